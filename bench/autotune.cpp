@@ -0,0 +1,375 @@
+// Parameter sweep and autotuning: restarts kv_server for every combination of
+// server settings, drives it with loadgen workloads and records throughput,
+// latency percentiles and resource usage. Reports the configuration with the
+// highest throughput per workload whose p99 stays within the latency SLO.
+//
+// Usage: ./autotune [--threads 4,8,16] [--pool 8,16,32] [--shards 4,16] [--capacity 1000,100000]
+//                   [--workloads get_popular,get_all,mix:80:10] [--clients 8,32] [--seconds 10]
+//                   [--slo-p99-ms 10] [--max-error-pct 1] [--config base.conf]
+//                   [--server ./kv_server] [--loadgen ./loadgen] [--port 8090] [--out autotune.csv]
+//
+// Settings are passed to kv_server as flags on top of --config (see config.h).
+// --pool sets DB_POOL_MAX_SIZE. Workloads are loadgen types, with mix ratios
+// after colons. kv_server is restarted for every (setting, workload) point, so
+// each point starts from a cold cache; it is warmed with loadgen before the
+// measured runs. The output of every process goes to autotune_logs/.
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <map>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include "httplib.h"
+#include "constants.h"
+
+struct TuneConfig {
+    std::vector<int> threads = {4, 8, 16};
+    std::vector<int> pool = {8, 16, 32};
+    std::vector<int> shards = {4, 16};
+    std::vector<int> capacity = {1000, 100000};
+    std::vector<std::string> workloads = {"get_popular", "get_all", "mix:80:10"};
+    std::vector<int> clients = {16};
+    int seconds = 10;
+    double slo_p99_ms = 10;
+    double max_error_pct = 1;
+    std::string config;
+    std::string server = "./kv_server";
+    std::string loadgen = "./loadgen";
+    int port = 8090;
+    std::string out = "autotune.csv";
+    std::string logs = "autotune_logs";
+};
+
+struct Point {
+    int threads, pool, shards, capacity;
+};
+
+struct Measurement {
+    std::string workload;
+    int clients = 0;
+    Point point;
+    bool ok = false;                // loadgen ran and reported results
+    std::map<std::string, double> summary;
+    double error_pct = 0;
+    double server_cpu_pct = 0;      // CPU time of kv_server / wall time (100 = one core)
+    double server_rss_mb = 0;
+    double server_peak_rss_mb = 0;
+    double loadgen_cpu_pct = 0;
+    bool meets_slo = false;
+};
+
+template <typename T>
+std::vector<T> parse_list(const std::string& s) {
+    std::vector<T> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        std::stringstream conv(item);
+        T v;
+        conv >> v;
+        out.push_back(v);
+    }
+    return out;
+}
+
+// Start `args` with stdout and stderr appended to `log`
+pid_t spawn(const std::vector<std::string>& args, const std::string& log) {
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+    int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd >= 0) {
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+    }
+    std::vector<char*> argv;
+    for (const auto& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+    argv.push_back(nullptr);
+    execv(argv[0], argv.data());
+    perror("execv");
+    _exit(127);
+}
+
+// utime + stime of a running process, in seconds
+double process_cpu_seconds(pid_t pid) {
+    std::ifstream f("/proc/" + std::to_string(pid) + "/stat");
+    std::string stat;
+    std::getline(f, stat);
+    size_t close_paren = stat.rfind(')');
+    if (close_paren == std::string::npos) return 0;
+    std::stringstream ss(stat.substr(close_paren + 2));
+    std::string field;
+    unsigned long long utime = 0, stime = 0;
+    // Fields after the command name start at 3 (state); utime and stime are 14 and 15
+    for (int i = 3; i <= 15 && ss >> field; ++i) {
+        if (i == 14) utime = std::stoull(field);
+        if (i == 15) stime = std::stoull(field);
+    }
+    return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+// VmRSS or VmHWM of a running process, in MB
+double process_memory_mb(pid_t pid, const std::string& field) {
+    std::ifstream f("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.compare(0, field.size() + 1, field + ":") == 0) return std::stod(line.substr(field.size() + 1)) / 1024.0;
+    }
+    return 0;
+}
+
+bool wait_ready(pid_t server, int port) {
+    httplib::Client cli("127.0.0.1", port);
+    cli.set_connection_timeout(0, 200000);
+    for (int i = 0; i < 300; ++i) {
+        if (waitpid(server, nullptr, WNOHANG) == server) return false;   // Exited during startup
+        auto res = cli.Get("/stats");
+        if (res && res->status == 200) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return false;
+}
+
+void stop_server(pid_t server) {
+    kill(server, SIGTERM);
+    for (int i = 0; i < 50; ++i) {
+        if (waitpid(server, nullptr, WNOHANG) == server) return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    kill(server, SIGKILL);
+    waitpid(server, nullptr, 0);
+}
+
+// loadgen <clients> <seconds> <type> [p1] [p2] for a workload such as "mix:80:10"
+std::vector<std::string> loadgen_args(const TuneConfig& cfg, const std::string& workload, int clients, int seconds) {
+    std::vector<std::string> args = {cfg.loadgen, std::to_string(clients), std::to_string(seconds)};
+    std::stringstream ss(workload);
+    std::string part;
+    while (std::getline(ss, part, ':')) args.push_back(part);
+    args.push_back("--port");
+    args.push_back(std::to_string(cfg.port));
+    return args;
+}
+
+// Run loadgen to completion; returns its CPU time in seconds, or -1 if it failed
+double run_loadgen(std::vector<std::string> args, const std::string& summary, const std::string& log) {
+    if (!summary.empty()) {
+        unlink(summary.c_str());
+        args.push_back("--summary");
+        args.push_back(summary);
+    }
+    pid_t pid = spawn(args, log);
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+std::map<std::string, double> read_summary(const std::string& path) {
+    std::map<std::string, double> out;
+    std::ifstream f(path);
+    std::string line;
+    while (std::getline(f, line)) {
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) continue;
+        char* end = nullptr;
+        double v = strtod(line.c_str() + eq + 1, &end);
+        if (end != line.c_str() + eq + 1) out[line.substr(0, eq)] = v;
+    }
+    return out;
+}
+
+std::string point_flags(const Point& p) {
+    return "--server-thread-pool-size " + std::to_string(p.threads) +
+           " --db-pool-max-size " + std::to_string(p.pool) +
+           " --cache-shards " + std::to_string(p.shards) +
+           " --cache-capacity-total " + std::to_string(p.capacity);
+}
+
+// One kv_server run: start it with the point's settings, warm it up with the
+// workload, then measure every client count
+std::vector<Measurement> run_point(const TuneConfig& cfg, const Point& p, const std::string& workload) {
+    std::vector<Measurement> results;
+    std::string tag = workload + "_t" + std::to_string(p.threads) + "_p" + std::to_string(p.pool) +
+                      "_s" + std::to_string(p.shards) + "_c" + std::to_string(p.capacity);
+    std::replace(tag.begin(), tag.end(), ':', '-');
+    std::string server_log = cfg.logs + "/" + tag + "_server.log";
+    std::string loadgen_log = cfg.logs + "/" + tag + "_loadgen.log";
+    std::string summary = cfg.logs + "/" + tag + ".summary";
+
+    std::vector<std::string> server_args = {cfg.server, std::to_string(cfg.port)};
+    if (!cfg.config.empty()) {
+        server_args.push_back("--config");
+        server_args.push_back(cfg.config);
+    }
+    std::stringstream flags(point_flags(p));
+    std::string flag;
+    while (flags >> flag) server_args.push_back(flag);
+    // A pool smaller than the default minimum would be rejected by the pool's own bounds
+    if (p.pool < Config::DB_POOL_MIN_SIZE) {
+        server_args.push_back("--db-pool-min-size");
+        server_args.push_back(std::to_string(p.pool));
+    }
+
+    pid_t server = spawn(server_args, server_log);
+    if (!wait_ready(server, cfg.port)) {
+        std::cerr << "kv_server did not start for " << tag << ", see " << server_log << "\n";
+        stop_server(server);
+        for (int clients : cfg.clients) {
+            Measurement m;
+            m.workload = workload;
+            m.clients = clients;
+            m.point = p;
+            results.push_back(m);
+        }
+        return results;
+    }
+
+    // Warm-up: loadgen's own pre-fill, then a short unmeasured run to heat the cache and pools
+    run_loadgen(loadgen_args(cfg, workload, std::min(*std::max_element(cfg.clients.begin(), cfg.clients.end()), 8), 2),
+                "", loadgen_log);
+
+    for (int clients : cfg.clients) {
+        Measurement m;
+        m.workload = workload;
+        m.clients = clients;
+        m.point = p;
+
+        std::vector<std::string> args = loadgen_args(cfg, workload, clients, cfg.seconds);
+        args.push_back("--no-warmup");
+        double cpu_before = process_cpu_seconds(server);
+        auto start = std::chrono::steady_clock::now();
+        double loadgen_cpu = run_loadgen(args, summary, loadgen_log);
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double cpu_after = process_cpu_seconds(server);
+
+        m.summary = read_summary(summary);
+        m.ok = loadgen_cpu >= 0 && m.summary.count("throughput") > 0;
+        if (m.ok) {
+            double requests = m.summary["requests"];
+            m.error_pct = requests > 0 ? (m.summary["failed"] + m.summary["shed"]) / requests * 100.0 : 100.0;
+            m.server_cpu_pct = (cpu_after - cpu_before) / wall * 100.0;
+            m.server_rss_mb = process_memory_mb(server, "VmRSS");
+            m.server_peak_rss_mb = process_memory_mb(server, "VmHWM");
+            m.loadgen_cpu_pct = loadgen_cpu / wall * 100.0;
+            m.meets_slo = m.summary["p99_ms"] <= cfg.slo_p99_ms && m.error_pct <= cfg.max_error_pct;
+        }
+        results.push_back(m);
+    }
+
+    stop_server(server);
+    return results;
+}
+
+int main(int argc, char* argv[]) {
+    TuneConfig cfg;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        std::string val = argv[i + 1];
+        if (arg == "--threads") cfg.threads = parse_list<int>(val);
+        else if (arg == "--pool") cfg.pool = parse_list<int>(val);
+        else if (arg == "--shards") cfg.shards = parse_list<int>(val);
+        else if (arg == "--capacity") cfg.capacity = parse_list<int>(val);
+        else if (arg == "--workloads") cfg.workloads = parse_list<std::string>(val);
+        else if (arg == "--clients") cfg.clients = parse_list<int>(val);
+        else if (arg == "--seconds") cfg.seconds = std::stoi(val);
+        else if (arg == "--slo-p99-ms") cfg.slo_p99_ms = std::stod(val);
+        else if (arg == "--max-error-pct") cfg.max_error_pct = std::stod(val);
+        else if (arg == "--config") cfg.config = val;
+        else if (arg == "--server") cfg.server = val;
+        else if (arg == "--loadgen") cfg.loadgen = val;
+        else if (arg == "--port") cfg.port = std::stoi(val);
+        else if (arg == "--out") cfg.out = val;
+        else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return 1;
+        }
+    }
+    if (cfg.threads.empty() || cfg.pool.empty() || cfg.shards.empty() || cfg.capacity.empty() ||
+        cfg.workloads.empty() || cfg.clients.empty()) {
+        std::cerr << "Every list needs at least one value\n";
+        return 1;
+    }
+    mkdir(cfg.logs.c_str(), 0755);
+
+    std::vector<Point> points;
+    for (int t : cfg.threads)
+        for (int p : cfg.pool)
+            for (int s : cfg.shards)
+                for (int c : cfg.capacity) points.push_back({t, p, s, c});
+
+    std::ofstream csv(cfg.out);
+    csv << std::fixed << std::setprecision(3);
+    csv << "workload,clients,threads,pool,shards,capacity,ok,throughput,mean_ms,p50_ms,p90_ms,p99_ms,p999_ms,"
+           "error_pct,hit_rate,server_cpu_pct,server_rss_mb,server_peak_rss_mb,loadgen_cpu_pct,meets_slo\n";
+
+    std::cout << ">>> " << points.size() << " configurations x " << cfg.workloads.size() << " workloads x "
+              << cfg.clients.size() << " client counts, " << cfg.seconds << "s each; SLO p99 <= " << cfg.slo_p99_ms
+              << " ms, errors <= " << cfg.max_error_pct << "%\n\n";
+    std::cout << std::left << std::setw(14) << "workload" << std::setw(8) << "clients" << std::setw(8) << "threads"
+              << std::setw(6) << "pool" << std::setw(8) << "shards" << std::setw(10) << "capacity" << std::right
+              << std::setw(12) << "req/s" << std::setw(9) << "p50ms" << std::setw(9) << "p99ms" << std::setw(8) << "err%"
+              << std::setw(8) << "cpu%" << std::setw(8) << "rssMB" << std::setw(5) << "slo" << "\n";
+
+    std::vector<Measurement> all;
+    for (const auto& workload : cfg.workloads) {
+        for (const auto& p : points) {
+            std::vector<Measurement> ms = run_point(cfg, p, workload);
+            for (auto& m : ms) {
+                std::cout << std::left << std::setw(14) << m.workload << std::setw(8) << m.clients << std::setw(8) << p.threads
+                          << std::setw(6) << p.pool << std::setw(8) << p.shards << std::setw(10) << p.capacity << std::right
+                          << std::fixed << std::setprecision(0) << std::setw(12) << m.summary["throughput"]
+                          << std::setprecision(2) << std::setw(9) << m.summary["p50_ms"] << std::setw(9) << m.summary["p99_ms"]
+                          << std::setw(8) << m.error_pct << std::setprecision(0) << std::setw(8) << m.server_cpu_pct
+                          << std::setw(8) << m.server_rss_mb << std::setw(5) << (!m.ok ? "ERR" : m.meets_slo ? "yes" : "no")
+                          << "\n";
+                csv << m.workload << "," << m.clients << "," << p.threads << "," << p.pool << "," << p.shards << ","
+                    << p.capacity << "," << (m.ok ? 1 : 0) << "," << m.summary["throughput"] << "," << m.summary["mean_ms"] << ","
+                    << m.summary["p50_ms"] << "," << m.summary["p90_ms"] << "," << m.summary["p99_ms"] << ","
+                    << m.summary["p999_ms"] << "," << m.error_pct << "," << m.summary["hit_rate"] << ","
+                    << m.server_cpu_pct << "," << m.server_rss_mb << "," << m.server_peak_rss_mb << ","
+                    << m.loadgen_cpu_pct << "," << (m.meets_slo ? 1 : 0) << "\n";
+                csv.flush();
+                all.push_back(m);
+            }
+        }
+    }
+
+    std::cout << "\n=== BEST CONFIGURATION PER WORKLOAD (p99 <= " << cfg.slo_p99_ms << " ms) ===\n";
+    for (const auto& workload : cfg.workloads) {
+        const Measurement* best = nullptr;
+        const Measurement* lowest_p99 = nullptr;
+        for (const auto& m : all) {
+            if (m.workload != workload || !m.ok) continue;
+            if (m.meets_slo && (best == nullptr || m.summary.at("throughput") > best->summary.at("throughput"))) best = &m;
+            if (lowest_p99 == nullptr || m.summary.at("p99_ms") < lowest_p99->summary.at("p99_ms")) lowest_p99 = &m;
+        }
+        std::cout << workload << ": ";
+        if (best != nullptr) {
+            std::cout << std::setprecision(0) << best->summary.at("throughput") << " req/s, p99 " << std::setprecision(2)
+                      << best->summary.at("p99_ms") << " ms at " << best->clients << " clients\n"
+                      << "    kv_server " << point_flags(best->point) << "\n";
+        } else if (lowest_p99 != nullptr) {
+            std::cout << "no configuration met the SLO; lowest p99 was " << std::setprecision(2)
+                      << lowest_p99->summary.at("p99_ms") << " ms (" << point_flags(lowest_p99->point) << ", "
+                      << lowest_p99->clients << " clients)\n";
+        } else {
+            std::cout << "no successful runs\n";
+        }
+    }
+    std::cout << "\nResults written to " << cfg.out << std::endl;
+    return 0;
+}
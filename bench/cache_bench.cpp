@@ -0,0 +1,255 @@
+// Cache-layer microbenchmark: drives ShardedLRUCache directly, without HTTP or MySQL.
+//
+// Usage: ./cache_bench [--threads 1,2,4,8] [--shards 1,4,16] [--dist uniform,zipf]
+//                      [--value-size 64,1024,16384] [--mix 90:5:5] [--keys 100000]
+//                      [--capacity 50000] [--seconds 2] [--out cache_bench.csv]
+//
+// Every combination of the comma-separated lists is run. --mix is get:put:remove
+// in percent. Results are printed as a table and written as CSV to --out.
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <malloc.h>
+#include "cache.h"
+
+struct BenchConfig {
+    std::vector<int> threads = {1, 2, 4, 8};
+    std::vector<int> shards = {1, 4, 16};
+    std::vector<std::string> dists = {"uniform", "zipf"};
+    std::vector<size_t> value_sizes = {64, 1024, 16384};
+    int pct_get = 90, pct_put = 5, pct_remove = 5;
+    size_t keys = 100000;
+    size_t capacity = 50000;
+    double seconds = 2.0;
+    std::string out = "cache_bench.csv";
+};
+
+struct RunResult {
+    uint64_t ops = 0;
+    double secs = 0;
+    double p50_ns = 0, p90_ns = 0, p99_ns = 0, p999_ns = 0;
+    double lock_wait_share = 0;   // Blocked time / total thread time
+    double bytes_per_entry = 0;
+    double hit_rate = 0;
+};
+
+// Time one op in every SAMPLE_EVERY so clock reads do not dominate
+const int SAMPLE_EVERY = 16;
+
+// Zipf(0.99) over [0, n) by inverse CDF
+class ZipfGenerator {
+private:
+    std::vector<double> cdf;
+
+public:
+    explicit ZipfGenerator(size_t n, double s = 0.99) : cdf(n) {
+        double sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += 1.0 / std::pow((double)(i + 1), s);
+            cdf[i] = sum;
+        }
+        for (auto& c : cdf) c /= sum;
+    }
+
+    size_t next(std::mt19937_64& rng) const {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        return std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+    }
+};
+
+template <typename T>
+std::vector<T> parse_list(const std::string& s) {
+    std::vector<T> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        std::stringstream conv(item);
+        T v;
+        conv >> v;
+        out.push_back(v);
+    }
+    return out;
+}
+
+std::string make_value(size_t size, size_t seed) {
+    // Half repetitive, half random: compressible like typical payloads, but not trivially
+    std::mt19937_64 rng(seed);
+    std::string v(size, 'a');
+    for (size_t i = size / 2; i < size; ++i) v[i] = (char)('a' + rng() % 26);
+    return v;
+}
+
+size_t heap_in_use() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+double percentile(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t idx = (size_t)(p / 100.0 * (sorted.size() - 1));
+    return sorted[idx];
+}
+
+RunResult run_one(const BenchConfig& cfg, int threads, int shards, const std::string& dist, size_t value_size,
+                  const ZipfGenerator& zipf) {
+    RunResult r;
+    std::vector<std::string> keys(cfg.keys);
+    for (size_t i = 0; i < cfg.keys; ++i) keys[i] = "key:" + std::to_string(i);
+    std::string value = make_value(value_size, value_size);
+
+    // Prefill to capacity and measure the heap cost per entry. Entries carry a
+    // version, as the server caches them: unversioned entries are misses.
+    size_t heap_before = heap_in_use();
+    ShardedLRUCache* cache = new ShardedLRUCache(cfg.capacity, shards);
+    size_t filled = std::min(cfg.capacity, cfg.keys);
+    for (size_t i = 0; i < filled; ++i) cache->put(keys[i], value, 1);
+    size_t heap_after = heap_in_use();
+    if (heap_after > heap_before && filled > 0) r.bytes_per_entry = (double)(heap_after - heap_before) / filled;
+
+    std::atomic<bool> go{false};
+    std::atomic<bool> stop{false};
+    std::vector<uint64_t> ops(threads, 0);
+    std::vector<std::vector<uint32_t>> samples(threads);
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::mt19937_64 rng(t * 7919 + 17);
+            std::uniform_int_distribution<size_t> uniform(0, cfg.keys - 1);
+            std::uniform_int_distribution<int> pct(0, 99);
+            std::vector<uint32_t>& local = samples[t];
+            local.reserve(1 << 20);
+            std::string out;
+            uint64_t n = 0;
+            while (!go.load(std::memory_order_acquire)) {}
+            while (!stop.load(std::memory_order_relaxed)) {
+                const std::string& key = keys[dist == "zipf" ? zipf.next(rng) : uniform(rng)];
+                int p = pct(rng);
+                bool sample = (n % SAMPLE_EVERY) == 0;
+                auto start = sample ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+                if (p < cfg.pct_get) cache->get(key, out);
+                else if (p < cfg.pct_get + cfg.pct_put) cache->put(key, value, 1);
+                else cache->remove(key);
+                if (sample) {
+                    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                    local.push_back((uint32_t)std::min<uint64_t>(ns, UINT32_MAX));
+                }
+                n++;
+            }
+            ops[t] = n;
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::duration<double>(cfg.seconds));
+    stop = true;
+    for (auto& w : workers) w.join();
+    r.secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<uint32_t> all;
+    for (int t = 0; t < threads; ++t) {
+        r.ops += ops[t];
+        all.insert(all.end(), samples[t].begin(), samples[t].end());
+    }
+    std::sort(all.begin(), all.end());
+    r.p50_ns = percentile(all, 50);
+    r.p90_ns = percentile(all, 90);
+    r.p99_ns = percentile(all, 99);
+    r.p999_ns = percentile(all, 99.9);
+
+    uint64_t hits = 0, misses = 0, wait_ns = 0;
+    for (const auto& s : cache->stats()) {
+        hits += s.hits;
+        misses += s.misses;
+        wait_ns += s.lock_wait_ns;
+    }
+    r.hit_rate = (hits + misses) > 0 ? (double)hits / (hits + misses) * 100.0 : 0.0;
+    r.lock_wait_share = wait_ns / (r.secs * 1e9 * threads) * 100.0;
+
+    delete cache;
+    return r;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig cfg;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        std::string val = argv[i + 1];
+        if (arg == "--threads") cfg.threads = parse_list<int>(val);
+        else if (arg == "--shards") cfg.shards = parse_list<int>(val);
+        else if (arg == "--dist") cfg.dists = parse_list<std::string>(val);
+        else if (arg == "--value-size") cfg.value_sizes = parse_list<size_t>(val);
+        else if (arg == "--keys") cfg.keys = std::stoul(val);
+        else if (arg == "--capacity") cfg.capacity = std::stoul(val);
+        else if (arg == "--seconds") cfg.seconds = std::stod(val);
+        else if (arg == "--out") cfg.out = val;
+        else if (arg == "--mix") {
+            std::replace(val.begin(), val.end(), ':', ',');
+            std::vector<int> mix = parse_list<int>(val);
+            if (mix.size() != 3 || mix[0] + mix[1] + mix[2] != 100) {
+                std::cerr << "--mix must be get:put:remove summing to 100\n";
+                return 1;
+            }
+            cfg.pct_get = mix[0];
+            cfg.pct_put = mix[1];
+            cfg.pct_remove = mix[2];
+        } else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return 1;
+        }
+    }
+    if (cfg.keys == 0) cfg.keys = 1;
+
+    std::ofstream csv(cfg.out);
+    csv << std::fixed;
+    csv << "threads,shards,dist,value_size,get_pct,put_pct,remove_pct,keys,capacity,ops,ops_per_sec,"
+           "p50_ns,p90_ns,p99_ns,p999_ns,lock_wait_pct,bytes_per_entry,hit_rate\n";
+
+    std::cout << ">>> Mix get/put/remove = " << cfg.pct_get << "/" << cfg.pct_put << "/" << cfg.pct_remove
+              << ", keys=" << cfg.keys << ", capacity=" << cfg.capacity
+              << ", compression " << (Config::CACHE_COMPRESSION_ENABLED ? ">= " + std::to_string(Config::CACHE_COMPRESS_THRESHOLD) + " bytes" : "off") << "\n\n";
+    std::cout << std::left << std::setw(8) << "threads" << std::setw(8) << "shards" << std::setw(9) << "dist"
+              << std::setw(8) << "value" << std::right << std::setw(14) << "ops/s" << std::setw(9) << "p50ns"
+              << std::setw(9) << "p99ns" << std::setw(10) << "p99.9ns" << std::setw(10) << "lockwait%"
+              << std::setw(10) << "B/entry" << std::setw(8) << "hit%" << "\n";
+
+    ZipfGenerator zipf(cfg.keys);
+    for (size_t vs : cfg.value_sizes) {
+        for (const auto& dist : cfg.dists) {
+            for (int shards : cfg.shards) {
+                for (int threads : cfg.threads) {
+                    RunResult r = run_one(cfg, threads, shards, dist, vs, zipf);
+                    double tput = r.ops / r.secs;
+                    std::cout << std::left << std::setw(8) << threads << std::setw(8) << shards << std::setw(9) << dist
+                              << std::setw(8) << vs << std::right << std::fixed << std::setprecision(0)
+                              << std::setw(14) << tput << std::setw(9) << r.p50_ns << std::setw(9) << r.p99_ns
+                              << std::setw(10) << r.p999_ns << std::setprecision(2) << std::setw(10) << r.lock_wait_share
+                              << std::setprecision(0) << std::setw(10) << r.bytes_per_entry
+                              << std::setprecision(1) << std::setw(8) << r.hit_rate << "\n";
+                    csv << threads << "," << shards << "," << dist << "," << vs << ","
+                        << cfg.pct_get << "," << cfg.pct_put << "," << cfg.pct_remove << ","
+                        << cfg.keys << "," << cfg.capacity << "," << r.ops << "," << std::setprecision(2) << tput << ","
+                        << r.p50_ns << "," << r.p90_ns << "," << r.p99_ns << "," << r.p999_ns << ","
+                        << r.lock_wait_share << "," << r.bytes_per_entry << "," << r.hit_rate << "\n";
+                }
+            }
+        }
+    }
+
+    std::cout << "\nResults written to " << cfg.out << std::endl;
+    return 0;
+}
@@ -0,0 +1,311 @@
+// In-process server benchmark: feeds raw HTTP request bytes through httplib's
+// request parser, router and the kv_server handlers, without sockets.
+//
+// Usage: ./server_bench [--workload hit|miss|create|update|delete|mix] [--threads 4]
+//                       [--requests 100000] [--keys 1000] [--value-size 64]
+//                       [--db <host>] [--out server_bench.csv]
+//
+// `hit` pre-fills the cache directly and never touches the database. Every other
+// workload runs against the MySQL server given by --db (default Config::DB_HOST).
+// Reported per request: wall latency, thread CPU time and heap allocations.
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <new>
+#include <cstddef>
+#include <cstdlib>
+#include <ctime>
+#include "server.h"
+
+// --- ALLOCATION COUNTING ---
+// Global operator new is replaced so each thread can count the allocations made by a request.
+// Every form is replaced (plain, array, nothrow, aligned, sized) so that all of them pair with
+// the same allocator; the release path stays out of line so the compiler does not see free()
+// applied to operator new's result.
+static thread_local uint64_t tl_allocs = 0;
+static thread_local uint64_t tl_alloc_bytes = 0;
+
+static void* counted_alloc(std::size_t size, std::size_t align) noexcept {
+    tl_allocs++;
+    tl_alloc_bytes += size;
+    if (size == 0) size = 1;
+    if (align <= alignof(std::max_align_t)) return std::malloc(size);
+    void* p = nullptr;
+    return posix_memalign(&p, align, size) == 0 ? p : nullptr;
+}
+
+static void* counted_alloc_or_throw(std::size_t size, std::size_t align) {
+    void* p = counted_alloc(size, align);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+__attribute__((noinline)) static void counted_free(void* p) noexcept { std::free(p); }
+
+void* operator new(std::size_t size) { return counted_alloc_or_throw(size, 0); }
+void* operator new[](std::size_t size) { return counted_alloc_or_throw(size, 0); }
+void* operator new(std::size_t size, std::align_val_t align) { return counted_alloc_or_throw(size, (std::size_t)align); }
+void* operator new[](std::size_t size, std::align_val_t align) { return counted_alloc_or_throw(size, (std::size_t)align); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size, 0); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size, 0); }
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return counted_alloc(size, (std::size_t)align); }
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return counted_alloc(size, (std::size_t)align); }
+
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { counted_free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { counted_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { counted_free(p); }
+
+// --- IN-MEMORY TRANSPORT ---
+// A Stream that reads one request from a string and collects the response
+class MemoryStream : public httplib::Stream {
+private:
+    const std::string& in;
+    size_t pos = 0;
+    std::string& out;
+
+public:
+    MemoryStream(const std::string& in_, std::string& out_) : in(in_), out(out_) {}
+
+    bool is_readable() const override { return pos < in.size(); }
+    bool wait_readable() const override { return true; }
+    bool wait_writable() const override { return true; }
+
+    ssize_t read(char* ptr, size_t size) override {
+        size_t n = std::min(size, in.size() - pos);
+        in.copy(ptr, n, pos);
+        pos += n;
+        return (ssize_t)n;
+    }
+
+    ssize_t write(const char* ptr, size_t size) override {
+        out.append(ptr, size);
+        return (ssize_t)size;
+    }
+
+    void get_remote_ip_and_port(std::string& ip, int& port) const override {
+        ip = "127.0.0.1";
+        port = 0;
+    }
+
+    void get_local_ip_and_port(std::string& ip, int& port) const override {
+        ip = "127.0.0.1";
+        port = Config::SERVER_PORT;
+    }
+
+    socket_t socket() const override { return INVALID_SOCKET; }
+    time_t duration() const override { return 0; }
+};
+
+// Server whose registered routes can be driven with in-memory requests
+class InProcessServer : public httplib::Server {
+public:
+    // Parse `raw`, route it and write the serialized response to `response`
+    bool dispatch(const std::string& raw, std::string& response) {
+        MemoryStream strm(raw, response);
+        bool closed = false;
+        return process_request(strm, "127.0.0.1", 0, "127.0.0.1", Config::SERVER_PORT, true, closed, nullptr);
+    }
+};
+
+// --- WORKLOADS ---
+enum Workload { HIT, MISS, CREATE, UPDATE, DELETE_KEYS, MIX };
+
+std::string raw_get(const std::string& key) {
+    return "GET /api/data?key=" + key + " HTTP/1.1\r\nHost: bench\r\n\r\n";
+}
+
+std::string raw_form(const char* method, const std::string& key, const std::string& val) {
+    std::string body = "key=" + key + "&val=" + val;
+    return std::string(method) + " /api/data HTTP/1.1\r\nHost: bench\r\n"
+           "Content-Type: application/x-www-form-urlencoded\r\n"
+           "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+std::string raw_delete(const std::string& key) {
+    return "DELETE /api/data?key=" + key + " HTTP/1.1\r\nHost: bench\r\n\r\n";
+}
+
+uint64_t thread_cpu_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct ThreadResult {
+    std::vector<uint32_t> wall_ns;
+    uint64_t cpu_ns = 0;
+    uint64_t allocs = 0;
+    uint64_t alloc_bytes = 0;
+    uint64_t ok = 0;
+    uint64_t errors = 0;
+};
+
+double percentile(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    return sorted[(size_t)(p / 100.0 * (sorted.size() - 1))];
+}
+
+int main(int argc, char* argv[]) {
+    std::string workload_s = "hit";
+    int threads = 4;
+    long requests = 100000;
+    int keys = 1000;
+    size_t value_size = 64;
+    std::string out_path = "server_bench.csv";
+    ServerOptions opts;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        std::string val = argv[i + 1];
+        if (arg == "--workload") workload_s = val;
+        else if (arg == "--threads") threads = std::stoi(val);
+        else if (arg == "--requests") requests = std::stol(val);
+        else if (arg == "--keys") keys = std::stoi(val);
+        else if (arg == "--value-size") value_size = std::stoul(val);
+        else if (arg == "--db") opts.db_host = val;
+        else if (arg == "--out") out_path = val;
+        else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return 1;
+        }
+    }
+
+    Workload workload;
+    if (workload_s == "hit") workload = HIT;
+    else if (workload_s == "miss") workload = MISS;
+    else if (workload_s == "create") workload = CREATE;
+    else if (workload_s == "update") workload = UPDATE;
+    else if (workload_s == "delete") workload = DELETE_KEYS;
+    else if (workload_s == "mix") workload = MIX;
+    else {
+        std::cerr << "Invalid workload.\n";
+        return 1;
+    }
+
+    init_services(opts);
+    InProcessServer svr;
+    register_routes(svr);
+
+    std::string value(value_size, 'v');
+    if (workload == HIT) {
+        // With a row version, as a database read would cache it; unversioned entries are misses
+        for (int k = 0; k < keys; ++k) cache->put(std::to_string(k), value, versionClock->now());
+    }
+
+    // Pre-build the request bytes so only server-side work is measured
+    std::vector<std::string> gets, posts, puts, deletes;
+    for (int k = 0; k < keys; ++k) {
+        std::string key = std::to_string(k);
+        gets.push_back(raw_get(key));
+        posts.push_back(raw_form("POST", key, value));
+        puts.push_back(raw_form("PUT", key, value));
+        deletes.push_back(raw_delete(key));
+    }
+
+    std::cout << ">>> Driving " << requests << " in-process requests (" << workload_s << ") with " << threads << " threads...\n";
+    std::vector<ThreadResult> results(threads);
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            ThreadResult& r = results[t];
+            long n = requests / threads + (t < requests % threads ? 1 : 0);
+            r.wall_ns.reserve(n);
+            std::mt19937 rng(t + 1);
+            std::uniform_int_distribution<int> key_dist(0, keys - 1);
+            std::uniform_int_distribution<int> pct(0, 99);
+            std::string response;
+            response.reserve(4096);
+
+            for (long i = 0; i < n; ++i) {
+                int k = key_dist(rng);
+                const std::string* raw = &gets[k];
+                if (workload == CREATE) raw = &posts[k];
+                else if (workload == UPDATE) raw = &puts[k];
+                else if (workload == DELETE_KEYS) raw = &deletes[k];
+                else if (workload == MIX) {
+                    int p = pct(rng);
+                    raw = p < 80 ? &gets[k] : p < 90 ? &posts[k] : &deletes[k];
+                } else if (workload == MISS) {
+                    cache->remove(std::to_string(k));
+                }
+
+                response.clear();
+                uint64_t allocs_before = tl_allocs;
+                uint64_t bytes_before = tl_alloc_bytes;
+                uint64_t cpu_before = thread_cpu_ns();
+                auto wall_before = std::chrono::steady_clock::now();
+
+                bool ok = svr.dispatch(*raw, response);
+
+                auto wall_after = std::chrono::steady_clock::now();
+                r.cpu_ns += thread_cpu_ns() - cpu_before;
+                r.allocs += tl_allocs - allocs_before;
+                r.alloc_bytes += tl_alloc_bytes - bytes_before;
+                r.wall_ns.push_back((uint32_t)std::min<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(wall_after - wall_before).count(), UINT32_MAX));
+
+                // Status line: "HTTP/1.1 200 OK"
+                bool success = ok && response.size() > 12 && (response[9] == '2' || response.compare(9, 3, "404") == 0);
+                if (success) r.ok++;
+                else r.errors++;
+            }
+        });
+    }
+    for (auto& w : workers) w.join();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<uint32_t> wall;
+    uint64_t cpu_ns = 0, allocs = 0, alloc_bytes = 0, ok = 0, errors = 0;
+    for (auto& r : results) {
+        wall.insert(wall.end(), r.wall_ns.begin(), r.wall_ns.end());
+        cpu_ns += r.cpu_ns;
+        allocs += r.allocs;
+        alloc_bytes += r.alloc_bytes;
+        ok += r.ok;
+        errors += r.errors;
+    }
+    std::sort(wall.begin(), wall.end());
+    uint64_t total = wall.size();
+    double tput = total / secs;
+    double cpu_us = total > 0 ? cpu_ns / 1000.0 / total : 0;
+    double allocs_per = total > 0 ? (double)allocs / total : 0;
+    double bytes_per = total > 0 ? (double)alloc_bytes / total : 0;
+
+    std::cout << "\n=== RESULTS ===\n";
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Throughput: " << tput << " req/sec\n";
+    std::cout << "Latency: p50=" << percentile(wall, 50) / 1000.0 << " us p99=" << percentile(wall, 99) / 1000.0
+              << " us p99.9=" << percentile(wall, 99.9) / 1000.0 << " us\n";
+    std::cout << "CPU: " << cpu_us << " us/request\n";
+    std::cout << "Allocations: " << allocs_per << " allocs/request, " << bytes_per << " bytes/request\n";
+    std::cout << "Responses: OK=" << ok << " Errors=" << errors << "\n";
+
+    std::ofstream csv(out_path);
+    csv << std::fixed << std::setprecision(2);
+    csv << "workload,threads,requests,value_size,req_per_sec,p50_us,p99_us,p999_us,cpu_us_per_req,allocs_per_req,alloc_bytes_per_req,errors\n";
+    csv << workload_s << "," << threads << "," << total << "," << value_size << "," << tput << ","
+        << percentile(wall, 50) / 1000.0 << "," << percentile(wall, 99) / 1000.0 << "," << percentile(wall, 99.9) / 1000.0 << ","
+        << cpu_us << "," << allocs_per << "," << bytes_per << "," << errors << "\n";
+    std::cout << "Results written to " << out_path << std::endl;
+
+    shutdown_services();
+    return 0;
+}
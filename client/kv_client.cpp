@@ -0,0 +1,325 @@
+#include <sstream>
+#include <cstdlib>
+#include "kv_client.h"
+
+namespace kv {
+
+// Keys per connection below which a batch is not split further
+static const size_t MIN_KEYS_PER_CHUNK = 32;
+
+ConnectionPool::ConnectionPool(const std::string& host_in, int port_in, const ClientOptions& opts_in)
+    : host(host_in), port(port_in), max_idle(opts_in.connections_per_node), opts(opts_in) {}
+
+std::unique_ptr<httplib::Client> ConnectionPool::borrow() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!idle.empty()) {
+            std::unique_ptr<httplib::Client> cli = std::move(idle.back());
+            idle.pop_back();
+            return cli;
+        }
+    }
+    std::unique_ptr<httplib::Client> cli(new httplib::Client(host, port));
+    cli->set_keep_alive(true);
+    cli->set_tcp_nodelay(true);
+    cli->set_connection_timeout(0, opts.connect_timeout_ms * 1000);
+    cli->set_read_timeout(opts.read_timeout_ms / 1000, (opts.read_timeout_ms % 1000) * 1000);
+    cli->set_write_timeout(opts.write_timeout_ms / 1000, (opts.write_timeout_ms % 1000) * 1000);
+    return cli;
+}
+
+void ConnectionPool::release(std::unique_ptr<httplib::Client> cli) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (idle.size() < max_idle) idle.push_back(std::move(cli));
+}
+
+Client::Client(const ClientOptions& opts_in) : opts(opts_in) {
+    setNodes(opts.nodes);
+    int n = opts.io_threads > 0 ? opts.io_threads : 1;
+    for (int i = 0; i < n; ++i) workers.emplace_back(&Client::workerLoop, this);
+}
+
+Client::Client(const std::string& host, int port) : Client([&] {
+    ClientOptions o;
+    o.host = host;
+    o.port = port;
+    return o;
+}()) {}
+
+Client::~Client() {
+    {
+        std::lock_guard<std::mutex> lock(task_mtx);
+        stopping = true;
+    }
+    task_cv.notify_all();
+    for (auto& t : workers) t.join();
+}
+
+void Client::setNodes(const std::vector<std::string>& nodes) {
+    HashRing next;
+    for (const auto& n : nodes) next.addNode(n, Config::CLUSTER_VNODES);
+    std::lock_guard<std::mutex> lock(ring_mtx);
+    ring = next;
+}
+
+std::string Client::nodeFor(const std::string& key) const {
+    std::lock_guard<std::mutex> lock(ring_mtx);
+    if (ring.empty()) return opts.host + ":" + std::to_string(opts.port);
+    return ring.owner(key);
+}
+
+ConnectionPool* Client::pool(const std::string& node) {
+    std::lock_guard<std::mutex> lock(pools_mtx);
+    auto it = pools.find(node);
+    if (it != pools.end()) return it->second.get();
+    std::string host;
+    int port;
+    Cluster::splitNode(node, host, port);
+    ConnectionPool* p = new ConnectionPool(host, port, opts);
+    pools[node].reset(p);
+    return p;
+}
+
+Result Client::send(httplib::Client& cli, const Request& r) {
+    httplib::Result res;
+    std::string path = "/api/data?key=" + httplib::encode_query_component(r.key);
+    switch (r.op) {
+        case GET:
+            res = cli.Get(path);
+            break;
+        // Large values go as the raw body, which the server streams into MySQL
+        case POST:
+            if (r.value.size() > Config::LARGE_VALUE_THRESHOLD) res = cli.Post(path, r.value, "application/octet-stream");
+            else res = cli.Post("/api/data", httplib::Params{{"key", r.key}, {"val", r.value}});
+            break;
+        case PUT: {
+            httplib::Params params{{"key", r.key}, {"val", r.value}};
+            if (r.conditional) {
+                path += "&if_version=" + std::to_string(r.if_version);
+                params.emplace("if_version", std::to_string(r.if_version));
+            }
+            if (r.value.size() > Config::LARGE_VALUE_THRESHOLD) res = cli.Put(path, r.value, "application/octet-stream");
+            else res = cli.Put("/api/data", params);
+            break;
+        }
+        case DELETE:
+            res = cli.Delete(path);
+            break;
+    }
+
+    Result out;
+    if (!res) {
+        out.error = httplib::to_string(res.error());
+        return out;
+    }
+    out.status = res->status;
+    out.value = std::move(res->body);
+    out.cache_status = res->get_header_value("X-Cache-Status");
+    out.server_timing = res->get_header_value("Server-Timing");
+    out.node = res->get_header_value("X-KV-Node");
+    out.version = std::strtoull(res->get_header_value("X-KV-Version", "0").c_str(), nullptr, 10);
+    if (!out.node.empty()) misroutes++;
+    return out;
+}
+
+std::vector<std::pair<std::string, double>> Result::stages() const {
+    std::vector<std::pair<std::string, double>> out;
+    std::stringstream ss(server_timing);
+    std::string metric;
+    while (std::getline(ss, metric, ',')) {
+        size_t begin = metric.find_first_not_of(' ');
+        size_t semi = metric.find(';');
+        size_t dur = metric.find("dur=");
+        if (begin == std::string::npos || semi == std::string::npos || dur == std::string::npos) continue;
+        out.emplace_back(metric.substr(begin, semi - begin), std::atof(metric.c_str() + dur + 4));
+    }
+    return out;
+}
+
+Result Client::execute(const Request& r) {
+    ConnectionPool* p = pool(nodeFor(r.key));
+    std::unique_ptr<httplib::Client> cli = p->borrow();
+    Result out = send(*cli, r);
+    // A connection that failed is in an unknown state; let it close
+    if (out.status != 0) p->release(std::move(cli));
+    return out;
+}
+
+Result Client::get(const std::string& key) { return execute({GET, key, ""}); }
+Result Client::put(const std::string& key, const std::string& value) { return execute({POST, key, value}); }
+Result Client::update(const std::string& key, const std::string& value) { return execute({PUT, key, value}); }
+Result Client::update(const std::string& key, const std::string& value, uint64_t if_version) {
+    return execute({PUT, key, value, true, if_version});
+}
+Result Client::del(const std::string& key) { return execute({DELETE, key, ""}); }
+
+Result Client::stats() {
+    ConnectionPool* p = pool(opts.host + ":" + std::to_string(opts.port));
+    std::unique_ptr<httplib::Client> cli = p->borrow();
+    httplib::Result res = cli->Get("/stats");
+    Result out;
+    if (!res) {
+        out.error = httplib::to_string(res.error());
+        return out;
+    }
+    out.status = res->status;
+    out.value = std::move(res->body);
+    p->release(std::move(cli));
+    return out;
+}
+
+void Client::enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(task_mtx);
+        tasks.push_back(std::move(task));
+    }
+    task_cv.notify_one();
+}
+
+void Client::workerLoop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(task_mtx);
+            task_cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) return;  // Stopping and drained
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+std::future<Result> Client::submit(Request r) {
+    std::shared_ptr<std::promise<Result>> promise = std::make_shared<std::promise<Result>>();
+    std::future<Result> f = promise->get_future();
+    enqueue([this, r, promise] { promise->set_value(execute(r)); });
+    return f;
+}
+
+void Client::submit(Request r, Callback cb) {
+    enqueue([this, r, cb] { cb(execute(r)); });
+}
+
+std::future<Result> Client::getAsync(const std::string& key) { return submit({GET, key, ""}); }
+std::future<Result> Client::putAsync(const std::string& key, const std::string& value) { return submit({POST, key, value}); }
+std::future<Result> Client::updateAsync(const std::string& key, const std::string& value) { return submit({PUT, key, value}); }
+std::future<Result> Client::delAsync(const std::string& key) { return submit({DELETE, key, ""}); }
+
+void Client::getAsync(const std::string& key, Callback cb) { submit({GET, key, ""}, std::move(cb)); }
+void Client::putAsync(const std::string& key, const std::string& value, Callback cb) { submit({POST, key, value}, std::move(cb)); }
+void Client::updateAsync(const std::string& key, const std::string& value, Callback cb) { submit({PUT, key, value}, std::move(cb)); }
+void Client::delAsync(const std::string& key, Callback cb) { submit({DELETE, key, ""}, std::move(cb)); }
+
+std::vector<Result> Client::batch(const std::vector<Request>& reqs) {
+    std::vector<Result> results(reqs.size());
+
+    // Group request indexes by owner node, then split each group into chunks
+    // that each run back-to-back on one keep-alive connection
+    std::map<std::string, std::vector<size_t>> by_node;
+    for (size_t i = 0; i < reqs.size(); ++i) by_node[nodeFor(reqs[i].key)].push_back(i);
+
+    std::vector<std::pair<std::string, std::vector<size_t>>> chunks;
+    for (auto& group : by_node) {
+        size_t n = group.second.size();
+        size_t parts = std::max<size_t>(1, std::min<size_t>(opts.connections_per_node, n / MIN_KEYS_PER_CHUNK));
+        size_t per = (n + parts - 1) / parts;
+        for (size_t start = 0; start < n; start += per) {
+            size_t end = std::min(n, start + per);
+            chunks.push_back({group.first, std::vector<size_t>(group.second.begin() + start, group.second.begin() + end)});
+        }
+    }
+
+    std::mutex done_mtx;
+    std::condition_variable done_cv;
+    size_t remaining = chunks.size();
+
+    auto run = [&](size_t c) {
+        ConnectionPool* p = pool(chunks[c].first);
+        std::unique_ptr<httplib::Client> cli = p->borrow();
+        bool healthy = true;
+        for (size_t idx : chunks[c].second) {
+            if (!healthy) cli = p->borrow();
+            results[idx] = send(*cli, reqs[idx]);
+            healthy = results[idx].status != 0;
+        }
+        if (healthy) p->release(std::move(cli));
+        std::lock_guard<std::mutex> lock(done_mtx);
+        if (--remaining == 0) done_cv.notify_all();
+    };
+
+    // The caller runs the first chunk itself
+    for (size_t c = 1; c < chunks.size(); ++c) enqueue([&run, c] { run(c); });
+    if (!chunks.empty()) run(0);
+
+    // Help drain the queue while waiting, so a batch issued from a callback cannot starve
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(done_mtx);
+            if (remaining == 0) break;
+        }
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> lock(task_mtx);
+            if (!tasks.empty()) {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+        }
+        if (task) {
+            task();
+        } else {
+            std::unique_lock<std::mutex> lock(done_mtx);
+            done_cv.wait_for(lock, std::chrono::milliseconds(1), [&] { return remaining == 0; });
+        }
+    }
+    return results;
+}
+
+std::vector<Result> Client::multiGet(const std::vector<std::string>& keys) {
+    std::vector<Request> reqs;
+    reqs.reserve(keys.size());
+    for (const auto& k : keys) reqs.push_back({GET, k, ""});
+    return batch(reqs);
+}
+
+std::vector<Result> Client::multiPut(const std::vector<std::pair<std::string, std::string>>& items) {
+    std::vector<Request> reqs;
+    reqs.reserve(items.size());
+    for (const auto& kv : items) reqs.push_back({POST, kv.first, kv.second});
+    return batch(reqs);
+}
+
+std::vector<Result> Client::multiDel(const std::vector<std::string>& keys) {
+    std::vector<Request> reqs;
+    reqs.reserve(keys.size());
+    for (const auto& k : keys) reqs.push_back({DELETE, k, ""});
+    return batch(reqs);
+}
+
+Result Client::bulkLoad(const std::vector<std::pair<std::string, std::string>>& items, bool populate_cache) {
+    // Records are "<klen> <vlen>\n<key><value>"; any node can load keys it does not own
+    std::string body;
+    size_t bytes = 0;
+    for (const auto& kv : items) bytes += kv.first.size() + kv.second.size() + 24;
+    body.reserve(bytes);
+    for (const auto& kv : items) {
+        body += std::to_string(kv.first.size()) + " " + std::to_string(kv.second.size()) + "\n";
+        body += kv.first;
+        body += kv.second;
+    }
+    ConnectionPool* p = pool(nodeFor(items.empty() ? "" : items.front().first));
+    std::unique_ptr<httplib::Client> cli = p->borrow();
+    httplib::Result res = cli->Post(populate_cache ? "/api/bulk?cache=1" : "/api/bulk", body, "application/octet-stream");
+    Result out;
+    if (!res) {
+        out.error = httplib::to_string(res.error());
+        return out;
+    }
+    out.status = res->status;
+    out.value = std::move(res->body);
+    p->release(std::move(cli));
+    return out;
+}
+
+} // namespace kv
@@ -0,0 +1,158 @@
+#ifndef KV_CLIENT_H
+#define KV_CLIENT_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <future>
+#include <functional>
+#include <atomic>
+#include <utility>
+#include "httplib.h"
+#include "cluster.h"
+
+namespace kv {
+
+// Outcome of one request. status is the HTTP status, or 0 if the request never got an answer.
+struct Result {
+    int status = 0;
+    std::string value;          // Response body
+    std::string cache_status;   // "HIT" / "MISS" on reads, empty otherwise
+    std::string node;           // Node that served the request (X-KV-Node), empty if not forwarded
+    std::string error;          // Transport error when status == 0
+    std::string server_timing;  // Server-Timing header: "stage;dur=ms, ..., total;dur=ms"
+    uint64_t version = 0;       // Key version (X-KV-Version) after a read or write, or the current one on a 409
+
+    bool ok() const { return status >= 200 && status < 300; }
+    bool hit() const { return cache_status == "HIT"; }
+    // Server-Timing parsed into (stage, milliseconds) pairs
+    std::vector<std::pair<std::string, double>> stages() const;
+};
+
+struct ClientOptions {
+    std::string host = Config::SERVER_ADDRESS;
+    int port = Config::SERVER_PORT;
+    std::vector<std::string> nodes;     // "host:port" of every cluster node; empty sends everything to host:port
+    int connections_per_node = 8;       // Keep-alive connections kept open per node
+    int io_threads = 4;                 // Workers running async requests and batch fan-out
+    int connect_timeout_ms = 300;
+    int read_timeout_ms = 5000;
+    int write_timeout_ms = 5000;
+};
+
+// Keep-alive connections to one server. Borrowing never blocks: when every
+// connection is busy a new one is opened, and at most `max_idle` are kept.
+class ConnectionPool {
+private:
+    std::string host;
+    int port;
+    size_t max_idle;
+    const ClientOptions& opts;
+    std::mutex mtx;
+    std::vector<std::unique_ptr<httplib::Client>> idle;
+
+public:
+    ConnectionPool(const std::string& host_in, int port_in, const ClientOptions& opts_in);
+
+    std::unique_ptr<httplib::Client> borrow();
+    void release(std::unique_ptr<httplib::Client> cli);
+};
+
+// Client for kv_server. Synchronous calls run on the caller's thread; *Async
+// calls and the batch calls run on an internal worker pool. Requests for a key
+// go straight to the node that owns it (same consistent-hash ring as the
+// server), so cluster mode costs no extra forwarding hop.
+//
+// All methods are thread-safe; one Client should be shared by the whole process.
+class Client {
+public:
+    using Callback = std::function<void(Result)>;
+
+    explicit Client(const ClientOptions& opts = ClientOptions());
+    Client(const std::string& host, int port);
+    ~Client();
+
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    Result get(const std::string& key);
+    Result put(const std::string& key, const std::string& value);      // POST: insert or overwrite
+    Result update(const std::string& key, const std::string& value);   // PUT: 404 if the key does not exist
+    // PUT only if the key is still at `if_version`: 409 with the current version otherwise
+    Result update(const std::string& key, const std::string& value, uint64_t if_version);
+    Result del(const std::string& key);
+    Result stats();
+
+    std::future<Result> getAsync(const std::string& key);
+    std::future<Result> putAsync(const std::string& key, const std::string& value);
+    std::future<Result> updateAsync(const std::string& key, const std::string& value);
+    std::future<Result> delAsync(const std::string& key);
+
+    void getAsync(const std::string& key, Callback cb);
+    void putAsync(const std::string& key, const std::string& value, Callback cb);
+    void updateAsync(const std::string& key, const std::string& value, Callback cb);
+    void delAsync(const std::string& key, Callback cb);
+
+    // Batches: keys are grouped by owner node, each group is split across up to
+    // connections_per_node keep-alive connections, and requests on a connection
+    // are sent back to back. Results are returned in input order.
+    std::vector<Result> multiGet(const std::vector<std::string>& keys);
+    std::vector<Result> multiPut(const std::vector<std::pair<std::string, std::string>>& items);
+    std::vector<Result> multiDel(const std::vector<std::string>& keys);
+
+    // Insert or overwrite many keys in one POST /api/bulk, written to MySQL in
+    // large transactions. With populate_cache the server also caches the values.
+    // The body reports the rows loaded; on failure, earlier transactions stay.
+    Result bulkLoad(const std::vector<std::pair<std::string, std::string>>& items, bool populate_cache = false);
+
+    // Node a key is sent to
+    std::string nodeFor(const std::string& key) const;
+
+    // Replace the cluster member list (e.g. after POST /cluster/members)
+    void setNodes(const std::vector<std::string>& nodes);
+
+    // Requests that the server had to forward to another node (stale member list)
+    uint64_t misrouted() const { return misroutes; }
+
+private:
+    enum Op { GET, POST, PUT, DELETE };
+
+    struct Request {
+        Op op;
+        std::string key;
+        std::string value;
+        bool conditional = false;
+        uint64_t if_version = 0;
+    };
+
+    ClientOptions opts;
+    HashRing ring;
+    mutable std::mutex ring_mtx;
+    std::map<std::string, std::unique_ptr<ConnectionPool>> pools;
+    std::mutex pools_mtx;
+    std::atomic<uint64_t> misroutes{0};
+
+    std::deque<std::function<void()>> tasks;
+    std::mutex task_mtx;
+    std::condition_variable task_cv;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    ConnectionPool* pool(const std::string& node);
+    Result send(httplib::Client& cli, const Request& r);
+    Result execute(const Request& r);
+    std::future<Result> submit(Request r);
+    void submit(Request r, Callback cb);
+    std::vector<Result> batch(const std::vector<Request>& reqs);
+    void enqueue(std::function<void()> task);
+    void workerLoop();
+};
+
+} // namespace kv
+
+#endif // KV_CLIENT_H
@@ -0,0 +1,139 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include "constants.h"
+#include "histogram.h"
+
+struct AdmissionStats {
+    bool enabled = false;
+    bool overloaded = false;
+    bool shedding_writes = false;
+    int queued = 0;                  // Connections waiting for a worker thread
+    uint64_t overload_episodes = 0;
+    uint64_t shed_writes = 0;
+    uint64_t shed_misses = 0;
+    double queue_delay_avg_ms = 0;
+    double queue_delay_p99_ms = 0;
+};
+
+// Ingress admission control. The server's task queue reports how long each
+// connection waited for a worker thread. As in CoDel, the server counts as
+// overloaded once that delay has stayed above ADMISSION_TARGET_MS for a whole
+// ADMISSION_INTERVAL_MS (a short burst is absorbed), or when the queue grows past
+// ADMISSION_QUEUE_LIMIT. One delay under the target, or an empty queue, ends it.
+//
+// Work is shed by cost. Writes have their own, lower thresholds
+// (ADMISSION_WRITE_TARGET_MS, ADMISSION_WRITE_QUEUE_LIMIT), so they are refused
+// first; reads that miss the cache are refused once the server is overloaded;
+// cache hits are always served. Refused requests get 503 with Retry-After
+// before they borrow a DB connection.
+class AdmissionController {
+private:
+    // CoDel state for one delay target
+    struct Detector {
+        std::atomic<bool> above{false};         // Verdict from the sojourn times
+        uint64_t above_deadline_ns = 0;         // A delay above target at or after this sets `above`; 0 while below. Protected by mtx.
+
+        // Returns true when the verdict turns to above
+        bool update(uint64_t sojourn_ns, uint64_t target_ns, uint64_t interval_ns, uint64_t now) {
+            if (sojourn_ns < target_ns) {
+                above_deadline_ns = 0;
+                above = false;
+            } else if (above_deadline_ns == 0) {
+                above_deadline_ns = now + interval_ns;
+            } else if (now >= above_deadline_ns && !above) {
+                above = true;
+                return true;
+            }
+            return false;
+        }
+    };
+
+    std::atomic<int> queued{0};
+    std::atomic<uint64_t> overload_episodes{0};
+    std::atomic<uint64_t> shed_writes{0};
+    std::atomic<uint64_t> shed_misses{0};
+    LatencyHistogram queue_delay;
+
+    std::mutex mtx;                             // Protects the detectors' deadlines
+    Detector overload;                          // ADMISSION_TARGET_MS: misses are shed
+    Detector write_overload;                    // ADMISSION_WRITE_TARGET_MS: writes are shed
+
+    static uint64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Above a detector's target, or at least `queue_limit` connections waiting
+    bool exceeded(const Detector& d, int queue_limit) const {
+        if (!Config::ADMISSION_ENABLED) return false;
+        int q = queued.load(std::memory_order_relaxed);
+        if (q <= 0) return false;
+        return d.above.load(std::memory_order_relaxed) || q >= queue_limit;
+    }
+
+public:
+    // A connection was queued for a worker. The worker may report it dequeued
+    // first, so `queued` can briefly read -1.
+    void onEnqueue() {
+        queued.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // A worker picked up a connection that waited `sojourn_ns`
+    void onDequeue(uint64_t sojourn_ns) {
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        queue_delay.record(sojourn_ns / 1000);
+
+        uint64_t now = nowNs();
+        uint64_t target_ns = (uint64_t)Config::ADMISSION_TARGET_MS * 1000000ULL;
+        uint64_t write_target_ns = std::min<uint64_t>((uint64_t)Config::ADMISSION_WRITE_TARGET_MS * 1000000ULL, target_ns);
+        uint64_t interval_ns = (uint64_t)Config::ADMISSION_INTERVAL_MS * 1000000ULL;
+        std::lock_guard<std::mutex> lock(mtx);
+        if (overload.update(sojourn_ns, target_ns, interval_ns, now)) overload_episodes++;
+        write_overload.update(sojourn_ns, write_target_ns, interval_ns, now);
+    }
+
+    bool overloaded() const {
+        return exceeded(overload, Config::ADMISSION_QUEUE_LIMIT);
+    }
+
+    // Writes are shed at the lower thresholds, and whenever misses are
+    bool sheddingWrites() const {
+        return exceeded(write_overload, std::min<int>(Config::ADMISSION_WRITE_QUEUE_LIMIT, Config::ADMISSION_QUEUE_LIMIT)) || overloaded();
+    }
+
+    // Should a write be executed?
+    bool admitWrite() {
+        if (!sheddingWrites()) return true;
+        shed_writes.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Should a read that missed the cache go to the database?
+    bool admitMiss() {
+        if (!overloaded()) return true;
+        shed_misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    AdmissionStats stats() const {
+        AdmissionStats s;
+        s.enabled = Config::ADMISSION_ENABLED;
+        s.overloaded = overloaded();
+        s.shedding_writes = sheddingWrites();
+        s.queued = queued.load(std::memory_order_relaxed);
+        s.overload_episodes = overload_episodes.load();
+        s.shed_writes = shed_writes.load();
+        s.shed_misses = shed_misses.load();
+        s.queue_delay_avg_ms = queue_delay.meanUs() / 1000.0;
+        s.queue_delay_p99_ms = queue_delay.percentileUs(99) / 1000.0;
+        return s;
+    }
+};
+
+#endif // ADMISSION_H
@@ -0,0 +1,279 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include "constants.h"
+#include "database.h"
+
+// Snapshot of the key filter (see /stats)
+struct KeyFilterStats {
+    bool ready = false;
+    bool disabled = false;
+    int64_t keys = 0;               // Keys added minus keys removed
+    uint64_t counters = 0;
+    int hashes = 0;
+    uint64_t memory_bytes = 0;
+    double fill_ratio = 0.0;        // Counters above zero
+    double estimated_fp_rate = 0.0; // fill_ratio ^ hashes
+    uint64_t saturated = 0;         // Counters stuck at their maximum
+    uint64_t build_keys = 0;        // Keys loaded by the startup scan
+    double build_ms = 0.0;
+    uint64_t definite_misses = 0;   // Lookups answered without MySQL
+    uint64_t false_positives = 0;   // Lookups the filter passed that MySQL did not find
+};
+
+// Counting Bloom filter of every key in key_value, so reads and deletes of keys
+// that do not exist are answered without MySQL. A key sets `hashes` 4-bit
+// counters, eight to a 32-bit word, updated with CAS so no lock is taken. A
+// counter that reaches 15 stays there; it can no longer be decremented safely,
+// and keeping it set only costs false positives.
+//
+// The filter is filled by a parallel scan at startup: one thread walks the
+// primary key index to cut it into KEY_FILTER_BUILD_BATCH-key ranges, and
+// KEY_FILTER_BUILD_THREADS threads stream the keys of each range. Until the scan
+// completes every key may exist. Adding a key twice (a create during the scan,
+// or a retried scan) is harmless: the extra count only keeps it a false positive.
+class KeyFilter {
+private:
+    std::unique_ptr<std::atomic<uint32_t>[]> words;
+    uint64_t num_counters = 0;
+    int hashes = 0;
+
+    std::atomic<bool> ready{false};
+    std::atomic<bool> disabled{false};
+    std::atomic<int64_t> keys{0};
+    std::atomic<uint64_t> build_keys{0};
+    std::atomic<uint64_t> build_us{0};
+    std::atomic<uint64_t> definite_misses{0};
+    std::atomic<uint64_t> false_positives{0};
+
+    std::atomic<bool> stopping{false};
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread builder;
+
+    static uint64_t mix(uint64_t x) {
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+
+    // Counter i of a key, by double hashing
+    template <typename F>
+    void forEachCounter(const std::string& key, F f) const {
+        uint64_t h1 = std::hash<std::string>()(key);
+        uint64_t h2 = mix(h1) | 1;
+        for (int i = 0; i < hashes; ++i) f((h1 + i * h2) % num_counters);
+    }
+
+    // Add `delta` (+1/-1) to a counter; saturated and empty counters are left alone
+    void bump(uint64_t idx, int delta) {
+        std::atomic<uint32_t>& w = words[idx / 8];
+        int shift = (idx % 8) * 4;
+        uint32_t old = w.load(std::memory_order_relaxed);
+        while (true) {
+            uint32_t c = (old >> shift) & 0xF;
+            if (c == 0xF || (delta < 0 && c == 0)) return;
+            uint32_t next = delta > 0 ? old + (1u << shift) : old - (1u << shift);
+            if (w.compare_exchange_weak(old, next, std::memory_order_relaxed)) return;
+        }
+    }
+
+    uint32_t counter(uint64_t idx) const {
+        return (words[idx / 8].load(std::memory_order_relaxed) >> ((idx % 8) * 4)) & 0xF;
+    }
+
+    // One pass over key_value. Returns false if any query failed.
+    bool scan(DBPool* pool) {
+        std::deque<std::pair<std::string, std::string>> ranges;   // [from, to); to "" = unbounded
+        bool split_done = false;
+        std::atomic<bool> failed{false};
+        std::mutex q_mtx;
+        std::condition_variable q_cv;
+
+        auto worker = [&] {
+            sql::Connection* con = pool->getConnection(Config::DB_CONNECT_TIMEOUT_SEC * 1000);
+            if (con == nullptr) {
+                failed = true;
+                q_cv.notify_all();
+                return;
+            }
+            bool con_failed = false;
+            while (!failed && !stopping) {
+                std::pair<std::string, std::string> range;
+                {
+                    std::unique_lock<std::mutex> lock(q_mtx);
+                    q_cv.wait(lock, [&] { return !ranges.empty() || split_done || failed; });
+                    if (ranges.empty()) break;
+                    range = std::move(ranges.front());
+                    ranges.pop_front();
+                }
+                try {
+                    std::unique_ptr<sql::PreparedStatement> pstmt(con->prepareStatement(range.second.empty()
+                        ? "SELECT key_name FROM key_value WHERE key_name >= ?"
+                        : "SELECT key_name FROM key_value WHERE key_name >= ? AND key_name < ?"));
+                    pstmt->setString(1, range.first);
+                    if (!range.second.empty()) pstmt->setString(2, range.second);
+                    std::unique_ptr<sql::ResultSet> rs(pstmt->executeQuery());
+                    while (rs->next()) {
+                        add(rs->getString(1));
+                        build_keys.fetch_add(1, std::memory_order_relaxed);
+                    }
+                } catch (sql::SQLException &e) {
+                    std::cerr << "[KeyFilter] Scan error: " << e.what() << std::endl;
+                    con_failed = true;
+                    failed = true;
+                    q_cv.notify_all();
+                }
+            }
+            pool->releaseConnection(con, con_failed);
+        };
+        std::vector<std::thread> workers;
+        for (int i = 0; i < std::max(1, Config::KEY_FILTER_BUILD_THREADS); ++i) workers.emplace_back(worker);
+
+        // Range boundaries: the key KEY_FILTER_BUILD_BATCH entries after the previous one.
+        // MySQL skips the entries inside the index, so only the boundary keys are sent.
+        sql::Connection* con = pool->getConnection(Config::DB_CONNECT_TIMEOUT_SEC * 1000);
+        bool con_failed = con == nullptr;
+        if (con != nullptr) {
+            try {
+                std::unique_ptr<sql::PreparedStatement> pstmt(con->prepareStatement(
+                    "SELECT key_name FROM key_value WHERE key_name >= ? ORDER BY key_name LIMIT 1 OFFSET ?"));
+                std::string from;
+                while (!failed && !stopping) {
+                    pstmt->setString(1, from);
+                    pstmt->setInt(2, std::max(1, Config::KEY_FILTER_BUILD_BATCH));
+                    std::unique_ptr<sql::ResultSet> rs(pstmt->executeQuery());
+                    std::string to = rs->next() ? rs->getString(1) : "";
+                    {
+                        std::lock_guard<std::mutex> lock(q_mtx);
+                        ranges.emplace_back(from, to);
+                    }
+                    q_cv.notify_one();
+                    if (to.empty()) break;
+                    from = to;
+                }
+            } catch (sql::SQLException &e) {
+                std::cerr << "[KeyFilter] Scan error: " << e.what() << std::endl;
+                con_failed = true;
+            }
+            pool->releaseConnection(con, con_failed);
+        }
+        {
+            std::lock_guard<std::mutex> lock(q_mtx);
+            split_done = true;
+            if (con_failed) failed = true;
+        }
+        q_cv.notify_all();
+        for (auto& t : workers) t.join();
+        return !failed && !stopping;
+    }
+
+    void buildLoop(DBPool* pool) {
+        auto start = std::chrono::steady_clock::now();
+        while (!stopping && !disabled) {
+            if (scan(pool)) {
+                build_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+                ready = !disabled;
+                std::cout << "[KeyFilter] Loaded " << build_keys << " keys in " << build_us / 1000 << " ms" << std::endl;
+                return;
+            }
+            // Keys already added stay; a second pass only adds false positives
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait_for(lock, std::chrono::milliseconds(Config::DB_RECONNECT_INTERVAL_MS), [this] { return stopping.load(); });
+        }
+    }
+
+public:
+    // Sized for `expected_keys` at `counters_per_key` counters each (10 gives about 1% false positives)
+    KeyFilter(uint64_t expected_keys, int counters_per_key) {
+        num_counters = std::max<uint64_t>(64, expected_keys * std::max(1, counters_per_key));
+        num_counters = (num_counters + 7) / 8 * 8;
+        hashes = std::max(1, (int)std::lround(std::log(2.0) * std::max(1, counters_per_key)));
+        words.reset(new std::atomic<uint32_t>[num_counters / 8]);
+        for (uint64_t i = 0; i < num_counters / 8; ++i) words[i].store(0, std::memory_order_relaxed);
+    }
+
+    ~KeyFilter() {
+        stopping = true;
+        cv.notify_all();
+        if (builder.joinable()) builder.join();
+    }
+
+    // Fill the filter from key_value in the background
+    void build(DBPool* pool) {
+        builder = std::thread(&KeyFilter::buildLoop, this, pool);
+    }
+
+    // Stop answering for good, once other processes may insert keys too
+    void disable() {
+        disabled = true;
+        ready = false;
+    }
+
+    // Whether the startup scan has completed, so mayContain() can be trusted
+    bool isReady() const { return ready.load(std::memory_order_acquire); }
+
+    // Call before the key can become visible in MySQL
+    void add(const std::string& key) {
+        forEachCounter(key, [this](uint64_t idx) { bump(idx, 1); });
+        keys.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Call once the key is gone from MySQL, and only for a key that was added.
+    // Removes before the startup scan completes are skipped: the scan may still add the key.
+    void remove(const std::string& key) {
+        if (!isReady()) return;
+        forEachCounter(key, [this](uint64_t idx) { bump(idx, -1); });
+        keys.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    bool mayContain(const std::string& key) const {
+        bool all = true;
+        forEachCounter(key, [&](uint64_t idx) { all = all && counter(idx) != 0; });
+        return all;
+    }
+
+    void countDefiniteMiss() { definite_misses.fetch_add(1, std::memory_order_relaxed); }
+    void countFalsePositive() { false_positives.fetch_add(1, std::memory_order_relaxed); }
+
+    KeyFilterStats stats() const {
+        KeyFilterStats s;
+        s.ready = isReady();
+        s.disabled = disabled.load();
+        s.keys = keys.load(std::memory_order_relaxed);
+        s.counters = num_counters;
+        s.hashes = hashes;
+        s.memory_bytes = num_counters / 2;
+        uint64_t nonzero = 0;
+        for (uint64_t w = 0; w < num_counters / 8; ++w) {
+            uint32_t word = words[w].load(std::memory_order_relaxed);
+            for (; word != 0; word >>= 4) {
+                uint32_t c = word & 0xF;
+                if (c != 0) nonzero++;
+                if (c == 0xF) s.saturated++;
+            }
+        }
+        s.fill_ratio = (double)nonzero / num_counters;
+        s.estimated_fp_rate = std::pow(s.fill_ratio, hashes);
+        s.build_keys = build_keys.load(std::memory_order_relaxed);
+        s.build_ms = build_us.load(std::memory_order_relaxed) / 1000.0;
+        s.definite_misses = definite_misses.load(std::memory_order_relaxed);
+        s.false_positives = false_positives.load(std::memory_order_relaxed);
+        return s;
+    }
+};
+
+#endif // BLOOM_H
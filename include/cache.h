@@ -4,68 +4,541 @@
 #include <unordered_map>
 #include <list>
 #include <mutex>
+#include <condition_variable>
 #include <vector>
 #include <functional>
 #include <string>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <charconv>
 #include "constants.h"
+#include "compression.h"
+#include "tracing.h"
+#include "placement.h"
+
+// Stored representation of a value. Large values are kept as lz blocks.
+struct CacheEntry {
+    std::string data;
+    bool compressed = false;
+    size_t raw_size = 0;
+    uint64_t version = 0;   // Row version (key_value.version), also orders invalidations (0 = unknown)
+    int64_t expires_us = 0; // Steady-clock deadline of a value read from a lagging replica (0 = none)
+};
+
+// A decompressed copy of a cached entry (see ShardedLRUCache::collect)
+struct CollectedEntry {
+    std::string key;
+    std::string value;
+    uint64_t version = 0;
+};
+
+// Snapshot of a shard's counters (see /stats)
+struct ShardStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t items = 0;
+    uint64_t compressed_items = 0;
+    uint64_t raw_bytes = 0;        // Uncompressed size of compressed entries
+    uint64_t stored_bytes = 0;     // Stored size of compressed entries
+    uint64_t compress_ops = 0;
+    uint64_t compress_ns = 0;
+    uint64_t decompress_ops = 0;
+    uint64_t decompress_ns = 0;
+    uint64_t lock_waits = 0;       // Acquisitions that found the shard lock held
+    uint64_t lock_wait_ns = 0;     // Time spent blocked on the shard lock
+    int node = -1;                 // NUMA node the shard was allocated on, -1 if not placed
+};
+
+// Outcome of an increment (see LRUCacheShard::incr)
+enum class IncrResult { APPLIED, MISSING, NOT_INTEGER, OVERFLOW };
+
+// Counter increments taken for one flush: the summed delta and the version to
+// store with it. The UPDATE only applies while the row is still at `base`, the
+// version the increments were counted from; `applied` reports whether it did.
+struct PendingWrite {
+    std::string key;
+    long long delta;
+    uint64_t version;
+    uint64_t base = 0;
+    uint64_t lineage = 0;       // Pending record the increments belong to
+    bool applied = false;
+};
+
+// Counter value as stored: a decimal integer, as MySQL's CAST(value AS SIGNED) reads it
+inline bool parseCounter(const std::string& s, long long& out) {
+    const char* end = s.data() + s.size();
+    auto r = std::from_chars(s.data(), end, out);
+    return !s.empty() && r.ec == std::errc() && r.ptr == end;
+}
 
 // A single partition of the cache
 class LRUCacheShard {
 private:
     size_t capacity;
-    std::list<std::pair<std::string, std::string>> items;
-    std::unordered_map<std::string, std::list<std::pair<std::string, std::string>>::iterator> cacheMap;
+    std::list<std::pair<std::string, CacheEntry>> items;
+    std::unordered_map<std::string, std::list<std::pair<std::string, CacheEntry>>::iterator> cacheMap;
     std::mutex mtx;
 
+    // Increments not yet in MySQL. Keys listed here are never evicted, so a
+    // cache miss always means the DB row is current. At most one flush per key
+    // is in flight, so flushes reach the row in order.
+    struct PendingDelta {
+        long long delta = 0;        // Waiting for the next flush
+        long long inflight = 0;     // Being written by a flush
+        int flushes = 0;            // Flushes in progress (0 or 1)
+        uint64_t version = 0;       // Version of the latest increment
+        uint64_t row_version = 0;   // Version of the row once the flushes so far have landed
+        uint64_t lineage = 0;       // Tells a record apart from one created after it was dropped
+    };
+    std::unordered_map<std::string, PendingDelta> pending;
+    uint64_t next_lineage = 0;
+    std::condition_variable settled;   // A flush finished; sync increments wait for their key's
+
+    // Protected by mtx
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t compressed_items = 0;
+    uint64_t raw_bytes = 0;
+    uint64_t stored_bytes = 0;
+    uint64_t compress_ops = 0;
+    uint64_t compress_ns = 0;
+
+    // Decompression happens outside the lock
+    std::atomic<uint64_t> decompress_ops{0};
+    std::atomic<uint64_t> decompress_ns{0};
+
+    // Lock contention, counted outside the lock
+    std::atomic<uint64_t> lock_waits{0};
+    std::atomic<uint64_t> lock_wait_ns{0};
+
+    static uint64_t elapsedNs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static int64_t nowUs() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static bool expired(const CacheEntry& e) {
+        return e.expires_us != 0 && nowUs() >= e.expires_us;
+    }
+
+    // Compress values above the threshold if it actually saves space. Runs before taking the lock.
+    static CacheEntry makeEntry(const std::string& value, uint64_t& cost_ns) {
+        CacheEntry e;
+        e.raw_size = value.size();
+        cost_ns = 0;
+        if (Config::CACHE_COMPRESSION_ENABLED && value.size() >= Config::CACHE_COMPRESS_THRESHOLD) {
+            auto start = std::chrono::steady_clock::now();
+            std::string block = lz::compress(value);
+            cost_ns = elapsedNs(start);
+            if (block.size() < value.size()) {
+                e.data = std::move(block);
+                e.compressed = true;
+                return e;
+            }
+        }
+        e.data = value;
+        return e;
+    }
+
+    void accountAdd(const CacheEntry& e) {
+        if (!e.compressed) return;
+        compressed_items++;
+        raw_bytes += e.raw_size;
+        stored_bytes += e.data.size();
+    }
+
+    void accountRemove(const CacheEntry& e) {
+        if (!e.compressed) return;
+        compressed_items--;
+        raw_bytes -= e.raw_size;
+        stored_bytes -= e.data.size();
+    }
+
+    // Take the shard lock, timing the wait only when it is contended
+    std::unique_lock<std::mutex> acquire() {
+        std::unique_lock<std::mutex> lock(mtx, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            auto start = std::chrono::steady_clock::now();
+            lock.lock();
+            uint64_t waited = elapsedNs(start);
+            lock_wait_ns.fetch_add(waited, std::memory_order_relaxed);
+            lock_waits.fetch_add(1, std::memory_order_relaxed);
+            tracing::add(tracing::CACHE_LOCK, waited);
+        }
+        return lock;
+    }
+
 public:
     LRUCacheShard(size_t cap) : capacity(cap) {}
 
-    bool get(const std::string& key, std::string& value) {
-        std::lock_guard<std::mutex> lock(mtx);
+    // Change the capacity, evicting LRU entries until the shard fits
+    void setCapacity(size_t cap) {
+        std::unique_lock<std::mutex> lock = acquire();
+        capacity = cap;
+        while (items.size() > capacity && evictLocked()) {}
+    }
+
+    // Allocate the hash table up front (first-touch places it on the calling thread's node)
+    void reserve() {
+        std::unique_lock<std::mutex> lock = acquire();
+        cacheMap.reserve(capacity);
+    }
+
+    // Returns the stored representation without decompressing it.
+    // An entry without a row version cannot be validated and counts as a miss.
+    bool getRaw(const std::string& key, std::string& value, bool& compressed, uint64_t& version) {
+        std::unique_lock<std::mutex> lock = acquire();
         auto it = cacheMap.find(key);
-        if (it == cacheMap.end()) {
+        if (it != cacheMap.end() && expired(it->second->second)) {
+            accountRemove(it->second->second);
+            items.erase(it->second);
+            cacheMap.erase(it);
+            it = cacheMap.end();
+        }
+        if (it == cacheMap.end() || it->second->second.version == 0) {
+            misses++;
             return false;
         }
+        hits++;
         // Move to front (MRU)
         items.splice(items.begin(), items, it->second);
-        value = it->second->second;
+        value = it->second->second.data;
+        compressed = it->second->second.compressed;
+        version = it->second->second.version;
+        return true;
+    }
+
+    bool get(const std::string& key, std::string& value, uint64_t& version) {
+        bool compressed = false;
+        if (!getRaw(key, value, compressed, version)) {
+            return false;
+        }
+        if (compressed) {
+            auto start = std::chrono::steady_clock::now();
+            std::string raw;
+            bool ok = lz::decompress(value, raw);
+            decompress_ns.fetch_add(elapsedNs(start), std::memory_order_relaxed);
+            decompress_ops.fetch_add(1, std::memory_order_relaxed);
+            if (!ok) {
+                remove(key);
+                return false;
+            }
+            value = std::move(raw);
+        }
         return true;
     }
 
-    void put(const std::string& key, const std::string& value) {
-        std::lock_guard<std::mutex> lock(mtx);
+    // Version of a cached key, without counting a hit or miss or changing the LRU order
+    bool versionOf(const std::string& key, uint64_t& version) {
+        std::unique_lock<std::mutex> lock = acquire();
+        auto it = cacheMap.find(key);
+        if (it == cacheMap.end()) return false;
+        version = it->second->second.version;
+        return true;
+    }
+
+    // Look up without counting a hit or miss or changing the LRU order (used by scans)
+    bool peek(const std::string& key, std::string& value, uint64_t& version) {
+        bool compressed;
+        {
+            std::unique_lock<std::mutex> lock = acquire();
+            auto it = cacheMap.find(key);
+            if (it == cacheMap.end()) return false;
+            value = it->second->second.data;
+            compressed = it->second->second.compressed;
+            version = it->second->second.version;
+        }
+        if (!compressed) return true;
+        std::string raw;
+        if (!lz::decompress(value, raw)) return false;
+        value = std::move(raw);
+        return true;
+    }
+
+    // Drop the least recently used entry without unflushed increments. Caller holds mtx.
+    bool evictLocked() {
+        auto it = items.end();
+        while (it != items.begin()) {
+            --it;
+            if (!pending.empty() && pending.count(it->first)) continue;
+            accountRemove(it->second);
+            cacheMap.erase(it->first);
+            items.erase(it);
+            return true;
+        }
+        return false;   // Everything is pinned; the shard stays over capacity until a flush
+    }
+
+    // Insert a new key at the MRU position, evicting the LRU entry if full. Caller holds mtx.
+    void insertLocked(const std::string& key, CacheEntry&& entry) {
+        if (items.size() >= capacity) evictLocked();
+        items.push_front({key, std::move(entry)});
+        accountAdd(items.front().second);
+        cacheMap[key] = items.begin();
+    }
+
+    // Store a value. A versioned put never replaces an entry with a newer version.
+    // With `ttl_ms` the entry is dropped on the first lookup after that long.
+    void put(const std::string& key, const std::string& value, uint64_t version = 0, int ttl_ms = 0) {
+        uint64_t cost_ns = 0;
+        CacheEntry entry = makeEntry(value, cost_ns);
+        entry.version = version;
+        if (ttl_ms > 0) entry.expires_us = nowUs() + (int64_t)ttl_ms * 1000;
+
+        std::unique_lock<std::mutex> lock = acquire();
+        if (cost_ns > 0) {
+            compress_ops++;
+            compress_ns += cost_ns;
+        }
         auto it = cacheMap.find(key);
         if (it != cacheMap.end()) {
-            // Update existing
-            it->second->second = value;
+            if (version != 0 && it->second->second.version > version) return;
+            // Update existing; the write supersedes unflushed increments
+            pending.erase(key);
+            accountRemove(it->second->second);
+            it->second->second = std::move(entry);
+            accountAdd(it->second->second);
             items.splice(items.begin(), items, it->second);
         } else {
             // Insert new
-            if (items.size() >= capacity) {
-                auto last = items.end();
-                last--;
-                cacheMap.erase(last->first);
-                items.pop_back();
-            }
-            items.push_front({key, value});
-            cacheMap[key] = items.begin();
+            insertLocked(key, std::move(entry));
+        }
+    }
+
+    // Insert only if the key is not cached yet. Returns false if it was.
+    bool putIfAbsent(const std::string& key, const std::string& value, uint64_t version = 0) {
+        uint64_t cost_ns = 0;
+        CacheEntry entry = makeEntry(value, cost_ns);
+        entry.version = version;
+
+        std::unique_lock<std::mutex> lock = acquire();
+        if (cost_ns > 0) {
+            compress_ops++;
+            compress_ns += cost_ns;
         }
+        if (cacheMap.count(key)) return false;
+        insertLocked(key, std::move(entry));
+        return true;
     }
 
     void remove(const std::string& key) {
-        std::lock_guard<std::mutex> lock(mtx);
+        std::unique_lock<std::mutex> lock = acquire();
+        pending.erase(key);
         auto it = cacheMap.find(key);
         if (it != cacheMap.end()) {
+            accountRemove(it->second->second);
             items.erase(it->second);
             cacheMap.erase(it);
         }
     }
+
+    // Drop the entry if it is older than `version`. Returns true if something was removed.
+    bool invalidate(const std::string& key, uint64_t version) {
+        std::unique_lock<std::mutex> lock = acquire();
+        auto it = cacheMap.find(key);
+        if (it == cacheMap.end() || it->second->second.version >= version) return false;
+        pending.erase(key);
+        accountRemove(it->second->second);
+        items.erase(it->second);
+        cacheMap.erase(it);
+        return true;
+    }
+
+    // Copy up to `limit` entries matching `pred`, most recently used first
+    void collect(const std::function<bool(const std::string&)>& pred, size_t limit,
+                 std::vector<std::pair<std::string, CacheEntry>>& out) {
+        std::unique_lock<std::mutex> lock = acquire();
+        size_t taken = 0;
+        for (const auto& item : items) {
+            if (taken >= limit) break;
+            // Replica reads are not handed over: the new owner would keep them for good
+            if (item.second.expires_us != 0 || !pred(item.first)) continue;
+            out.push_back(item);
+            taken++;
+        }
+    }
+
+    // Drop every entry matching `pred`. Returns the number removed.
+    size_t removeIf(const std::function<bool(const std::string&)>& pred) {
+        std::unique_lock<std::mutex> lock = acquire();
+        size_t removed = 0;
+        for (auto it = items.begin(); it != items.end();) {
+            if (pred(it->first)) {
+                accountRemove(it->second);
+                cacheMap.erase(it->first);
+                it = items.erase(it);
+                removed++;
+            } else {
+                ++it;
+            }
+        }
+        return removed;
+    }
+
+    // Add `delta` to the cached counter and store the result in `value`. A key
+    // that is not cached is loaded from `base` (its DB value, at row version
+    // `version`), or MISSING is returned if `base` is null. Each increment bumps
+    // the version by one, so a write with a newer version still replaces the
+    // counter; `version` returns the new one. A deferred delta waits for
+    // takePending(); otherwise the caller writes `sync` to MySQL itself and calls
+    // settle(), after any flush of the key still in flight.
+    IncrResult incr(const std::string& key, long long delta, const std::string* base, bool deferred,
+                    long long& value, uint64_t& version, PendingWrite* sync = nullptr) {
+        std::unique_lock<std::mutex> lock = acquire();
+        if (!deferred) {
+            settled.wait(lock, [&] {
+                auto p = pending.find(key);
+                return p == pending.end() || p->second.flushes == 0;
+            });
+        }
+        auto it = cacheMap.find(key);
+        // Entries without a row version and values read from a replica are re-read
+        // like misses: the count must start from the primary's row
+        bool cached = it != cacheMap.end() && it->second->second.version != 0 && it->second->second.expires_us == 0;
+        long long current;
+        if (cached) {
+            // Counters are far below the compression threshold
+            if (it->second->second.compressed || !parseCounter(it->second->second.data, current)) return IncrResult::NOT_INTEGER;
+        } else if (base == nullptr) {
+            misses++;
+            return IncrResult::MISSING;
+        } else if (!parseCounter(*base, current)) {
+            return IncrResult::NOT_INTEGER;
+        }
+        if (__builtin_add_overflow(current, delta, &value)) return IncrResult::OVERFLOW;
+
+        if (cached) version = it->second->second.version;
+        uint64_t from = version;    // The row's version: nothing is pending yet if the record is new
+        version++;
+        CacheEntry entry;
+        entry.data = std::to_string(value);
+        entry.version = version;
+        if (it != cacheMap.end()) {
+            hits++;
+            accountRemove(it->second->second);
+            it->second->second = std::move(entry);
+            accountAdd(it->second->second);
+            items.splice(items.begin(), items, it->second);
+        } else {
+            insertLocked(key, std::move(entry));
+        }
+        auto found = pending.find(key);
+        if (found == pending.end()) {
+            found = pending.emplace(key, PendingDelta()).first;
+            found->second.row_version = from;
+            found->second.lineage = ++next_lineage;
+        }
+        PendingDelta& p = found->second;
+        p.version = version;
+        if (deferred) {
+            p.delta += delta;
+        } else {
+            p.inflight += delta;
+            p.flushes++;
+            if (sync != nullptr) *sync = {key, delta, version, p.row_version, p.lineage};
+        }
+        return IncrResult::APPLIED;
+    }
+
+    // Move up to `limit` waiting deltas to in-flight for a flush. Each must be
+    // settled. Keys with a flush still in flight wait for the next one.
+    void takePending(size_t limit, std::vector<PendingWrite>& out) {
+        std::unique_lock<std::mutex> lock = acquire();
+        size_t taken = 0;
+        for (auto& p : pending) {
+            if (taken >= limit) break;
+            if (p.second.delta == 0 || p.second.flushes > 0) continue;
+            out.push_back({p.first, p.second.delta, p.second.version, p.second.row_version, p.second.lineage});
+            p.second.inflight += p.second.delta;
+            p.second.flushes++;
+            p.second.delta = 0;
+            taken++;
+        }
+    }
+
+    // Finish writing `w`. A failed write is queued again, or with `revert` taken
+    // back out of the cached value (for callers that report the failure). A write
+    // that found the row rewritten by someone else drops the counter: its
+    // increments are superseded, and the next read or increment loads the row.
+    void settle(const PendingWrite& w, bool ok, bool revert) {
+        std::unique_lock<std::mutex> lock = acquire();
+        settled.notify_all();
+        auto p = pending.find(w.key);
+        if (p == pending.end() || p->second.lineage != w.lineage) return;   // Overwritten or deleted meanwhile
+        const std::string& key = w.key;
+        long long delta = w.delta;
+        p->second.inflight -= delta;
+        p->second.flushes--;
+        if (ok && w.applied) {
+            p->second.row_version = std::max(p->second.row_version, w.version);
+        } else if (ok) {
+            pending.erase(p);
+            auto it = cacheMap.find(key);
+            if (it != cacheMap.end()) {
+                accountRemove(it->second->second);
+                items.erase(it->second);
+                cacheMap.erase(it);
+            }
+            return;
+        } else if (!revert) {
+            p->second.delta += delta;
+        } else {
+            auto it = cacheMap.find(key);
+            long long current;
+            if (it != cacheMap.end() && !it->second->second.compressed && parseCounter(it->second->second.data, current)) {
+                CacheEntry entry;
+                entry.data = std::to_string(current - delta);
+                entry.version = it->second->second.version;
+                accountRemove(it->second->second);
+                it->second->second = std::move(entry);
+                accountAdd(it->second->second);
+            }
+        }
+        if (p->second.delta == 0 && p->second.flushes == 0) pending.erase(p);
+    }
+
+    bool hasPending(const std::string& key) {
+        std::unique_lock<std::mutex> lock = acquire();
+        return pending.count(key) > 0;
+    }
+
+    // Keys with increments not yet in MySQL, and the sum of their deltas
+    void pendingStats(uint64_t& keys, long long& deltas) {
+        std::unique_lock<std::mutex> lock = acquire();
+        keys += pending.size();
+        for (const auto& p : pending) deltas += p.second.delta + p.second.inflight;
+    }
+
+    ShardStats stats() {
+        ShardStats s;
+        {
+            std::unique_lock<std::mutex> lock = acquire();
+            s.hits = hits;
+            s.misses = misses;
+            s.items = items.size();
+            s.compressed_items = compressed_items;
+            s.raw_bytes = raw_bytes;
+            s.stored_bytes = stored_bytes;
+            s.compress_ops = compress_ops;
+            s.compress_ns = compress_ns;
+        }
+        s.decompress_ops = decompress_ops.load(std::memory_order_relaxed);
+        s.decompress_ns = decompress_ns.load(std::memory_order_relaxed);
+        s.lock_waits = lock_waits.load(std::memory_order_relaxed);
+        s.lock_wait_ns = lock_wait_ns.load(std::memory_order_relaxed);
+        return s;
+    }
 };
 
 // Wrapper to manage multiple shards
 class ShardedLRUCache {
 private:
     std::vector<LRUCacheShard*> shards;
+    std::vector<int> shard_nodes;   // NUMA node each shard was allocated on (-1 = not placed)
     int num_shards;
 
     int getShardIndex(const std::string& key) {
@@ -74,11 +547,21 @@ private:
     }
 
 public:
-    ShardedLRUCache(size_t total_capacity, int num_shards_in) : num_shards(num_shards_in) {
+    // With a topology, shard i and its hash table are allocated on NUMA node nodes[i]
+    ShardedLRUCache(size_t total_capacity, int num_shards_in, const placement::Topology* topo = nullptr,
+                    const std::vector<int>& nodes = {})
+        : shard_nodes(num_shards_in, -1), num_shards(num_shards_in) {
         size_t cap_per_shard = total_capacity / num_shards;
         if (cap_per_shard < 1) cap_per_shard = 1;
         for (int i = 0; i < num_shards; ++i) {
-            shards.push_back(new LRUCacheShard(cap_per_shard));
+            if (topo != nullptr && i < (int)nodes.size()) {
+                placement::ScopedNodeAffinity on_node(*topo, nodes[i]);
+                shards.push_back(new LRUCacheShard(cap_per_shard));
+                shards.back()->reserve();
+                shard_nodes[i] = nodes[i];
+            } else {
+                shards.push_back(new LRUCacheShard(cap_per_shard));
+            }
         }
     }
 
@@ -87,16 +570,109 @@ public:
     }
 
     bool get(const std::string& key, std::string& value) {
-        return shards[getShardIndex(key)]->get(key, value);
+        uint64_t version;
+        return shards[getShardIndex(key)]->get(key, value, version);
+    }
+
+    bool get(const std::string& key, std::string& value, uint64_t& version) {
+        return shards[getShardIndex(key)]->get(key, value, version);
+    }
+
+    bool getRaw(const std::string& key, std::string& value, bool& compressed, uint64_t& version) {
+        return shards[getShardIndex(key)]->getRaw(key, value, compressed, version);
+    }
+
+    bool versionOf(const std::string& key, uint64_t& version) {
+        return shards[getShardIndex(key)]->versionOf(key, version);
+    }
+
+    void put(const std::string& key, const std::string& value, uint64_t version = 0, int ttl_ms = 0) {
+        shards[getShardIndex(key)]->put(key, value, version, ttl_ms);
+    }
+
+    bool peek(const std::string& key, std::string& value, uint64_t& version) {
+        return shards[getShardIndex(key)]->peek(key, value, version);
     }
 
-    void put(const std::string& key, const std::string& value) {
-        shards[getShardIndex(key)]->put(key, value);
+    bool invalidate(const std::string& key, uint64_t version) {
+        return shards[getShardIndex(key)]->invalidate(key, version);
     }
 
     void remove(const std::string& key) {
         shards[getShardIndex(key)]->remove(key);
     }
+
+    bool putIfAbsent(const std::string& key, const std::string& value, uint64_t version = 0) {
+        return shards[getShardIndex(key)]->putIfAbsent(key, value, version);
+    }
+
+    IncrResult incr(const std::string& key, long long delta, const std::string* base, bool deferred,
+                    long long& value, uint64_t& version, PendingWrite* sync = nullptr) {
+        return shards[getShardIndex(key)]->incr(key, delta, base, deferred, value, version, sync);
+    }
+
+    std::vector<PendingWrite> takePending(size_t limit) {
+        std::vector<PendingWrite> out;
+        for (auto s : shards) {
+            if (out.size() >= limit) break;
+            s->takePending(limit - out.size(), out);
+        }
+        return out;
+    }
+
+    void settle(const PendingWrite& w, bool ok, bool revert) {
+        shards[getShardIndex(w.key)]->settle(w, ok, revert);
+    }
+
+    bool hasPending(const std::string& key) {
+        return shards[getShardIndex(key)]->hasPending(key);
+    }
+
+    void pendingStats(uint64_t& keys, long long& deltas) {
+        for (auto s : shards) s->pendingStats(keys, deltas);
+    }
+
+    // Decompressed copies of the cached entries matching `pred`, hottest first within each shard
+    std::vector<CollectedEntry> collect(const std::function<bool(const std::string&)>& pred, size_t limit) {
+        std::vector<std::pair<std::string, CacheEntry>> raw;
+        size_t per_shard = limit / num_shards + 1;
+        for (auto s : shards) s->collect(pred, per_shard, raw);
+
+        std::vector<CollectedEntry> out;
+        out.reserve(raw.size());
+        for (auto& e : raw) {
+            if (e.second.compressed) {
+                std::string value;
+                if (!lz::decompress(e.second.data, value)) continue;
+                out.push_back({e.first, std::move(value), e.second.version});
+            } else {
+                out.push_back({e.first, std::move(e.second.data), e.second.version});
+            }
+        }
+        return out;
+    }
+
+    size_t removeIf(const std::function<bool(const std::string&)>& pred) {
+        size_t removed = 0;
+        for (auto s : shards) removed += s->removeIf(pred);
+        return removed;
+    }
+
+    // Resize without dropping entries other than the ones over the new capacity
+    void setCapacity(size_t total_capacity) {
+        size_t cap_per_shard = total_capacity / num_shards;
+        if (cap_per_shard < 1) cap_per_shard = 1;
+        for (auto s : shards) s->setCapacity(cap_per_shard);
+    }
+
+    std::vector<ShardStats> stats() {
+        std::vector<ShardStats> out;
+        for (size_t i = 0; i < shards.size(); ++i) {
+            out.push_back(shards[i]->stats());
+            out.back().node = shard_nodes[i];
+        }
+        return out;
+    }
 };
 
 #endif // LRU_CACHE_H
\ No newline at end of file
@@ -0,0 +1,401 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <map>
+#include <set>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include "httplib.h"
+#include "constants.h"
+
+// Consistent-hash ring with virtual nodes. Node ids are "host:port".
+class HashRing {
+private:
+    std::map<uint64_t, std::string> ring;
+
+public:
+    // FNV-1a with a murmur-style finalizer: stable across processes, unlike std::hash
+    static uint64_t hash(const std::string& s) {
+        uint64_t h = 1469598103934665603ULL;
+        for (unsigned char c : s) {
+            h ^= c;
+            h *= 1099511628211ULL;
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    void addNode(const std::string& node, int vnodes) {
+        for (int i = 0; i < vnodes; ++i) {
+            ring[hash(node + "#" + std::to_string(i))] = node;
+        }
+    }
+
+    void removeNode(const std::string& node) {
+        for (auto it = ring.begin(); it != ring.end();) {
+            if (it->second == node) it = ring.erase(it);
+            else ++it;
+        }
+    }
+
+    bool empty() const { return ring.empty(); }
+
+    // First virtual node clockwise from the key's hash
+    const std::string& owner(const std::string& key) const {
+        auto it = ring.lower_bound(hash(key));
+        if (it == ring.end()) it = ring.begin();
+        return it->second;
+    }
+
+    std::vector<std::string> nodes() const {
+        std::vector<std::string> out;
+        for (const auto& v : ring) {
+            bool seen = false;
+            for (const auto& n : out) seen = seen || n == v.second;
+            if (!seen) out.push_back(v.second);
+        }
+        return out;
+    }
+};
+
+// One entry of a key handoff stream: 'P' ships a cached value with its row
+// version, 'D' drops a key whose shipped value went stale. Encoded as
+// "<op> <klen> <vlen> <version>\n<key><value>". Drops carry version 0.
+struct HandoffRecord {
+    char op;
+    std::string key;
+    std::string value;
+    uint64_t version = 0;
+};
+
+inline std::string encodeRecords(const std::vector<HandoffRecord>& records) {
+    std::string out;
+    for (const auto& r : records) {
+        out += r.op;
+        out += " " + std::to_string(r.key.size()) + " " + std::to_string(r.value.size()) + " " + std::to_string(r.version) + "\n";
+        out += r.key;
+        out += r.value;
+    }
+    return out;
+}
+
+inline bool decodeRecords(const std::string& body, std::vector<HandoffRecord>& out) {
+    size_t pos = 0;
+    while (pos < body.size()) {
+        size_t nl = body.find('\n', pos);
+        if (nl == std::string::npos) return false;
+        HandoffRecord r;
+        size_t klen = 0, vlen = 0;
+        unsigned long long version = 0;
+        char op = 0;
+        std::string header = body.substr(pos, nl - pos);
+        if (sscanf(header.c_str(), "%c %zu %zu %llu", &op, &klen, &vlen, &version) != 4) return false;
+        pos = nl + 1;
+        if (body.size() - pos < klen + vlen) return false;
+        r.op = op;
+        r.version = version;
+        r.key = body.substr(pos, klen);
+        r.value = body.substr(pos + klen, vlen);
+        pos += klen + vlen;
+        out.push_back(std::move(r));
+    }
+    return true;
+}
+
+// Keep-alive HTTP clients to one peer, reused across forwarded requests
+class PeerClientPool {
+private:
+    std::string host;
+    int port;
+    std::mutex mtx;
+    std::vector<std::unique_ptr<httplib::Client>> idle;
+
+public:
+    PeerClientPool(const std::string& host_in, int port_in) : host(host_in), port(port_in) {}
+
+    std::unique_ptr<httplib::Client> borrow() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!idle.empty()) {
+                std::unique_ptr<httplib::Client> cli = std::move(idle.back());
+                idle.pop_back();
+                return cli;
+            }
+        }
+        std::unique_ptr<httplib::Client> cli(new httplib::Client(host, port));
+        cli->set_keep_alive(true);
+        cli->set_connection_timeout(0, Config::CLUSTER_CONNECT_TIMEOUT_MS * 1000);
+        cli->set_read_timeout(Config::CLUSTER_FORWARD_TIMEOUT_SEC, 0);
+        cli->set_write_timeout(Config::CLUSTER_FORWARD_TIMEOUT_SEC, 0);
+        return cli;
+    }
+
+    void release(std::unique_ptr<httplib::Client> cli) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if ((int)idle.size() < Config::CLUSTER_PEER_POOL_SIZE) idle.push_back(std::move(cli));
+    }
+};
+
+// Cluster membership and request forwarding. Each node owns the keys that hash
+// to it on the ring; requests for other keys are forwarded to the owner over
+// pooled keep-alive connections. A forwarded request carries
+// CLUSTER_FORWARD_HEADER and is always served locally, so a stale ring can
+// never cause a forwarding loop.
+//
+// Membership changes go through a transition. The previous ring is kept until
+// every handoff has finished. A moved key stays with its previous owner, which
+// keeps serving it (and the new owner forwards to it) until the previous owner
+// has streamed its hot entries and reported the handoff done. A node that is
+// not in the new membership hands nothing over and is never waited for; a
+// handoff that does not finish in time is abandoned (see Rebalancer).
+class Cluster {
+private:
+    std::string self_id;
+    HashRing ring;
+    std::unique_ptr<HashRing> prev_ring;          // Set while a membership transition is in progress
+    std::set<std::string> pending_from;           // Previous owners that have not finished handing keys to us
+    std::set<std::string> sending_to;             // New owners we have not finished handing keys to
+    std::map<std::string, std::string> early_done;  // Previous owner -> membership it finished handing off for, not applied here yet
+    mutable std::shared_timed_mutex ring_mtx;
+    std::map<std::string, std::unique_ptr<PeerClientPool>> peers;
+    std::mutex peers_mtx;
+
+    std::atomic<uint64_t> forwarded{0};
+    std::atomic<uint64_t> forward_errors{0};
+
+    // Sorted, comma-separated node list identifying a membership
+    static std::string membershipOf(const HashRing& r) {
+        std::vector<std::string> nodes = r.nodes();
+        std::sort(nodes.begin(), nodes.end());
+        std::string out;
+        for (const auto& n : nodes) out += (out.empty() ? "" : ",") + n;
+        return out;
+    }
+
+    // Caller holds ring_mtx exclusively
+    void finishIfDone() {
+        if (pending_from.empty() && sending_to.empty()) prev_ring.reset();
+    }
+
+    PeerClientPool* peer(const std::string& node) {
+        std::lock_guard<std::mutex> lock(peers_mtx);
+        auto it = peers.find(node);
+        if (it != peers.end()) return it->second.get();
+        std::string host;
+        int port;
+        splitNode(node, host, port);
+        PeerClientPool* p = new PeerClientPool(host, port);
+        peers[node].reset(p);
+        return p;
+    }
+
+public:
+    Cluster(const std::string& self_in, const std::vector<std::string>& nodes) : self_id(self_in) {
+        for (const auto& n : nodes) ring.addNode(n, Config::CLUSTER_VNODES);
+    }
+
+    static void splitNode(const std::string& node, std::string& host, int& port) {
+        size_t colon = node.rfind(':');
+        host = node.substr(0, colon);
+        port = colon == std::string::npos ? Config::SERVER_PORT : std::stoi(node.substr(colon + 1));
+    }
+
+    bool enabled() const {
+        std::shared_lock<std::shared_timed_mutex> lock(ring_mtx);
+        return !ring.empty();
+    }
+
+    const std::string& self() const { return self_id; }
+
+    std::string owner(const std::string& key) const {
+        std::shared_lock<std::shared_timed_mutex> lock(ring_mtx);
+        if (ring.empty()) return self_id;
+        return ring.owner(key);
+    }
+
+    std::vector<std::string> nodes() const {
+        std::shared_lock<std::shared_timed_mutex> lock(ring_mtx);
+        return ring.nodes();
+    }
+
+    // Decide where a key is served. Returns true to serve locally, otherwise sets `target`.
+    bool route(const std::string& key, std::string& target) const {
+        std::shared_lock<std::shared_timed_mutex> lock(ring_mtx);
+        if (ring.empty()) return true;
+        const std::string& owner = ring.owner(key);
+        if (prev_ring) {
+            const std::string& prev = prev_ring->owner(key);
+            if (owner == self_id && prev != self_id && pending_from.count(prev)) {
+                target = prev;   // Still being handed to us
+                return false;
+            }
+            if (owner != self_id && prev == self_id && sending_to.count(owner)) {
+                return true;     // Still ours until the handoff completes
+            }
+        }
+        if (owner == self_id) return true;
+        target = owner;
+        return false;
+    }
+
+    // Switch to a new membership. Fails if a transition is still in progress.
+    // `targets` receives the nodes this node must hand keys to.
+    bool setMembers(const std::vector<std::string>& nodes, std::vector<std::string>& targets) {
+        std::unique_lock<std::shared_timed_mutex> lock(ring_mtx);
+        if (prev_ring) return false;
+        HashRing next;
+        for (const auto& n : nodes) next.addNode(n, Config::CLUSTER_VNODES);
+
+        if (!ring.empty()) {
+            prev_ring.reset(new HashRing(ring));
+            std::vector<std::string> staying = next.nodes();
+            for (const auto& n : ring.nodes()) {
+                // A removed node may be down: its keys are read from the database instead
+                if (n != self_id && std::find(staying.begin(), staying.end(), n) != staying.end()) pending_from.insert(n);
+            }
+            for (const auto& n : next.nodes()) {
+                if (n != self_id) sending_to.insert(n);
+            }
+        }
+        ring = next;
+        // Previous owners that finished before this node applied the change
+        std::string id = membershipOf(ring);
+        for (const auto& e : early_done) {
+            if (e.second == id) pending_from.erase(e.first);
+        }
+        early_done.clear();
+        targets.assign(sending_to.begin(), sending_to.end());
+        finishIfDone();
+        return true;
+    }
+
+    bool inTransition() const {
+        std::shared_lock<std::shared_timed_mutex> lock(ring_mtx);
+        return prev_ring != nullptr;
+    }
+
+    // Current membership, as sent with a handoff-done report
+    std::string membership() const {
+        std::shared_lock<std::shared_timed_mutex> lock(ring_mtx);
+        return membershipOf(ring);
+    }
+
+    // `from` finished handing keys to us under `members` (empty: the current membership).
+    // A report for a membership this node has not applied yet is kept for setMembers().
+    void handoffReceived(const std::string& from, const std::string& members) {
+        std::unique_lock<std::shared_timed_mutex> lock(ring_mtx);
+        if (!members.empty() && members != membershipOf(ring)) {
+            early_done[from] = members;
+            return;
+        }
+        pending_from.erase(from);
+        finishIfDone();
+    }
+
+    void handoffSent(const std::string& to) {
+        std::unique_lock<std::shared_timed_mutex> lock(ring_mtx);
+        sending_to.erase(to);
+        finishIfDone();
+    }
+
+    // Previous owners still handing keys to us
+    std::set<std::string> pendingFrom() const {
+        std::shared_lock<std::shared_timed_mutex> lock(ring_mtx);
+        return pending_from;
+    }
+
+    // Owner of `key` before the transition in progress, or "" if there is none
+    std::string previousOwner(const std::string& key) const {
+        std::shared_lock<std::shared_timed_mutex> lock(ring_mtx);
+        if (!prev_ring || prev_ring->empty()) return "";
+        return prev_ring->owner(key);
+    }
+
+    // Stop waiting for `from`; its keys are served here from now on
+    void abandonPending(const std::set<std::string>& from) {
+        std::unique_lock<std::shared_timed_mutex> lock(ring_mtx);
+        for (const auto& n : from) pending_from.erase(n);
+        finishIfDone();
+    }
+
+    // End the transition in progress without waiting for any handoff. Returns false if there is none.
+    bool abandonTransition() {
+        std::unique_lock<std::shared_timed_mutex> lock(ring_mtx);
+        if (!prev_ring) return false;
+        pending_from.clear();
+        sending_to.clear();
+        prev_ring.reset();
+        return true;
+    }
+
+    // POST a body to a peer over the pooled connections. Returns true on a 2xx answer.
+    bool post(const std::string& node, const std::string& path, const std::string& body) {
+        PeerClientPool* pool = peer(node);
+        std::unique_ptr<httplib::Client> cli = pool->borrow();
+        httplib::Headers headers = {{Config::CLUSTER_FORWARD_HEADER, self_id}};
+        httplib::Result r = cli->Post(path, headers, body, "application/octet-stream");
+        if (!r) return false;
+        pool->release(std::move(cli));
+        return r->status >= 200 && r->status < 300;
+    }
+
+    // Relay a request to `node` and copy its answer into `res`. Answers 502 if the peer is unreachable.
+    // With `body`, a POST body still being received is streamed to the peer as it arrives.
+    void forward(const std::string& node, const httplib::Request& req, httplib::Response& res,
+                 const httplib::ContentReader* body = nullptr) {
+        forwarded++;
+        PeerClientPool* pool = peer(node);
+        std::unique_ptr<httplib::Client> cli = pool->borrow();
+
+        httplib::Headers headers = {{Config::CLUSTER_FORWARD_HEADER, self_id}};
+        if (req.has_header("Accept-Encoding")) headers.emplace("Accept-Encoding", req.get_header_value("Accept-Encoding"));
+        std::string content_type = req.get_header_value("Content-Type");
+
+        httplib::Result r;
+        bool streamed = false;
+        if (req.method == "GET") r = cli->Get(req.target, headers);
+        else if (req.method == "POST" && body != nullptr) {
+            r = cli->Post(req.target, headers, [body, &streamed](size_t, httplib::DataSink& sink) {
+                streamed = true;
+                if (!(*body)([&sink](const char* data, size_t len) { return sink.write(data, len); })) return false;
+                sink.done();
+                return true;
+            }, content_type);
+        }
+        else if (req.method == "POST") r = cli->Post(req.target, headers, req.body, content_type);
+        else if (req.method == "PUT") r = cli->Put(req.target, headers, req.body, content_type);
+        else if (req.method == "DELETE") r = cli->Delete(req.target, headers);
+
+        // Consume a body the peer never asked for, so the client's connection stays usable
+        if (body != nullptr && !streamed) (*body)([](const char*, size_t) { return true; });
+        if (!r) {
+            // Drop the client: its connection is in an unknown state
+            forward_errors++;
+            res.status = 502;
+            res.set_content("Owner node " + node + " unreachable", "text/plain");
+            return;
+        }
+
+        res.status = r->status;
+        for (const char* h : {"X-Cache-Status", "X-KV-Version", "Content-Encoding", "Retry-After"}) {
+            if (r->has_header(h)) res.set_header(h, r->get_header_value(h));
+        }
+        res.set_header("X-KV-Node", node);
+        res.set_content(r->body, r->get_header_value("Content-Type", "text/plain"));
+        pool->release(std::move(cli));
+    }
+
+    uint64_t forwardedCount() const { return forwarded; }
+    uint64_t forwardErrors() const { return forward_errors; }
+};
+
+#endif // CLUSTER_H
@@ -0,0 +1,157 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+// Self-contained LZ77 block codec (LZ4-style sequences) used by the cache
+// to keep large values compressed in memory.
+//
+// Block layout:
+//   [4 bytes raw length, little endian] [sequences...]
+// Each sequence is:
+//   token (hi nibble = literal length, lo nibble = match length - 4),
+//   optional literal length bytes (255 continuation), literals,
+//   2-byte little endian match offset, optional match length bytes.
+// The last sequence carries literals only.
+namespace lz {
+
+const uint32_t MIN_MATCH = 4;
+const int HASH_BITS = 12;
+const size_t HEADER_SIZE = 4;
+const size_t LAST_LITERALS = 5;   // Trailing bytes always emitted as literals
+const uint32_t MAX_OFFSET = 65535;
+
+inline uint32_t read32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t hash32(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+inline void writeLength(std::string& out, size_t len) {
+    while (len >= 255) {
+        out.push_back((char)255);
+        len -= 255;
+    }
+    out.push_back((char)len);
+}
+
+inline void emitSequence(std::string& out, const char* lit, size_t lit_len, uint32_t offset, size_t match_len) {
+    size_t ml = match_len - MIN_MATCH;
+    uint8_t token = (uint8_t)(((lit_len >= 15 ? 15 : lit_len) << 4) | (ml >= 15 ? 15 : ml));
+    out.push_back((char)token);
+    if (lit_len >= 15) writeLength(out, lit_len - 15);
+    out.append(lit, lit_len);
+    out.push_back((char)(offset & 0xFF));
+    out.push_back((char)(offset >> 8));
+    if (ml >= 15) writeLength(out, ml - 15);
+}
+
+inline void emitLastLiterals(std::string& out, const char* lit, size_t lit_len) {
+    out.push_back((char)((lit_len >= 15 ? 15 : lit_len) << 4));
+    if (lit_len >= 15) writeLength(out, lit_len - 15);
+    out.append(lit, lit_len);
+}
+
+// Compress `in` into a self-describing block.
+inline std::string compress(const std::string& in) {
+    const char* src = in.data();
+    size_t n = in.size();
+
+    std::string out;
+    out.reserve(HEADER_SIZE + n + n / 255 + 16);
+    uint32_t raw_len = (uint32_t)n;
+    for (int i = 0; i < 4; ++i) out.push_back((char)((raw_len >> (8 * i)) & 0xFF));
+
+    size_t anchor = 0;
+    if (n > MIN_MATCH + LAST_LITERALS) {
+        std::vector<uint32_t> table(1u << HASH_BITS, 0);
+        size_t limit = n - LAST_LITERALS;
+        size_t ip = 1;
+        while (ip + MIN_MATCH <= limit) {
+            uint32_t seq = read32(src + ip);
+            uint32_t h = hash32(seq);
+            size_t cand = table[h];
+            table[h] = (uint32_t)ip;
+
+            if (cand < ip && ip - cand <= MAX_OFFSET && read32(src + cand) == seq) {
+                size_t match_len = MIN_MATCH;
+                while (ip + match_len < limit && src[cand + match_len] == src[ip + match_len]) {
+                    match_len++;
+                }
+                emitSequence(out, src + anchor, ip - anchor, (uint32_t)(ip - cand), match_len);
+                ip += match_len;
+                anchor = ip;
+            } else {
+                ip++;
+            }
+        }
+    }
+    emitLastLiterals(out, src + anchor, n - anchor);
+    return out;
+}
+
+// Raw length recorded in a block header, or 0 if the block is truncated.
+inline size_t rawLength(const std::string& block) {
+    if (block.size() < HEADER_SIZE) return 0;
+    uint32_t len = 0;
+    for (int i = 0; i < 4; ++i) len |= (uint32_t)(uint8_t)block[i] << (8 * i);
+    return len;
+}
+
+// Decompress a block produced by compress(). Returns false on malformed input.
+inline bool decompress(const std::string& block, std::string& out) {
+    if (block.size() < HEADER_SIZE) return false;
+    size_t raw_len = rawLength(block);
+    out.assign(raw_len, '\0');
+
+    const uint8_t* ip = (const uint8_t*)block.data() + HEADER_SIZE;
+    const uint8_t* end = (const uint8_t*)block.data() + block.size();
+    size_t op = 0;
+
+    auto readLength = [&](size_t& len) -> bool {
+        uint8_t b;
+        do {
+            if (ip >= end) return false;
+            b = *ip++;
+            len += b;
+        } while (b == 255);
+        return true;
+    };
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+        size_t lit_len = token >> 4;
+        if (lit_len == 15 && !readLength(lit_len)) return false;
+        if ((size_t)(end - ip) < lit_len || raw_len - op < lit_len) return false;
+        std::memcpy(&out[op], ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        if (ip == end) break;  // Last sequence has no match
+
+        if (end - ip < 2) return false;
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        size_t match_len = token & 0x0F;
+        if (match_len == 15 && !readLength(match_len)) return false;
+        match_len += MIN_MATCH;
+
+        if (offset == 0 || offset > op || raw_len - op < match_len) return false;
+        // Byte-wise copy: source and destination may overlap
+        size_t from = op - offset;
+        for (size_t i = 0; i < match_len; ++i) out[op + i] = out[from + i];
+        op += match_len;
+    }
+    return op == raw_len;
+}
+
+} // namespace lz
+
+#endif // COMPRESSION_H
@@ -0,0 +1,408 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <climits>
+#include <limits>
+#include "constants.h"
+
+// Runtime configuration. Every variable in constants.h can be set from a config
+// file ("NAME = value" lines, '#' comments) and from command-line flags
+// (--cache-shards 8, --CACHE_SHARDS=8); flags win over the file. Lists are
+// comma-separated. Settings held in std::atomic are "hot": a reload (SIGHUP or
+// the admin endpoint) applies them to the running server. Changes to the other
+// settings in the file are reported and need a restart. Numbers outside a
+// setting's range are rejected wherever they come from.
+class ConfigLoader {
+public:
+    struct Setting {
+        std::string name;
+        bool hot;
+        std::function<bool(const std::string&)> set;   // Parse and store; false if the value is invalid
+        std::function<std::string()> get;
+        std::function<bool(const std::string&, std::string&)> normalize;   // Value as get() would print it after set()
+        std::string limits;         // Accepted range for error messages, empty if any value parses
+        bool grows_cold = false;    // Hot, but raising it above its startup value needs a restart
+        std::string startup;        // Value after load(), for grows_cold
+    };
+
+private:
+    std::vector<Setting> settings;
+    std::string path;                                               // Config file, empty if none
+    std::vector<std::pair<std::string, std::string>> overrides;     // Command-line settings
+    std::mutex mtx;                                                 // Serializes reloads and admin changes
+
+    static std::string trim(const std::string& s) {
+        size_t b = s.find_first_not_of(" \t\r\n");
+        if (b == std::string::npos) return "";
+        size_t e = s.find_last_not_of(" \t\r\n");
+        return s.substr(b, e - b + 1);
+    }
+
+    template <typename T>
+    static bool parse(const std::string& in, T& out) {
+        if (in.empty()) return false;
+        errno = 0;
+        char* end = nullptr;
+        long long n = strtoll(in.c_str(), &end, 10);
+        if (errno != 0 || *end != '\0' || n < 0) return false;
+        if ((unsigned long long)n > (unsigned long long)std::numeric_limits<T>::max()) return false;
+        out = (T)n;
+        return true;
+    }
+
+    static bool parse(const std::string& in, bool& out) {
+        std::string v = in;
+        std::transform(v.begin(), v.end(), v.begin(), ::tolower);
+        if (v == "true" || v == "1" || v == "on" || v == "yes") out = true;
+        else if (v == "false" || v == "0" || v == "off" || v == "no") out = false;
+        else return false;
+        return true;
+    }
+
+    static bool parse(const std::string& in, std::string& out) {
+        out = in;
+        return true;
+    }
+
+    static bool parse(const std::string& in, std::vector<std::string>& out) {
+        out.clear();
+        std::stringstream ss(in);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            item = trim(item);
+            if (!item.empty()) out.push_back(item);
+        }
+        return true;
+    }
+
+    template <typename T>
+    static std::string show(T v) { return std::to_string(v); }
+    static std::string show(bool v) { return v ? "true" : "false"; }
+    static std::string show(const std::string& v) { return v; }
+    static std::string show(const std::vector<std::string>& v) {
+        std::string out;
+        for (const auto& item : v) out += (out.empty() ? "" : ",") + item;
+        return out;
+    }
+
+    template <typename T>
+    static bool normalize(const std::string& in, std::string& out) {
+        T value;
+        if (!parse(in, value)) return false;
+        out = show(value);
+        return true;
+    }
+
+    template <typename T>
+    void add(const char* name, T& var) {
+        settings.push_back({name, false,
+                            [&var](const std::string& v) { return parse(v, var); },
+                            [&var] { return show(var); },
+                            normalize<T>, "", false, ""});
+    }
+
+    template <typename T>
+    void add(const char* name, std::atomic<T>& var) {
+        settings.push_back({name, true,
+                            [&var](const std::string& v) {
+                                T value;
+                                if (!parse(v, value)) return false;
+                                var = value;
+                                return true;
+                            },
+                            [&var] { return show(var.load()); },
+                            normalize<T>, "", false, ""});
+    }
+
+    // Accept only [min, max] for an integer setting
+    void range(const char* name, long long min, long long max) {
+        for (auto& s : settings) {
+            if (s.name != name) continue;
+            auto in_range = [min, max](const std::string& v) {
+                long long n;
+                return parse(v, n) && n >= min && n <= max;
+            };
+            auto set = s.set;
+            auto norm = s.normalize;
+            s.set = [in_range, set](const std::string& v) { return in_range(v) && set(v); };
+            s.normalize = [in_range, norm](const std::string& v, std::string& out) { return in_range(v) && norm(v, out); };
+            s.limits = max == LLONG_MAX ? " (at least " + std::to_string(min) + ")"
+                                        : " (" + std::to_string(min) + "-" + std::to_string(max) + ")";
+        }
+    }
+
+    // Whether `s` is being raised above its startup value
+    static bool raisedPastStartup(const Setting& s, const std::string& value) {
+        long long from, to;
+        return s.grows_cold && parse(s.startup, from) && parse(value, to) && to > from;
+    }
+
+    // "cache-shards" and "CACHE_SHARDS" both name CACHE_SHARDS
+    static std::string canonical(const std::string& flag) {
+        std::string name = flag;
+        for (auto& c : name) c = c == '-' ? '_' : (char)toupper((unsigned char)c);
+        return name;
+    }
+
+    // Read "NAME = value" pairs from the config file
+    bool readFile(std::vector<std::pair<std::string, std::string>>& out, std::string& error) const {
+        if (path.empty()) return true;
+        std::ifstream f(path);
+        if (!f) {
+            error = "cannot open " + path;
+            return false;
+        }
+        std::string line;
+        int lineno = 0;
+        while (std::getline(f, line)) {
+            lineno++;
+            size_t hash = line.find('#');
+            if (hash != std::string::npos) line.resize(hash);
+            line = trim(line);
+            if (line.empty()) continue;
+            size_t eq = line.find('=');
+            if (eq == std::string::npos) {
+                error = path + ":" + std::to_string(lineno) + ": expected NAME = value";
+                return false;
+            }
+            out.push_back({canonical(trim(line.substr(0, eq))), trim(line.substr(eq + 1))});
+        }
+        return true;
+    }
+
+public:
+    ConfigLoader() {
+        using namespace Config;
+#define KV_SETTING(name) add(#name, name)
+        KV_SETTING(DB_HOST); KV_SETTING(DB_USER); KV_SETTING(DB_PASS); KV_SETTING(DB_NAME);
+        KV_SETTING(DB_READ_REPLICAS); KV_SETTING(REPLICA_MAX_LAG_SEC); KV_SETTING(REPLICA_FILL_TTL_MS);
+        KV_SETTING(REPLICA_LAG_CHECK_INTERVAL_MS);
+        KV_SETTING(SERVER_ADDRESS); KV_SETTING(SERVER_PORT); KV_SETTING(SERVER_THREAD_POOL_SIZE);
+        KV_SETTING(SERVER_WORKER_QUEUE_CAPACITY); KV_SETTING(SERVER_WORKER_SPIN_US);
+        KV_SETTING(SERVER_WORKER_CPUS); KV_SETTING(DB_THREAD_CPUS); KV_SETTING(CACHE_NUMA_PLACEMENT);
+        KV_SETTING(CLUSTER_NODES); KV_SETTING(CLUSTER_VNODES); KV_SETTING(CLUSTER_PEER_POOL_SIZE);
+        KV_SETTING(CLUSTER_CONNECT_TIMEOUT_MS); KV_SETTING(CLUSTER_FORWARD_TIMEOUT_SEC); KV_SETTING(CLUSTER_FORWARD_HEADER);
+        KV_SETTING(CLUSTER_MIGRATION_BATCH); KV_SETTING(CLUSTER_MIGRATION_KEYS_PER_SEC);
+        KV_SETTING(CLUSTER_MIGRATION_MAX_KEYS); KV_SETTING(CLUSTER_MIGRATION_RETRIES); KV_SETTING(CLUSTER_HANDOFF_TIMEOUT_SEC);
+        KV_SETTING(REPL_ROLE); KV_SETTING(REPL_LEADER); KV_SETTING(REPL_LOG_CAPACITY); KV_SETTING(REPL_STREAM_BATCH);
+        KV_SETTING(REPL_HEARTBEAT_MS); KV_SETTING(REPL_RECONNECT_MS); KV_SETTING(REPL_MAX_FOLLOWERS);
+        KV_SETTING(INVALIDATION_ENABLED); KV_SETTING(INVALIDATION_GROUP); KV_SETTING(INVALIDATION_PORT);
+        KV_SETTING(INVALIDATION_TTL); KV_SETTING(INVALIDATION_FLUSH_US); KV_SETTING(INVALIDATION_MAX_PACKET);
+        KV_SETTING(INVALIDATION_REMEMBER_MS);
+        KV_SETTING(PROFILE_DEFAULT_HZ); KV_SETTING(PROFILE_MAX_HZ); KV_SETTING(PROFILE_MAX_SECONDS); KV_SETTING(PROFILE_MAX_SAMPLES);
+        KV_SETTING(TRACE_ENABLED); KV_SETTING(TRACE_RING_CAPACITY);
+        KV_SETTING(ADMISSION_ENABLED); KV_SETTING(ADMISSION_TARGET_MS); KV_SETTING(ADMISSION_INTERVAL_MS);
+        KV_SETTING(ADMISSION_QUEUE_LIMIT); KV_SETTING(ADMISSION_WRITE_TARGET_MS); KV_SETTING(ADMISSION_WRITE_QUEUE_LIMIT);
+        KV_SETTING(SCAN_BATCH_SIZE); KV_SETTING(SCAN_DEFAULT_LIMIT);
+        KV_SETTING(LARGE_VALUE_THRESHOLD); KV_SETTING(LARGE_VALUE_CHUNK_BYTES);
+        KV_SETTING(COUNTER_SYNC); KV_SETTING(COUNTER_FLUSH_INTERVAL_MS); KV_SETTING(COUNTER_FLUSH_BATCH);
+        KV_SETTING(BULK_STATEMENT_ROWS); KV_SETTING(BULK_STATEMENT_BYTES); KV_SETTING(BULK_TRANSACTION_ROWS);
+        KV_SETTING(BULK_MAX_KEY_BYTES); KV_SETTING(BULK_MAX_VALUE_BYTES);
+        KV_SETTING(KEY_FILTER_ENABLED); KV_SETTING(KEY_FILTER_EXPECTED_KEYS); KV_SETTING(KEY_FILTER_COUNTERS_PER_KEY);
+        KV_SETTING(KEY_FILTER_BUILD_THREADS); KV_SETTING(KEY_FILTER_BUILD_BATCH);
+        KV_SETTING(CACHE_CAPACITY_TOTAL); KV_SETTING(CACHE_SHARDS); KV_SETTING(CACHE_COMPRESSION_ENABLED);
+        KV_SETTING(CACHE_COMPRESS_THRESHOLD); KV_SETTING(CACHE_COMPRESS_ENCODING);
+        KV_SETTING(DB_POOL_MIN_SIZE); KV_SETTING(DB_POOL_MAX_SIZE); KV_SETTING(DB_POOL_GROW_WAIT_P99_MS);
+        KV_SETTING(DB_POOL_IDLE_TIMEOUT_SEC); KV_SETTING(DB_POOL_MAINTENANCE_INTERVAL_MS); KV_SETTING(DB_POOL_AFFINITY_SLOTS);
+        KV_SETTING(DB_POOL_PARK_RECHECK_MS); KV_SETTING(DB_BORROW_TIMEOUT_MS); KV_SETTING(DB_VALIDATE_IDLE_MS);
+        KV_SETTING(DB_RECONNECT_INTERVAL_MS); KV_SETTING(DB_CONNECT_TIMEOUT_SEC); KV_SETTING(DB_READ_TIMEOUT_SEC);
+        KV_SETTING(RETRY_AFTER_SEC);
+#undef KV_SETTING
+
+        // Sizes, divisors and steps that cannot be zero
+#define KV_RANGE(name, min, max) range(#name, min, max)
+        KV_RANGE(SERVER_PORT, 1, 65535); KV_RANGE(SERVER_THREAD_POOL_SIZE, 1, LLONG_MAX);
+        KV_RANGE(SERVER_WORKER_QUEUE_CAPACITY, 1, LLONG_MAX);
+        KV_RANGE(CLUSTER_VNODES, 1, LLONG_MAX); KV_RANGE(CLUSTER_MIGRATION_BATCH, 1, LLONG_MAX);
+        KV_RANGE(CLUSTER_MIGRATION_KEYS_PER_SEC, 1, LLONG_MAX); KV_RANGE(CLUSTER_MIGRATION_RETRIES, 1, LLONG_MAX);
+        KV_RANGE(REPL_LOG_CAPACITY, 1, LLONG_MAX); KV_RANGE(REPL_STREAM_BATCH, 1, LLONG_MAX);
+        KV_RANGE(INVALIDATION_PORT, 1, 65535); KV_RANGE(INVALIDATION_TTL, 0, 255); KV_RANGE(INVALIDATION_MAX_PACKET, 64, 65507);
+        KV_RANGE(TRACE_RING_CAPACITY, 1, LLONG_MAX);
+        KV_RANGE(ADMISSION_QUEUE_LIMIT, 1, LLONG_MAX); KV_RANGE(ADMISSION_WRITE_QUEUE_LIMIT, 1, LLONG_MAX);
+        KV_RANGE(SCAN_BATCH_SIZE, 1, LLONG_MAX); KV_RANGE(SCAN_DEFAULT_LIMIT, 1, LLONG_MAX); KV_RANGE(LARGE_VALUE_CHUNK_BYTES, 1, LLONG_MAX);
+        KV_RANGE(COUNTER_FLUSH_BATCH, 1, LLONG_MAX);
+        KV_RANGE(BULK_STATEMENT_ROWS, 1, LLONG_MAX); KV_RANGE(BULK_STATEMENT_BYTES, 1, LLONG_MAX); KV_RANGE(BULK_TRANSACTION_ROWS, 1, LLONG_MAX);
+        KV_RANGE(BULK_MAX_KEY_BYTES, 1, 3072); KV_RANGE(BULK_MAX_VALUE_BYTES, 0, 1073741824);
+        KV_RANGE(KEY_FILTER_EXPECTED_KEYS, 1, LLONG_MAX); KV_RANGE(KEY_FILTER_COUNTERS_PER_KEY, 1, 64);
+        KV_RANGE(KEY_FILTER_BUILD_THREADS, 1, LLONG_MAX); KV_RANGE(KEY_FILTER_BUILD_BATCH, 1, LLONG_MAX);
+        KV_RANGE(CACHE_CAPACITY_TOTAL, 1, LLONG_MAX); KV_RANGE(CACHE_SHARDS, 1, LLONG_MAX);
+        KV_RANGE(DB_POOL_MAX_SIZE, 1, LLONG_MAX);
+
+        // Durations and rates, capped at realistic values so that converting them
+        // to finer units cannot overflow
+        KV_RANGE(REPLICA_MAX_LAG_SEC, 0, 86400); KV_RANGE(REPLICA_FILL_TTL_MS, 0, 3600000);
+        KV_RANGE(REPLICA_LAG_CHECK_INTERVAL_MS, 1, 3600000); KV_RANGE(SERVER_WORKER_SPIN_US, 0, 1000000);
+        KV_RANGE(CLUSTER_CONNECT_TIMEOUT_MS, 1, 60000); KV_RANGE(CLUSTER_FORWARD_TIMEOUT_SEC, 1, 3600);
+        KV_RANGE(CLUSTER_HANDOFF_TIMEOUT_SEC, 1, 86400);
+        KV_RANGE(REPL_HEARTBEAT_MS, 1, 600000); KV_RANGE(REPL_RECONNECT_MS, 1, 3600000);
+        KV_RANGE(INVALIDATION_FLUSH_US, 0, 1000000); KV_RANGE(INVALIDATION_REMEMBER_MS, 0, 3600000);
+        KV_RANGE(PROFILE_DEFAULT_HZ, 1, 10000); KV_RANGE(PROFILE_MAX_HZ, 1, 10000); KV_RANGE(PROFILE_MAX_SECONDS, 1, 3600);
+        KV_RANGE(ADMISSION_TARGET_MS, 1, 60000); KV_RANGE(ADMISSION_INTERVAL_MS, 1, 60000);
+        KV_RANGE(ADMISSION_WRITE_TARGET_MS, 1, 60000); KV_RANGE(COUNTER_FLUSH_INTERVAL_MS, 1, 3600000);
+        KV_RANGE(DB_POOL_GROW_WAIT_P99_MS, 0, 60000); KV_RANGE(DB_POOL_IDLE_TIMEOUT_SEC, 0, 86400);
+        KV_RANGE(DB_POOL_MAINTENANCE_INTERVAL_MS, 1, 3600000); KV_RANGE(DB_POOL_PARK_RECHECK_MS, 1, 60000);
+        KV_RANGE(DB_BORROW_TIMEOUT_MS, 0, 600000); KV_RANGE(DB_VALIDATE_IDLE_MS, 0, 3600000);
+        KV_RANGE(DB_RECONNECT_INTERVAL_MS, 1, 3600000); KV_RANGE(DB_CONNECT_TIMEOUT_SEC, 1, 3600);
+        KV_RANGE(DB_READ_TIMEOUT_SEC, 1, 3600); KV_RANGE(RETRY_AFTER_SEC, 0, 3600);
+#undef KV_RANGE
+
+        // The pool allocates DB_POOL_MAX_SIZE connection entries at startup
+        for (auto& s : settings) s.grows_cold = s.name == "DB_POOL_MAX_SIZE";
+    }
+
+    ConfigLoader(const ConfigLoader&) = delete;
+    ConfigLoader& operator=(const ConfigLoader&) = delete;
+
+    const Setting* find(const std::string& name) const {
+        std::string key = canonical(name);
+        for (const auto& s : settings) {
+            if (s.name == key) return &s;
+        }
+        return nullptr;
+    }
+
+    const std::vector<Setting>& all() const { return settings; }
+
+    // Take --config <file> and --<setting> <value> / --<setting>=<value> out of
+    // argv. Arguments that are not settings are returned in `rest`.
+    bool parseArgs(int argc, char* argv[], std::vector<std::string>& rest, std::string& error) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg.compare(0, 2, "--") != 0) {
+                rest.push_back(arg);
+                continue;
+            }
+            std::string name = arg.substr(2);
+            std::string value;
+            size_t eq = name.find('=');
+            bool inline_value = eq != std::string::npos;
+            if (inline_value) {
+                value = name.substr(eq + 1);
+                name.resize(eq);
+            }
+            if (name != "config" && find(name) == nullptr) {
+                rest.push_back(arg);
+                continue;
+            }
+            if (!inline_value) {
+                if (i + 1 >= argc) {
+                    error = arg + " needs a value";
+                    return false;
+                }
+                value = argv[++i];
+            }
+            if (name == "config") path = value;
+            else overrides.push_back({canonical(name), value});
+        }
+        return true;
+    }
+
+    // Apply the file, then the command line, to every setting. Call once at startup.
+    bool load(std::string& error) {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::vector<std::pair<std::string, std::string>> values;
+        if (!readFile(values, error)) return false;
+        values.insert(values.end(), overrides.begin(), overrides.end());
+        for (const auto& kv : values) {
+            const Setting* s = find(kv.first);
+            if (s == nullptr) {
+                error = "unknown setting " + kv.first;
+                return false;
+            }
+            if (!s->set(kv.second)) {
+                error = "invalid value for " + kv.first + ": " + kv.second + s->limits;
+                return false;
+            }
+        }
+        for (auto& s : settings) {
+            if (s.grows_cold) s.startup = s.get();
+        }
+        return true;
+    }
+
+    // Re-read the file (command-line values still win) and apply the hot settings
+    // that changed. Cold settings whose value differs are listed in `restart`, as
+    // are grows_cold settings raised above their startup value (applied as far as
+    // the running server allows).
+    bool reload(std::vector<std::string>& changed, std::vector<std::string>& restart, std::string& error) {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::vector<std::pair<std::string, std::string>> file_values, values;
+        if (!readFile(file_values, error)) return false;
+        // Later values win: the file's last assignment, then the command line
+        file_values.insert(file_values.end(), overrides.begin(), overrides.end());
+        for (const auto& kv : file_values) {
+            auto it = std::find_if(values.begin(), values.end(),
+                                   [&](const std::pair<std::string, std::string>& v) { return v.first == kv.first; });
+            if (it == values.end()) values.push_back(kv);
+            else it->second = kv.second;
+        }
+        // Validate everything before changing anything
+        std::vector<std::pair<const Setting*, std::string>> parsed;
+        for (const auto& kv : values) {
+            const Setting* s = find(kv.first);
+            std::string value;
+            if (s == nullptr) {
+                error = "unknown setting " + kv.first;
+                return false;
+            }
+            if (!s->normalize(kv.second, value)) {
+                error = "invalid value for " + kv.first + ": " + kv.second + s->limits;
+                return false;
+            }
+            parsed.push_back({s, value});
+        }
+        for (const auto& p : parsed) {
+            const Setting* s = p.first;
+            std::string before = s->get();
+            if (before == p.second) continue;
+            if (s->hot) {
+                s->set(p.second);
+                changed.push_back(s->name + "=" + p.second);
+                if (raisedPastStartup(*s, p.second)) restart.push_back(s->name);
+            } else if (std::find(restart.begin(), restart.end(), s->name) == restart.end()) {
+                restart.push_back(s->name);
+            }
+        }
+        return true;
+    }
+
+    // Change one hot setting at runtime (admin endpoint). The file and command
+    // line are not modified; a reload sets the value again if either names it.
+    bool setHot(const std::string& name, const std::string& value, std::string& error) {
+        std::lock_guard<std::mutex> lock(mtx);
+        const Setting* s = find(name);
+        if (s == nullptr) {
+            error = "unknown setting " + name;
+            return false;
+        }
+        if (!s->hot) {
+            error = s->name + " cannot change while the server runs";
+            return false;
+        }
+        std::string normalized;
+        if (s->normalize(value, normalized) && raisedPastStartup(*s, normalized)) {
+            error = s->name + " above " + s->startup + " needs a restart";
+            return false;
+        }
+        if (!s->set(value)) {
+            error = "invalid value for " + s->name + ": " + value + s->limits;
+            return false;
+        }
+        return true;
+    }
+
+    const std::string& file() const { return path; }
+};
+
+#endif // CONFIG_H
@@ -2,25 +2,135 @@
 #define CONSTANTS_H
 
 #include <string>
+#include <vector>
+#include <atomic>
 
+// Defaults for every tunable. kv_server overrides them at startup from a config
+// file and command-line flags (see config.h); nothing changes them afterwards
+// except the std::atomic ones, which can be reloaded while the server runs.
 namespace Config {
     // Database Config
-    const std::string DB_HOST = "tcp://127.0.0.1:3306";
-    const std::string DB_USER = "mysql_user";
-    const std::string DB_PASS = "abc@123"; 
-    const std::string DB_NAME = "kv_store_db";
+    inline std::string DB_HOST = "tcp://127.0.0.1:3306";
+    inline std::string DB_USER = "mysql_user";
+    inline std::string DB_PASS = "abc@123"; 
+    inline std::string DB_NAME = "kv_store_db";
+
+    // Read replicas used for cache-miss reads (e.g. "tcp://127.0.0.1:3307"). Empty = primary only.
+    inline std::vector<std::string> DB_READ_REPLICAS = {};
+    inline std::atomic<long long> REPLICA_MAX_LAG_SEC{5};          // Exclude replicas further behind than this
+    inline std::atomic<int> REPLICA_FILL_TTL_MS{1000};             // Cached values read from a replica expire after this (0 = not cached)
+    inline int REPLICA_LAG_CHECK_INTERVAL_MS = 1000;
 
     // Server Config
-    const std::string SERVER_ADDRESS = "127.0.0.1";
-    const int SERVER_PORT = 8080;
-    const int SERVER_THREAD_POOL_SIZE = 4; // Number of HTTP worker threads
+    inline std::string SERVER_ADDRESS = "127.0.0.1";
+    inline int SERVER_PORT = 8080;
+    inline int SERVER_THREAD_POOL_SIZE = 4; // Number of HTTP worker threads
+    inline int SERVER_WORKER_QUEUE_CAPACITY = 1024;   // Queued connections per worker before new ones are refused
+    inline int SERVER_WORKER_SPIN_US = 50;            // Idle workers poll this long before parking
+
+    // CPU/NUMA placement, as CPU lists like "0-3,8". Empty = leave to the scheduler.
+    inline std::string SERVER_WORKER_CPUS = "";       // Worker i is pinned to the i-th CPU of the list
+    inline std::string DB_THREAD_CPUS = "";           // DB pool, replica, replication and invalidation threads
+    inline bool CACHE_NUMA_PLACEMENT = true;          // Allocate cache shards on the NUMA nodes of the workers
+
+    // Cluster Config: "host:port" of every node. Empty = standalone.
+    // Run each node as ./kv_server <port>; keys are assigned on a consistent-hash ring.
+    inline std::vector<std::string> CLUSTER_NODES = {};
+    inline int CLUSTER_VNODES = 128;                  // Virtual nodes per member
+    inline int CLUSTER_PEER_POOL_SIZE = 16;           // Idle keep-alive connections kept per peer
+    inline int CLUSTER_CONNECT_TIMEOUT_MS = 300;
+    inline int CLUSTER_FORWARD_TIMEOUT_SEC = 5;
+    inline std::string CLUSTER_FORWARD_HEADER = "X-KV-Forwarded-By";
+    inline int CLUSTER_MIGRATION_BATCH = 256;         // Entries per handoff request
+    inline int CLUSTER_MIGRATION_KEYS_PER_SEC = 20000; // Handoff rate limit per target
+    inline int CLUSTER_MIGRATION_MAX_KEYS = 100000;   // Hottest entries shipped per target
+    inline int CLUSTER_MIGRATION_RETRIES = 5;
+    inline int CLUSTER_HANDOFF_TIMEOUT_SEC = 300;     // A handoff not finished by then is given up
+
+    // Replication Config: role is "standalone", "leader" or "follower" (overridden by --leader / --follow host:port)
+    inline std::string REPL_ROLE = "standalone";
+    inline std::string REPL_LEADER = "";              // "host:port" of the leader when following
+    inline int REPL_LOG_CAPACITY = 100000;            // Writes retained for followers that reconnect
+    inline int REPL_STREAM_BATCH = 512;               // Log entries per chunk
+    inline int REPL_HEARTBEAT_MS = 1000;              // Idle stream heartbeat; followers time out after 3 missed
+    inline int REPL_RECONNECT_MS = 500;
+    inline int REPL_MAX_FOLLOWERS = 2;                // Streams served at once; each holds a worker, so kept below SERVER_THREAD_POOL_SIZE
+
+    // Invalidation bus: instances sharing the same MySQL table join one multicast group
+    inline bool INVALIDATION_ENABLED = false;
+    inline std::string INVALIDATION_GROUP = "239.255.42.99";
+    inline int INVALIDATION_PORT = 9399;
+    inline int INVALIDATION_TTL = 1;                  // Multicast hops; 1 keeps traffic on the local segment
+    inline int INVALIDATION_FLUSH_US = 500;           // Batching window before a datagram is sent
+    inline int INVALIDATION_MAX_PACKET = 1400;        // Stay below a typical MTU
+    inline int INVALIDATION_REMEMBER_MS = 2000;       // How long received versions block stale cache fills
+
+    // Sampling profiler (GET /debug/profile?seconds=N[&hz=H])
+    inline int PROFILE_DEFAULT_HZ = 99;               // Off the 100 Hz beat of periodic work
+    inline int PROFILE_MAX_HZ = 1000;
+    inline int PROFILE_MAX_SECONDS = 60;
+    inline int PROFILE_MAX_SAMPLES = 50000;           // Stack buffer (512 bytes each); later samples are dropped
+
+    // Stage tracing: Server-Timing header and GET /debug/traces
+    inline bool TRACE_ENABLED = true;
+    inline int TRACE_RING_CAPACITY = 4096;            // Records kept per worker thread between /debug/traces reads
+
+    // Admission control: shed writes, then cache-miss reads, when connections queue for workers too long
+    inline std::atomic<bool> ADMISSION_ENABLED{true};
+    inline std::atomic<int> ADMISSION_TARGET_MS{5};               // Acceptable queueing delay
+    inline std::atomic<int> ADMISSION_INTERVAL_MS{100};           // Delay must stay above target this long to count as overload
+    inline std::atomic<int> ADMISSION_QUEUE_LIMIT{64};            // Queued connections that count as overload regardless of delay
+    inline std::atomic<int> ADMISSION_WRITE_TARGET_MS{2};         // Writes are shed once the delay stays above this (at most ADMISSION_TARGET_MS)
+    inline std::atomic<int> ADMISSION_WRITE_QUEUE_LIMIT{32};      // Queued connections at which writes are shed (at most ADMISSION_QUEUE_LIMIT)
+
+    // Range scans (GET /api/scan): rows per query and streamed chunk
+    inline int SCAN_BATCH_SIZE = 500;
+    inline int SCAN_DEFAULT_LIMIT = 1000;             // Rows returned when the request gives no limit
+
+    // Large values: streamed between the HTTP body and MySQL in pieces, never cached
+    inline size_t LARGE_VALUE_THRESHOLD = 256 * 1024;
+    inline size_t LARGE_VALUE_CHUNK_BYTES = 1024 * 1024;  // Piece size; keep below MySQL's max_allowed_packet
+
+    // Counters (POST /api/incr): increments are aggregated in the cache and flushed as one UPDATE per counter
+    inline std::atomic<bool> COUNTER_SYNC{false};                 // Write every increment to MySQL before answering
+    inline std::atomic<int> COUNTER_FLUSH_INTERVAL_MS{100};       // Longest an increment waits to reach MySQL
+    inline int COUNTER_FLUSH_BATCH = 500;             // Counters per flush transaction
+
+    // Bulk load (POST /api/bulk): records are inserted with multi-row statements inside large transactions
+    inline int BULK_STATEMENT_ROWS = 1000;            // Rows per INSERT (at most 21845: three placeholders per row)
+    inline size_t BULK_STATEMENT_BYTES = 4 * 1024 * 1024; // Also end a statement here; keep below max_allowed_packet
+    inline int BULK_TRANSACTION_ROWS = 50000;         // Rows per commit
+    inline size_t BULK_MAX_KEY_BYTES = 1020;          // key_name is VARCHAR(255) in utf8mb4
+    inline size_t BULK_MAX_VALUE_BYTES = 16 * 1024 * 1024; // Larger records are rejected before they are buffered
+
+    // Key filter: counting Bloom filter of existing keys, so misses skip MySQL (standalone nodes only)
+    inline bool KEY_FILTER_ENABLED = true;
+    inline long long KEY_FILTER_EXPECTED_KEYS = 1000000; // Sizing; more keys raise the false-positive rate
+    inline int KEY_FILTER_COUNTERS_PER_KEY = 10;      // 4-bit counters per expected key; 10 gives about 1% false positives
+    inline int KEY_FILTER_BUILD_THREADS = 4;          // Parallel range scans filling the filter at startup
+    inline int KEY_FILTER_BUILD_BATCH = 10000;        // Keys per scanned range
 
     // Cache Config
-    const int CACHE_CAPACITY_TOTAL = 1000; // Total items in cache
-    const int CACHE_SHARDS = 4;            // Number of cache shards to reduce lock contention
+    inline std::atomic<int> CACHE_CAPACITY_TOTAL{1000}; // Total items in cache
+    inline int CACHE_SHARDS = 4;            // Number of cache shards to reduce lock contention
+    inline bool CACHE_COMPRESSION_ENABLED = true;
+    inline std::atomic<size_t> CACHE_COMPRESS_THRESHOLD{1024};     // Compress values of at least this many bytes
+    inline std::string CACHE_COMPRESS_ENCODING = "x-kv-lz"; // Content-Encoding for clients that accept raw lz blocks
 
     // DB Connection Pool Config
-    const int DB_POOL_SIZE = 4; // Match thread pool size to avoid waiting
+    inline std::atomic<int> DB_POOL_MIN_SIZE{4};  // Connections opened at startup and kept when idle
+    inline std::atomic<int> DB_POOL_MAX_SIZE{16}; // Upper bound for wait-driven growth
+    inline std::atomic<int> DB_POOL_GROW_WAIT_P99_MS{2};          // Grow when the window's borrow-wait p99 exceeds this
+    inline std::atomic<int> DB_POOL_IDLE_TIMEOUT_SEC{30};         // Close connections idle longer than this (down to the minimum)
+    inline int DB_POOL_MAINTENANCE_INTERVAL_MS = 500; // Sizing window
+    inline int DB_POOL_AFFINITY_SLOTS = 64;           // Per-thread connection slots (threads beyond this share the queue)
+    inline int DB_POOL_PARK_RECHECK_MS = 1;           // Re-check interval for threads parked on an exhausted pool
+    inline std::atomic<int> DB_BORROW_TIMEOUT_MS{200};            // Give up borrowing after this long and answer 503
+    inline std::atomic<int> DB_VALIDATE_IDLE_MS{5000};            // Ping connections idle longer than this before handing them out
+    inline int DB_RECONNECT_INTERVAL_MS = 1000;       // Back-off between reconnect attempts
+    inline int DB_CONNECT_TIMEOUT_SEC = 2;
+    inline int DB_READ_TIMEOUT_SEC = 5;               // Socket read/write timeout for queries
+    inline std::atomic<int> RETRY_AFTER_SEC{1};                   // Retry-After sent with 503 responses
 }
 
 #endif // CONSTANTS_H
\ No newline at end of file
@@ -0,0 +1,146 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include "constants.h"
+#include "database.h"
+#include "cache.h"
+
+// Snapshot of the increment path (see /stats)
+struct CounterStats {
+    uint64_t increments = 0;
+    uint64_t pending_keys = 0;     // Counters with increments not yet in MySQL
+    long long pending_delta = 0;   // Sum of those increments
+    uint64_t flushes = 0;          // Flush transactions committed
+    uint64_t statements = 0;       // UPDATEs written (one per counter per flush)
+    uint64_t superseded = 0;       // Flushes dropped because another write replaced the row first
+    uint64_t flush_errors = 0;
+};
+
+// Writes aggregated counter increments to MySQL. POST /api/incr applies each
+// delta to the counter's cache entry; the entry stays pinned while deltas are
+// waiting. Every COUNTER_FLUSH_INTERVAL_MS this thread takes the waiting deltas,
+// one per counter however many increments it received, and writes them as
+// `value = value + delta` UPDATEs, COUNTER_FLUSH_BATCH per transaction, along
+// with the counter's latest version. Failed batches are queued again. An UPDATE
+// only applies while the row is at the version the increments were counted
+// from: a PUT, create or delete that lands first supersedes them, and the
+// cached counter is dropped rather than added on top of the new value.
+class CounterFlusher {
+private:
+    ShardedLRUCache* cache;
+    DBPool* pool;
+    std::function<void(const std::string&, uint64_t)> on_flushed;   // Tells other instances the DB row changed
+
+    std::atomic<uint64_t> increments{0};
+    std::atomic<uint64_t> flushes{0};
+    std::atomic<uint64_t> statements{0};
+    std::atomic<uint64_t> superseded{0};
+    std::atomic<uint64_t> flush_errors{0};
+
+    std::atomic<bool> stopping{false};
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread flusher;
+
+    void flushLoop() {
+        while (!stopping) {
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait_for(lock, std::chrono::milliseconds(Config::COUNTER_FLUSH_INTERVAL_MS.load()), [this] { return stopping.load(); });
+            }
+            flush();
+        }
+        flush();    // Whatever arrived before shutdown
+    }
+
+public:
+    CounterFlusher(ShardedLRUCache* cache_in, DBPool* pool_in, std::function<void(const std::string&, uint64_t)> on_flushed_in)
+        : cache(cache_in), pool(pool_in), on_flushed(std::move(on_flushed_in)) {
+        flusher = std::thread(&CounterFlusher::flushLoop, this);
+    }
+
+    ~CounterFlusher() {
+        stopping = true;
+        cv.notify_all();
+        if (flusher.joinable()) flusher.join();
+    }
+
+    void counted() { increments.fetch_add(1, std::memory_order_relaxed); }
+
+    // Add each delta to its row in one transaction, marking the ones whose row was
+    // still at their base version as applied. Returns false if nothing was committed.
+    bool write(std::vector<PendingWrite>& deltas) {
+        sql::Connection* con = pool->getConnection();
+        if (con == nullptr) return false;
+        bool ok = true;
+        try {
+            con->setAutoCommit(false);
+            std::unique_ptr<sql::PreparedStatement> pstmt(con->prepareStatement(
+                "UPDATE key_value SET value = CAST(value AS SIGNED) + ?, version = GREATEST(version, ?) WHERE key_name = ? AND version <= ?"));
+            for (auto& d : deltas) {
+                pstmt->setInt64(1, d.delta);
+                pstmt->setUInt64(2, d.version);
+                pstmt->setString(3, d.key);
+                pstmt->setUInt64(4, d.base);
+                d.applied = pstmt->executeUpdate() > 0;
+            }
+            con->commit();
+        } catch (sql::SQLException &e) {
+            std::cerr << "SQL Error in Counter Flush: " << e.what() << std::endl;
+            ok = false;
+            try {
+                con->rollback();
+            } catch (sql::SQLException &) {}
+        }
+        try {
+            con->setAutoCommit(true);
+        } catch (sql::SQLException &) {
+            ok = false;
+        }
+        pool->releaseConnection(con, !ok);
+        if (ok) {
+            flushes.fetch_add(1, std::memory_order_relaxed);
+            statements.fetch_add(deltas.size(), std::memory_order_relaxed);
+            for (const auto& d : deltas) {
+                if (d.applied) on_flushed(d.key, d.version);
+                else superseded.fetch_add(1, std::memory_order_relaxed);
+            }
+        } else {
+            flush_errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        return ok;
+    }
+
+    // Write every waiting delta now
+    void flush() {
+        while (true) {
+            std::vector<PendingWrite> deltas = cache->takePending(Config::COUNTER_FLUSH_BATCH);
+            if (deltas.empty()) return;
+            bool ok = write(deltas);
+            for (const auto& d : deltas) cache->settle(d, ok, false);
+            if (!ok) return;    // Retried next interval
+        }
+    }
+
+    CounterStats stats() {
+        CounterStats s;
+        s.increments = increments.load(std::memory_order_relaxed);
+        s.flushes = flushes.load(std::memory_order_relaxed);
+        s.statements = statements.load(std::memory_order_relaxed);
+        s.superseded = superseded.load(std::memory_order_relaxed);
+        s.flush_errors = flush_errors.load(std::memory_order_relaxed);
+        cache->pendingStats(s.pending_keys, s.pending_delta);
+        return s;
+    }
+};
+
+#endif // COUNTERS_H
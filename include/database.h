@@ -7,54 +7,496 @@
 #include <cppconn/prepared_statement.h>
 #include <cppconn/exception.h>
 
-#include <queue>
+#include <string>
+#include <vector>
 #include <mutex>
 #include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <algorithm>
 #include "constants.h"
+#include "histogram.h"
+#include "mpmc_queue.h"
 
+// Snapshot of pool sizing and borrow metrics (see /stats)
+struct PoolStats {
+    int size = 0;
+    int idle = 0;
+    int in_use = 0;
+    int min_size = 0;
+    int max_size = 0;
+    uint64_t borrows = 0;
+    uint64_t affinity_hits = 0;     // Borrows served from the thread's own slot
+    uint64_t steals = 0;            // Borrows served from another thread's slot
+    uint64_t sleeps = 0;            // Borrows that had to block
+    uint64_t grown = 0;
+    uint64_t shrunk = 0;
+    uint64_t timeouts = 0;          // Borrows that gave up after DB_BORROW_TIMEOUT_MS
+    uint64_t invalidated = 0;       // Connections that failed validation
+    uint64_t reconnects = 0;        // Connections re-established in the background
+    int reconnecting = 0;           // Connections currently waiting to be re-established
+    double wait_avg_ms = 0;
+    double wait_p50_ms = 0;
+    double wait_p99_ms = 0;
+    double window_wait_p99_ms = 0;  // p99 of the last maintenance window
+    double hold_avg_ms = 0;
+    double hold_p99_ms = 0;
+    double utilization = 0;         // Busy connection-time / pool connection-time over the last window
+};
+
+// Elastic connection pool. Sized between DB_POOL_MIN_SIZE and DB_POOL_MAX_SIZE:
+// a maintenance thread adds a connection when the borrow-wait p99 of the last
+// window exceeds DB_POOL_GROW_WAIT_P99_MS and closes connections idle for
+// longer than DB_POOL_IDLE_TIMEOUT_SEC.
+//
+// Borrowing is lock-free on the fast path. Each worker thread owns an affinity
+// slot and returns its connection there, so the next borrow on that thread is a
+// single uncontended exchange. Otherwise connections go through a lock-free
+// MPMC queue, and a borrower with an empty slot and queue steals from other
+// threads' slots. The mutex/condition variable is only used to park threads
+// when every connection is busy.
+//
+// Borrowing is bounded by DB_BORROW_TIMEOUT_MS (getConnection() returns nullptr
+// and the handler answers 503). Connections idle for longer than
+// DB_VALIDATE_IDLE_MS are pinged before being handed out, and connections
+// returned after an SQL error are pinged before going back to the pool. Dead
+// connections are handed to a reconnect thread instead of being reused.
 class DBPool {
 private:
-    std::queue<sql::Connection*> connections;
+    typedef std::chrono::steady_clock Clock;
+    static const int NO_CONNECTION = -1;
+
+    std::string host;                            // Endpoint this pool connects to
+    const uint64_t id;                           // Unique per pool, never reused; keys the thread's slot
+
+    // One opened connection. Indexed by position in `entries`.
+    struct alignas(64) Entry {
+        std::atomic<sql::Connection*> con{nullptr};
+        std::atomic<int64_t> borrowed_at_us{0};
+        std::atomic<int64_t> idle_since_us{0};
+    };
+
+    // Per-thread parking place for an idle connection
+    struct alignas(64) AffinitySlot {
+        std::atomic<int> idx{NO_CONNECTION};
+    };
+
+    const int capacity;                          // DB_POOL_MAX_SIZE at startup; a reload can lower the bound, not raise it past this
+    std::unique_ptr<Entry[]> entries;            // `capacity` entries
+    std::unique_ptr<AffinitySlot[]> slots;       // DB_POOL_AFFINITY_SLOTS slots
+    MPMCQueue<int> idle;
+    std::atomic<int> next_slot{0};
+    std::vector<int> free_entries;               // Unopened entries
+    std::mutex free_mtx;
+
+    std::atomic<int> total{0};                   // Opened connections
+    std::atomic<int> in_use{0};
+    std::atomic<int> waiters{0};                 // Threads parked in getConnection()
     std::mutex mtx;
     std::condition_variable cv;
     sql::mysql::MySQL_Driver* driver;
 
+    LatencyHistogram wait_hist;
+    LatencyHistogram window_wait_hist;
+    LatencyHistogram last_window_wait;
+    LatencyHistogram hold_hist;
+    std::atomic<uint64_t> window_hold_us{0};
+    std::atomic<uint64_t> affinity_hits{0};
+    std::atomic<uint64_t> steals{0};
+    std::atomic<uint64_t> sleeps{0};
+    std::atomic<uint64_t> grown{0};
+    std::atomic<uint64_t> shrunk{0};
+    std::atomic<uint64_t> timeouts{0};
+    std::atomic<uint64_t> invalidated{0};
+    std::atomic<uint64_t> reconnects{0};
+    std::atomic<double> last_utilization{0.0};
+
+    std::atomic<bool> stopping{false};
+    std::mutex maint_mtx;
+    std::condition_variable maint_cv;
+    std::thread maintenance;
+
+    std::vector<int> reconnect_queue;            // Entries whose connection is dead
+    std::mutex reconnect_mtx;
+    std::condition_variable reconnect_cv;
+    std::thread reconnector;
+
+    static int64_t nowUs() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    static uint64_t nextId() {
+        static std::atomic<uint64_t> next{0};
+        return ++next;
+    }
+
+    // Affinity slot of the calling thread in this pool, or NO_CONNECTION if all slots are taken.
+    // A thread has one slot per pool (primary and each replica); a handful, so a linear scan.
+    int mySlot() {
+        static thread_local std::vector<std::pair<uint64_t, int>> slot_of;
+        for (const auto& p : slot_of) {
+            if (p.first == id) return p.second;
+        }
+        int s = next_slot.fetch_add(1, std::memory_order_relaxed);
+        int slot = s < Config::DB_POOL_AFFINITY_SLOTS ? s : NO_CONNECTION;
+        slot_of.emplace_back(id, slot);
+        return slot;
+    }
+
+    int indexOf(sql::Connection* con) {
+        for (int i = 0; i < capacity; ++i) {
+            if (entries[i].con.load(std::memory_order_relaxed) == con) return i;
+        }
+        return NO_CONNECTION;
+    }
+
+    // Lock-free acquisition: own slot, shared queue, then other threads' slots
+    int tryAcquire() {
+        int slot = mySlot();
+        if (slot != NO_CONNECTION && slots[slot].idx.load(std::memory_order_relaxed) != NO_CONNECTION) {
+            int idx = slots[slot].idx.exchange(NO_CONNECTION, std::memory_order_acquire);
+            if (idx != NO_CONNECTION) {
+                affinity_hits.fetch_add(1, std::memory_order_relaxed);
+                return idx;
+            }
+        }
+        int idx;
+        if (idle.pop(idx)) return idx;
+        for (int i = 0; i < Config::DB_POOL_AFFINITY_SLOTS; ++i) {
+            if (i == slot || slots[i].idx.load(std::memory_order_relaxed) == NO_CONNECTION) continue;
+            idx = slots[i].idx.exchange(NO_CONNECTION, std::memory_order_acquire);
+            if (idx != NO_CONNECTION) {
+                steals.fetch_add(1, std::memory_order_relaxed);
+                return idx;
+            }
+        }
+        return NO_CONNECTION;
+    }
+
+    void pushIdle(int idx) {
+        entries[idx].idle_since_us.store(nowUs(), std::memory_order_relaxed);
+        enqueue(idx);
+    }
+
+    void enqueue(int idx) {
+        idle.push(idx);  // Capacity >= DB_POOL_MAX_SIZE, never full
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(mtx);
+            cv.notify_one();
+        }
+    }
+
+    sql::Connection* createConnection() {
+        try {
+            sql::ConnectOptionsMap props;
+            props["hostName"] = host;
+            props["userName"] = Config::DB_USER;
+            props["password"] = Config::DB_PASS;
+            props["OPT_CONNECT_TIMEOUT"] = Config::DB_CONNECT_TIMEOUT_SEC;
+            props["OPT_READ_TIMEOUT"] = Config::DB_READ_TIMEOUT_SEC;
+            props["OPT_WRITE_TIMEOUT"] = Config::DB_READ_TIMEOUT_SEC;
+            sql::Connection* con = driver->connect(props);
+            con->setSchema(Config::DB_NAME);
+            return con;
+        } catch (sql::SQLException &e) {
+            fprintf(stderr, "Error connecting to DB %s: %s\n", host.c_str(), e.what());
+            return nullptr;
+        }
+    }
+
+    // Open a connection in a free entry. If `retry` is set, a failed connect keeps the
+    // entry in the pool and leaves it to the reconnect thread.
+    bool openEntry(bool retry) {
+        int idx;
+        {
+            std::lock_guard<std::mutex> lock(free_mtx);
+            if (free_entries.empty()) return false;
+            idx = free_entries.back();
+            free_entries.pop_back();
+        }
+        sql::Connection* con = createConnection();
+        if (con == nullptr) {
+            if (retry) {
+                total++;
+                scheduleReconnect(idx);
+            } else {
+                std::lock_guard<std::mutex> lock(free_mtx);
+                free_entries.push_back(idx);
+            }
+            return false;
+        }
+        entries[idx].con.store(con, std::memory_order_release);
+        total++;
+        pushIdle(idx);
+        return true;
+    }
+
+    void closeEntry(int idx) {
+        sql::Connection* con = entries[idx].con.exchange(nullptr);
+        delete con;
+        total--;
+        shrunk++;
+        std::lock_guard<std::mutex> lock(free_mtx);
+        free_entries.push_back(idx);
+    }
+
+    int maxSize() const {
+        return std::min<int>(Config::DB_POOL_MAX_SIZE, capacity);
+    }
+
+    void grow() {
+        if (total.load() >= maxSize()) return;
+        if (openEntry(false)) grown++;
+    }
+
+    void shrinkIdle() {
+        int64_t cutoff = nowUs() - (int64_t)Config::DB_POOL_IDLE_TIMEOUT_SEC * 1000000;
+        // Above a lowered maximum every idle connection counts as stale
+        auto stale = [&](int idx) {
+            return total.load() > maxSize() || entries[idx].idle_since_us.load(std::memory_order_relaxed) < cutoff;
+        };
+
+        // Idle connections parked in affinity slots
+        for (int i = 0; i < Config::DB_POOL_AFFINITY_SLOTS && total.load() > Config::DB_POOL_MIN_SIZE; ++i) {
+            int idx = slots[i].idx.load(std::memory_order_relaxed);
+            if (idx == NO_CONNECTION || !stale(idx)) continue;
+            if (slots[i].idx.compare_exchange_strong(idx, NO_CONNECTION)) closeEntry(idx);
+        }
+
+        // Idle connections in the shared queue; fresh ones are put back
+        size_t n = idle.size();
+        for (size_t i = 0; i < n; ++i) {
+            int idx;
+            if (!idle.pop(idx)) break;
+            if (total.load() > Config::DB_POOL_MIN_SIZE && stale(idx)) {
+                closeEntry(idx);
+            } else {
+                enqueue(idx);
+            }
+        }
+    }
+
+    void maintenanceLoop() {
+        auto window_start = Clock::now();
+        while (!stopping) {
+            {
+                std::unique_lock<std::mutex> lock(maint_mtx);
+                maint_cv.wait_for(lock, std::chrono::milliseconds(Config::DB_POOL_MAINTENANCE_INTERVAL_MS), [this] { return stopping.load(); });
+            }
+            if (stopping) break;
+
+            auto now = Clock::now();
+            uint64_t window_us = std::chrono::duration_cast<std::chrono::microseconds>(now - window_start).count();
+            window_start = now;
+            window_wait_hist.drainInto(last_window_wait);
+
+            int size = total.load();
+            uint64_t busy_us = window_hold_us.exchange(0);
+            if (size > 0 && window_us > 0) {
+                double util = (double)busy_us / ((double)window_us * size);
+                last_utilization = util > 1.0 ? 1.0 : util;
+            }
+
+            // Parked waiters have not recorded their wait yet, so treat them as over the threshold
+            bool starved = waiters.load() > 0;
+            if (total.load() < Config::DB_POOL_MIN_SIZE && total.load() < maxSize()) {
+                grow();   // The minimum was raised
+            } else if (total.load() > maxSize()) {
+                shrinkIdle();
+            } else if (starved || last_window_wait.percentileUs(99) > (uint64_t)Config::DB_POOL_GROW_WAIT_P99_MS * 1000) {
+                grow();
+            } else {
+                shrinkIdle();
+            }
+        }
+    }
+
+    int reconnectingCount() {
+        std::lock_guard<std::mutex> lock(reconnect_mtx);
+        return (int)reconnect_queue.size();
+    }
+
+    void scheduleReconnect(int idx) {
+        delete entries[idx].con.exchange(nullptr);
+        std::lock_guard<std::mutex> lock(reconnect_mtx);
+        reconnect_queue.push_back(idx);
+        reconnect_cv.notify_one();
+    }
+
+    // Ping a connection; dead ones are handed to the reconnect thread
+    bool validate(int idx) {
+        bool ok = false;
+        try {
+            ok = entries[idx].con.load()->isValid();
+        } catch (sql::SQLException &e) {
+            ok = false;
+        }
+        if (!ok) {
+            invalidated++;
+            scheduleReconnect(idx);
+        }
+        return ok;
+    }
+
+    void reconnectLoop() {
+        while (!stopping) {
+            std::vector<int> pending;
+            {
+                std::unique_lock<std::mutex> lock(reconnect_mtx);
+                reconnect_cv.wait(lock, [this] { return stopping.load() || !reconnect_queue.empty(); });
+                if (stopping) break;
+                pending.swap(reconnect_queue);
+            }
+
+            std::vector<int> failed;
+            for (int idx : pending) {
+                sql::Connection* con = createConnection();
+                if (con == nullptr) {
+                    failed.push_back(idx);
+                    continue;
+                }
+                entries[idx].con.store(con, std::memory_order_release);
+                reconnects++;
+                pushIdle(idx);
+            }
+
+            if (!failed.empty()) {
+                std::unique_lock<std::mutex> lock(reconnect_mtx);
+                reconnect_queue.insert(reconnect_queue.end(), failed.begin(), failed.end());
+                // Back off before hammering an unavailable server again
+                reconnect_cv.wait_for(lock, std::chrono::milliseconds(Config::DB_RECONNECT_INTERVAL_MS), [this] { return stopping.load(); });
+            }
+        }
+    }
+
 public:
-    DBPool() {
+    explicit DBPool(const std::string& host_in = Config::DB_HOST)
+        : host(host_in),
+          id(nextId()),
+          capacity(Config::DB_POOL_MAX_SIZE),
+          entries(new Entry[capacity]),
+          slots(new AffinitySlot[Config::DB_POOL_AFFINITY_SLOTS]),
+          idle(capacity) {
         driver = sql::mysql::get_mysql_driver_instance();
-        for (int i = 0; i < Config::DB_POOL_SIZE; ++i) {
-            try {
-                sql::Connection* con = driver->connect(Config::DB_HOST, Config::DB_USER, Config::DB_PASS);
-                con->setSchema(Config::DB_NAME);
-                connections.push(con);
-            } catch (sql::SQLException &e) {
-                fprintf(stderr, "Error connecting to DB: %s\n", e.what());
-            }
+        for (int i = capacity - 1; i >= 0; --i) free_entries.push_back(i);
+        for (int i = 0; i < Config::DB_POOL_MIN_SIZE; ++i) {
+            openEntry(true);
         }
+        if (reconnectingCount() > 0) {
+            fprintf(stderr, "DB pool %s: %d of %d connections failed, retrying in background\n", host.c_str(), reconnectingCount(), Config::DB_POOL_MIN_SIZE.load());
+        }
+        maintenance = std::thread(&DBPool::maintenanceLoop, this);
+        reconnector = std::thread(&DBPool::reconnectLoop, this);
     }
 
     ~DBPool() {
-        std::lock_guard<std::mutex> lock(mtx);
-        while (!connections.empty()) {
-            delete connections.front();
-            connections.pop();
+        stopping = true;
+        maint_cv.notify_all();
+        reconnect_cv.notify_all();
+        if (maintenance.joinable()) maintenance.join();
+        if (reconnector.joinable()) reconnector.join();
+
+        for (int i = 0; i < capacity; ++i) {
+            delete entries[i].con.exchange(nullptr);
         }
     }
 
-    sql::Connection* getConnection() {
-        std::unique_lock<std::mutex> lock(mtx);
-        while (connections.empty()) {
-            cv.wait(lock);
+    // Borrow a connection, or nullptr if none became available within timeout_ms
+    sql::Connection* getConnection(int timeout_ms = Config::DB_BORROW_TIMEOUT_MS) {
+        auto start = Clock::now();
+        auto deadline = start + std::chrono::milliseconds(timeout_ms);
+        int idx;
+        for (;;) {
+            idx = tryAcquire();
+            if (idx == NO_CONNECTION) {
+                // Slow path: every connection is busy. Register as a waiter before the
+                // final re-check so a concurrent pushIdle() either sees us or we see it.
+                sleeps.fetch_add(1, std::memory_order_relaxed);
+                std::unique_lock<std::mutex> lock(mtx);
+                waiters.fetch_add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                while ((idx = tryAcquire()) == NO_CONNECTION && Clock::now() < deadline) {
+                    // Bounded wait: a connection parked in an affinity slot does not notify
+                    cv.wait_for(lock, std::chrono::milliseconds(Config::DB_POOL_PARK_RECHECK_MS));
+                }
+                waiters.fetch_sub(1);
+                if (idx == NO_CONNECTION) {
+                    timeouts++;
+                    window_wait_hist.record((uint64_t)timeout_ms * 1000);
+                    return nullptr;
+                }
+            }
+
+            // Connections that sat idle for a while may have been dropped by the server
+            int64_t idle_us = nowUs() - entries[idx].idle_since_us.load(std::memory_order_relaxed);
+            if (idle_us < (int64_t)Config::DB_VALIDATE_IDLE_MS * 1000 || validate(idx)) break;
         }
-        sql::Connection* con = connections.front();
-        connections.pop();
-        return con;
+
+        int64_t now = nowUs();
+        entries[idx].borrowed_at_us.store(now, std::memory_order_relaxed);
+        in_use.fetch_add(1, std::memory_order_relaxed);
+
+        uint64_t wait_us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+        wait_hist.record(wait_us);
+        window_wait_hist.record(wait_us);
+        return entries[idx].con.load(std::memory_order_acquire);
     }
 
-    void releaseConnection(sql::Connection* con) {
-        std::unique_lock<std::mutex> lock(mtx);
-        connections.push(con);
-        cv.notify_one();
+    // Return a borrowed connection. Pass suspect = true after an SQL error so the
+    // connection is validated before it is reused.
+    void releaseConnection(sql::Connection* con, bool suspect = false) {
+        if (con == nullptr) return;
+        int idx = indexOf(con);
+        if (idx == NO_CONNECTION) return;
+
+        int64_t now = nowUs();
+        uint64_t hold_us = (uint64_t)(now - entries[idx].borrowed_at_us.load(std::memory_order_relaxed));
+        hold_hist.record(hold_us);
+        window_hold_us.fetch_add(hold_us, std::memory_order_relaxed);
+        in_use.fetch_sub(1, std::memory_order_relaxed);
+
+        if (suspect && !validate(idx)) return;
+
+        // Keep the connection on this thread unless someone is parked waiting for one
+        int slot = mySlot();
+        if (slot != NO_CONNECTION && waiters.load(std::memory_order_relaxed) == 0) {
+            entries[idx].idle_since_us.store(now, std::memory_order_relaxed);
+            int empty = NO_CONNECTION;
+            if (slots[slot].idx.compare_exchange_strong(empty, idx, std::memory_order_release, std::memory_order_relaxed)) return;
+        }
+        pushIdle(idx);
+    }
+
+    const std::string& endpoint() const { return host; }
+
+    PoolStats stats() {
+        PoolStats s;
+        s.size = total.load();
+        s.in_use = in_use.load();
+        s.reconnecting = reconnectingCount();
+        s.idle = s.size - s.in_use - s.reconnecting;
+        s.min_size = Config::DB_POOL_MIN_SIZE;
+        s.max_size = maxSize();
+        s.borrows = wait_hist.total();
+        s.affinity_hits = affinity_hits;
+        s.steals = steals;
+        s.sleeps = sleeps;
+        s.grown = grown;
+        s.shrunk = shrunk;
+        s.timeouts = timeouts;
+        s.invalidated = invalidated;
+        s.reconnects = reconnects;
+        s.wait_avg_ms = wait_hist.meanUs() / 1000.0;
+        s.wait_p50_ms = wait_hist.percentileUs(50) / 1000.0;
+        s.wait_p99_ms = wait_hist.percentileUs(99) / 1000.0;
+        s.window_wait_p99_ms = last_window_wait.percentileUs(99) / 1000.0;
+        s.hold_avg_ms = hold_hist.meanUs() / 1000.0;
+        s.hold_p99_ms = hold_hist.percentileUs(99) / 1000.0;
+        s.utilization = last_utilization;
+        return s;
     }
 };
 
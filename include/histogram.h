@@ -0,0 +1,81 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Lock-free latency histogram with power-of-two microsecond buckets.
+// Bucket i counts samples in [2^(i-1), 2^i) us; bucket 0 counts sub-microsecond samples.
+class LatencyHistogram {
+public:
+    static const int NUM_BUCKETS = 40;
+
+    void record(uint64_t us) {
+        buckets[bucketFor(us)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum_us.fetch_add(us, std::memory_order_relaxed);
+    }
+
+    uint64_t total() const { return count.load(std::memory_order_relaxed); }
+    uint64_t sumUs() const { return sum_us.load(std::memory_order_relaxed); }
+
+    double meanUs() const {
+        uint64_t c = total();
+        return c > 0 ? (double)sumUs() / c : 0.0;
+    }
+
+    // Upper bound (in us) of the bucket holding the p-th percentile (p in [0, 100])
+    uint64_t percentileUs(double p) const {
+        std::vector<uint64_t> snap(NUM_BUCKETS);
+        uint64_t c = 0;
+        for (int i = 0; i < NUM_BUCKETS; ++i) {
+            snap[i] = buckets[i].load(std::memory_order_relaxed);
+            c += snap[i];
+        }
+        return percentileOf(snap, c, p);
+    }
+
+    // Copy the counts into `into` and zero this histogram (used for sliding windows)
+    void drainInto(LatencyHistogram& into) {
+        for (int i = 0; i < NUM_BUCKETS; ++i) {
+            into.buckets[i].store(buckets[i].exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        into.count.store(count.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+        into.sum_us.store(sum_us.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    void reset() {
+        for (int i = 0; i < NUM_BUCKETS; ++i) buckets[i].store(0, std::memory_order_relaxed);
+        count.store(0, std::memory_order_relaxed);
+        sum_us.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> buckets[NUM_BUCKETS] = {};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum_us{0};
+
+    static int bucketFor(uint64_t us) {
+        int b = 0;
+        while (us > 0 && b < NUM_BUCKETS - 1) {
+            us >>= 1;
+            b++;
+        }
+        return b;
+    }
+
+    static uint64_t percentileOf(const std::vector<uint64_t>& snap, uint64_t c, double p) {
+        if (c == 0) return 0;
+        uint64_t rank = (uint64_t)(p / 100.0 * c);
+        if (rank >= c) rank = c - 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < NUM_BUCKETS; ++i) {
+            seen += snap[i];
+            if (seen > rank) return i == 0 ? 0 : (1ULL << i) - 1;
+        }
+        return (1ULL << (NUM_BUCKETS - 1));
+    }
+};
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,312 @@
+#ifndef INVALIDATION_H
+#define INVALIDATION_H
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include "constants.h"
+#include "cache.h"
+
+// Hybrid logical clock: microseconds since the epoch, never going backwards and
+// always ahead of every version received from other instances.
+class VersionClock {
+private:
+    std::atomic<uint64_t> last{0};
+
+public:
+    uint64_t now() {
+        uint64_t wall = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        uint64_t prev = last.load();
+        uint64_t next;
+        do {
+            next = wall > prev ? wall : prev + 1;
+        } while (!last.compare_exchange_weak(prev, next));
+        return next;
+    }
+
+    void observe(uint64_t v) {
+        uint64_t prev = last.load();
+        while (v > prev && !last.compare_exchange_weak(prev, v)) {}
+    }
+};
+
+// Snapshot of bus counters (see /stats)
+struct BusStats {
+    bool enabled = false;
+    uint64_t packets_sent = 0;
+    uint64_t keys_sent = 0;
+    uint64_t packets_received = 0;
+    uint64_t keys_received = 0;
+    uint64_t invalidated = 0;       // Received keys that removed an older cached entry
+    uint64_t stale_fills = 0;       // DB reads not cached because a newer write was seen meanwhile
+};
+
+// Cross-instance cache invalidation over UDP multicast. Each local write
+// publishes (key, version); a sender thread batches queued keys into datagrams
+// of at most INVALIDATION_MAX_PACKET bytes every INVALIDATION_FLUSH_US. Other
+// instances drop their cached entry if it is older than the received version
+// and remember the version for a short while, so a DB read that started before
+// the write cannot put the stale value back (see shouldCacheFill()).
+//
+// Datagram layout: "KVIN" | sender id (8) | count (2) | count x [version (8) | key length (2) | key]
+class InvalidationBus {
+private:
+    struct Pending {
+        std::string key;
+        uint64_t version;
+    };
+
+    ShardedLRUCache* cache;
+    VersionClock* clock;
+    uint64_t node_id;
+    int send_fd = -1;
+    int recv_fd = -1;
+    sockaddr_in group_addr;
+
+    std::vector<Pending> queue;                     // Protected by mtx
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    // Recently received invalidations: key -> version, expired in FIFO order
+    std::unordered_map<std::string, uint64_t> recent;
+    std::deque<std::pair<std::string, std::pair<uint64_t, uint64_t>>> recent_order;   // (key, (version, received at us))
+    std::mutex recent_mtx;
+
+    std::atomic<bool> stopping{false};
+    std::thread sender;
+    std::thread receiver;
+
+    std::atomic<uint64_t> packets_sent{0};
+    std::atomic<uint64_t> keys_sent{0};
+    std::atomic<uint64_t> packets_received{0};
+    std::atomic<uint64_t> keys_received{0};
+    std::atomic<uint64_t> invalidated{0};
+    std::atomic<uint64_t> stale_fills{0};
+
+    static const size_t HEADER_SIZE = 4 + 8 + 2;
+
+    static uint64_t steadyUs() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void put64(std::string& out, uint64_t v) {
+        for (int i = 0; i < 8; ++i) out.push_back((char)((v >> (8 * i)) & 0xFF));
+    }
+
+    static void put16(std::string& out, uint16_t v) {
+        out.push_back((char)(v & 0xFF));
+        out.push_back((char)(v >> 8));
+    }
+
+    static uint64_t get64(const unsigned char* p) {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i) v |= (uint64_t)p[i] << (8 * i);
+        return v;
+    }
+
+    static uint16_t get16(const unsigned char* p) {
+        return (uint16_t)(p[0] | (p[1] << 8));
+    }
+
+    bool openSockets() {
+        std::memset(&group_addr, 0, sizeof(group_addr));
+        group_addr.sin_family = AF_INET;
+        group_addr.sin_port = htons(Config::INVALIDATION_PORT);
+        group_addr.sin_addr.s_addr = inet_addr(Config::INVALIDATION_GROUP.c_str());
+
+        send_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        recv_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (send_fd < 0 || recv_fd < 0) return false;
+
+        unsigned char ttl = (unsigned char)Config::INVALIDATION_TTL;
+        unsigned char loop = 1;  // Instances on the same host must see each other
+        setsockopt(send_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        setsockopt(send_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+
+        int reuse = 1;
+        setsockopt(recv_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#ifdef SO_REUSEPORT
+        setsockopt(recv_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+#endif
+        sockaddr_in bind_addr;
+        std::memset(&bind_addr, 0, sizeof(bind_addr));
+        bind_addr.sin_family = AF_INET;
+        bind_addr.sin_port = htons(Config::INVALIDATION_PORT);
+        bind_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(recv_fd, (sockaddr*)&bind_addr, sizeof(bind_addr)) < 0) return false;
+
+        ip_mreq mreq;
+        mreq.imr_multiaddr.s_addr = group_addr.sin_addr.s_addr;
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (setsockopt(recv_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) return false;
+
+        // Wake up periodically to notice shutdown
+        timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = 200000;
+        setsockopt(recv_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        return true;
+    }
+
+    void sendPacket(const std::string& packet, uint16_t count) {
+        std::string out = packet;
+        out[HEADER_SIZE - 2] = (char)(count & 0xFF);
+        out[HEADER_SIZE - 1] = (char)(count >> 8);
+        if (sendto(send_fd, out.data(), out.size(), 0, (sockaddr*)&group_addr, sizeof(group_addr)) >= 0) {
+            packets_sent++;
+            keys_sent += count;
+        }
+    }
+
+    void senderLoop() {
+        std::string header = "KVIN";
+        put64(header, node_id);
+        put16(header, 0);
+
+        while (!stopping) {
+            std::vector<Pending> batch;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [this] { return stopping.load() || !queue.empty(); });
+                if (stopping) break;
+                // Give concurrent writes a moment to join this batch
+                cv.wait_for(lock, std::chrono::microseconds(Config::INVALIDATION_FLUSH_US), [this] { return stopping.load(); });
+                batch.swap(queue);
+            }
+
+            std::string packet = header;
+            uint16_t count = 0;
+            for (const auto& p : batch) {
+                size_t entry_size = 8 + 2 + p.key.size();
+                if (count > 0 && packet.size() + entry_size > (size_t)Config::INVALIDATION_MAX_PACKET) {
+                    sendPacket(packet, count);
+                    packet = header;
+                    count = 0;
+                }
+                put64(packet, p.version);
+                put16(packet, (uint16_t)p.key.size());
+                packet += p.key;
+                count++;
+            }
+            if (count > 0) sendPacket(packet, count);
+        }
+    }
+
+    void remember(const std::string& key, uint64_t version) {
+        std::lock_guard<std::mutex> lock(recent_mtx);
+        uint64_t& v = recent[key];
+        if (version > v) v = version;
+        uint64_t now = steadyUs();
+        recent_order.push_back({key, {version, now}});
+        uint64_t horizon = (uint64_t)Config::INVALIDATION_REMEMBER_MS * 1000;
+        while (!recent_order.empty() && now - recent_order.front().second.second > horizon) {
+            // A later invalidation of the same key keeps the entry alive
+            auto it = recent.find(recent_order.front().first);
+            if (it != recent.end() && it->second == recent_order.front().second.first) recent.erase(it);
+            recent_order.pop_front();
+        }
+    }
+
+    void receiverLoop() {
+        std::vector<unsigned char> buf(65536);
+        while (!stopping) {
+            ssize_t n = recv(recv_fd, buf.data(), buf.size(), 0);
+            if (n < (ssize_t)HEADER_SIZE || std::memcmp(buf.data(), "KVIN", 4) != 0) continue;
+            if (get64(buf.data() + 4) == node_id) continue;  // Our own datagram looped back
+            packets_received++;
+
+            uint16_t count = get16(buf.data() + 12);
+            size_t pos = HEADER_SIZE;
+            for (uint16_t i = 0; i < count; ++i) {
+                if (pos + 10 > (size_t)n) break;
+                uint64_t version = get64(buf.data() + pos);
+                uint16_t klen = get16(buf.data() + pos + 8);
+                pos += 10;
+                if (pos + klen > (size_t)n) break;
+                std::string key((const char*)buf.data() + pos, klen);
+                pos += klen;
+
+                keys_received++;
+                clock->observe(version);
+                remember(key, version);
+                if (cache->invalidate(key, version)) invalidated++;
+            }
+        }
+    }
+
+public:
+    InvalidationBus(ShardedLRUCache* cache_in, VersionClock* clock_in) : cache(cache_in), clock(clock_in) {
+        std::random_device rd;
+        node_id = ((uint64_t)rd() << 32) | rd();
+        if (!Config::INVALIDATION_ENABLED) return;
+        if (!openSockets()) {
+            std::cerr << "Invalidation bus disabled: cannot join " << Config::INVALIDATION_GROUP << ":" << Config::INVALIDATION_PORT
+                      << " (" << strerror(errno) << ")" << std::endl;
+            return;
+        }
+        sender = std::thread(&InvalidationBus::senderLoop, this);
+        receiver = std::thread(&InvalidationBus::receiverLoop, this);
+    }
+
+    ~InvalidationBus() {
+        stopping = true;
+        cv.notify_all();
+        if (sender.joinable()) sender.join();
+        if (receiver.joinable()) receiver.join();
+        if (send_fd >= 0) close(send_fd);
+        if (recv_fd >= 0) close(recv_fd);
+    }
+
+    bool enabled() const { return sender.joinable(); }
+
+    // Announce a local write of `key` at `version`
+    void publish(const std::string& key, uint64_t version) {
+        if (!enabled() || key.size() > 0xFFFF) return;
+        std::lock_guard<std::mutex> lock(mtx);
+        queue.push_back({key, version});
+        cv.notify_one();
+    }
+
+    // Whether a value read from the DB at `read_version` may be cached. False if
+    // another instance wrote the key after the read started.
+    bool shouldCacheFill(const std::string& key, uint64_t read_version) {
+        if (!enabled()) return true;
+        std::lock_guard<std::mutex> lock(recent_mtx);
+        auto it = recent.find(key);
+        if (it != recent.end() && it->second >= read_version) {
+            stale_fills++;
+            return false;
+        }
+        return true;
+    }
+
+    BusStats stats() {
+        BusStats s;
+        s.enabled = enabled();
+        s.packets_sent = packets_sent;
+        s.keys_sent = keys_sent;
+        s.packets_received = packets_received;
+        s.keys_received = keys_received;
+        s.invalidated = invalidated;
+        s.stale_fills = stale_fills;
+        return s;
+    }
+};
+
+#endif // INVALIDATION_H
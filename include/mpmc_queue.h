@@ -0,0 +1,95 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+// Bounded lock-free multi-producer/multi-consumer queue (Vyukov's sequence-number ring).
+// Capacity is rounded up to a power of two. push() fails when full, pop() when empty.
+template <typename T>
+class MPMCQueue {
+private:
+    struct alignas(64) Cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    std::vector<Cell> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0};   // Next position to pop
+    alignas(64) std::atomic<size_t> tail{0};   // Next position to push
+
+    static size_t roundUp(size_t n) {
+        size_t cap = 2;
+        while (cap < n) cap <<= 1;
+        return cap;
+    }
+
+public:
+    explicit MPMCQueue(size_t capacity) : cells(roundUp(capacity)), mask(roundUp(capacity) - 1) {
+        for (size_t i = 0; i < cells.size(); ++i) cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    MPMCQueue(const MPMCQueue&) = delete;
+    MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+    bool push(const T& v) {
+        T copy(v);
+        return push(std::move(copy));
+    }
+
+    // Moves v into the queue; on failure v is left untouched
+    bool push(T&& v) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& c = cells[pos & mask];
+            size_t seq = c.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    c.value = std::move(v);
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Full
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(T& out) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& c = cells[pos & mask];
+            size_t seq = c.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    out = std::move(c.value);
+                    c.seq.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Empty
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Approximate number of queued elements
+    size_t size() const {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_relaxed);
+        return t > h ? t - h : 0;
+    }
+
+    size_t capacity() const { return cells.size(); }
+};
+
+#endif // MPMC_QUEUE_H
@@ -0,0 +1,172 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+
+// CPU and NUMA placement. The topology is read from sysfs, so no libnuma is
+// needed. Memory is placed with the kernel's default first-touch policy: a
+// thread that allocates while pinned to a node's CPUs gets pages from that node.
+namespace placement {
+
+// "0-3,8,10-11" -> {0,1,2,3,8,10,11}. Empty or malformed input gives an empty list.
+inline std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || range.find_first_not_of(" \n") == std::string::npos) continue;
+        size_t dash = range.find('-');
+        char* end = nullptr;
+        int lo = (int)strtol(range.c_str(), &end, 10);
+        int hi = dash == std::string::npos ? lo : (int)strtol(range.c_str() + dash + 1, nullptr, 10);
+        if (end == range.c_str() || lo < 0 || hi < lo) return {};
+        for (int c = lo; c <= hi; ++c) cpus.push_back(c);
+    }
+    return cpus;
+}
+
+inline std::string formatCpuList(const std::vector<int>& cpus) {
+    std::string out;
+    for (size_t i = 0; i < cpus.size();) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+        if (!out.empty()) out += ",";
+        out += std::to_string(cpus[i]);
+        if (j > i) out += "-" + std::to_string(cpus[j]);
+        i = j + 1;
+    }
+    return out.empty() ? "-" : out;
+}
+
+struct Topology {
+    std::vector<std::vector<int>> node_cpus;   // CPUs of each NUMA node
+    std::map<int, int> cpu_node;               // CPU -> node
+
+    // Node of a CPU; 0 when unknown
+    int nodeOf(int cpu) const {
+        auto it = cpu_node.find(cpu);
+        return it == cpu_node.end() ? 0 : it->second;
+    }
+
+    int numNodes() const { return (int)node_cpus.size(); }
+
+    static Topology detect() {
+        Topology t;
+        DIR* dir = opendir("/sys/devices/system/node");
+        std::map<int, std::vector<int>> nodes;
+        if (dir != nullptr) {
+            while (dirent* entry = readdir(dir)) {
+                std::string name = entry->d_name;
+                if (name.compare(0, 4, "node") != 0 || name.size() == 4 || name.find_first_not_of("0123456789", 4) != std::string::npos) continue;
+                std::ifstream f("/sys/devices/system/node/" + name + "/cpulist");
+                std::string list;
+                std::getline(f, list);
+                nodes[atoi(name.c_str() + 4)] = parseCpuList(list);
+            }
+            closedir(dir);
+        }
+        if (nodes.empty()) {
+            // No NUMA information (non-NUMA kernel or container): one node with every online CPU
+            long n = sysconf(_SC_NPROCESSORS_ONLN);
+            for (int c = 0; c < n; ++c) nodes[0].push_back(c);
+        }
+        // Node ids may have gaps; index nodes by id so nodeOf() matches sysfs
+        t.node_cpus.resize(nodes.rbegin()->first + 1);
+        for (const auto& n : nodes) {
+            t.node_cpus[n.first] = n.second;
+            for (int c : n.second) t.cpu_node[c] = n.first;
+        }
+        return t;
+    }
+};
+
+inline cpu_set_t toSet(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus) {
+        if (c < CPU_SETSIZE) CPU_SET(c, &set);
+    }
+    return set;
+}
+
+// Restrict the calling thread to `cpus`. An empty list leaves it unchanged.
+inline bool pinThread(const std::vector<int>& cpus) {
+    if (cpus.empty()) return true;
+    cpu_set_t set = toSet(cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// Restrict every thread of the process except the caller to `cpus`. Used once at
+// startup to move the background threads the services have already started.
+inline int pinOtherThreads(const std::vector<int>& cpus) {
+    if (cpus.empty()) return 0;
+    cpu_set_t set = toSet(cpus);
+    pid_t self = (pid_t)syscall(SYS_gettid);
+    int pinned = 0;
+    DIR* dir = opendir("/proc/self/task");
+    if (dir == nullptr) return 0;
+    while (dirent* entry = readdir(dir)) {
+        pid_t tid = (pid_t)atoi(entry->d_name);
+        if (tid <= 0 || tid == self) continue;
+        if (sched_setaffinity(tid, sizeof(set), &set) == 0) pinned++;
+    }
+    closedir(dir);
+    return pinned;
+}
+
+// Runs the calling thread on one node's CPUs for the lifetime of the scope, so
+// memory first touched inside it is allocated on that node
+class ScopedNodeAffinity {
+private:
+    cpu_set_t saved;
+    bool changed = false;
+
+public:
+    ScopedNodeAffinity(const Topology& topo, int node) {
+        if (node < 0 || node >= topo.numNodes() || topo.node_cpus[node].empty()) return;
+        if (pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) != 0) return;
+        changed = pinThread(topo.node_cpus[node]);
+        if (changed) sched_yield();   // Let the scheduler migrate us before anything is allocated
+    }
+
+    ~ScopedNodeAffinity() {
+        if (changed) pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+    }
+
+    ScopedNodeAffinity(const ScopedNodeAffinity&) = delete;
+    ScopedNodeAffinity& operator=(const ScopedNodeAffinity&) = delete;
+};
+
+// Home node for each of `shards` cache shards. Keys are hashed over shards, so
+// every worker uses every shard equally; the shards are spread over the nodes
+// the workers run on in proportion to the workers on each node. Without worker
+// pinning every node counts once.
+inline std::vector<int> shardNodes(const Topology& topo, const std::vector<int>& worker_cpus, int shards) {
+    std::vector<int> weighted;
+    for (int c : worker_cpus) weighted.push_back(topo.nodeOf(c));
+    std::sort(weighted.begin(), weighted.end());
+    if (weighted.empty()) {
+        for (int n = 0; n < topo.numNodes(); ++n) {
+            if (!topo.node_cpus[n].empty()) weighted.push_back(n);
+        }
+    }
+    std::vector<int> nodes(shards, 0);
+    for (int i = 0; i < shards && !weighted.empty(); ++i) nodes[i] = weighted[i * weighted.size() / shards];
+    return nodes;
+}
+
+} // namespace placement
+
+#endif // PLACEMENT_H
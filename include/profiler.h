@@ -0,0 +1,205 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <execinfo.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include "constants.h"
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+// In-process sampling CPU profiler. Every thread of the process gets its own
+// timer_create() timer on its CPU-time clock that sends SIGPROF to that thread,
+// so each busy worker is sampled at the full rate (a process-wide ITIMER_PROF
+// delivers at most one signal per kernel tick for all threads together).
+// Threads started during a run are not sampled. The signal handler only calls
+// backtrace() and claims a slot in a preallocated buffer with one atomic
+// increment; symbolization happens after the run.
+class SamplingProfiler {
+public:
+    static const int MAX_DEPTH = 64;
+
+private:
+    struct Sample {
+        int depth;
+        void* pcs[MAX_DEPTH];
+    };
+
+    // Handler state is static: signal handlers cannot carry a context pointer
+    static Sample* samples() {
+        // calloc: zeroed pages are only committed once samples land in them
+        static Sample* buf = static_cast<Sample*>(calloc(Config::PROFILE_MAX_SAMPLES, sizeof(Sample)));
+        return buf;
+    }
+    static std::atomic<size_t>& next() {
+        static std::atomic<size_t> n{0};
+        return n;
+    }
+    static std::atomic<size_t>& dropped() {
+        static std::atomic<size_t> n{0};
+        return n;
+    }
+
+    std::atomic<bool> running{false};
+
+    static void onSignal(int, siginfo_t*, void*) {
+        int saved_errno = errno;
+        size_t idx = next().fetch_add(1, std::memory_order_relaxed);
+        if (idx < (size_t)Config::PROFILE_MAX_SAMPLES) {
+            Sample& s = samples()[idx];
+            s.depth = backtrace(s.pcs, MAX_DEPTH);
+        } else {
+            dropped().fetch_add(1, std::memory_order_relaxed);
+        }
+        errno = saved_errno;
+    }
+
+    static std::string symbolize(void* pc) {
+        Dl_info info;
+        if (dladdr(pc, &info) && info.dli_sname) {
+            int status = 0;
+            char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            std::string name = (status == 0 && demangled) ? demangled : info.dli_sname;
+            free(demangled);
+            return name;
+        }
+        // No symbol (static function or stripped binary): module + offset
+        char buf[64];
+        if (dladdr(pc, &info) && info.dli_fname) {
+            const char* base = strrchr(info.dli_fname, '/');
+            snprintf(buf, sizeof(buf), "+0x%lx", (unsigned long)((char*)pc - (char*)info.dli_fbase));
+            return std::string(base ? base + 1 : info.dli_fname) + buf;
+        }
+        snprintf(buf, sizeof(buf), "0x%lx", (unsigned long)pc);
+        return buf;
+    }
+
+    // ';' separates frames in collapsed stacks, and a space separates the count
+    static void sanitize(std::string& frame) {
+        for (auto& c : frame) {
+            if (c == ';') c = ':';
+            else if (c == '\n') c = ' ';
+        }
+    }
+
+    // CPU-time clock of another thread of this process (the kernel's MAKE_THREAD_CPUCLOCK)
+    static clockid_t threadCpuClock(pid_t tid) {
+        return (clockid_t)((~(unsigned int)tid) << 3) | 6;   // CPUCLOCK_SCHED | CPUCLOCK_PERTHREAD_MASK
+    }
+
+    // One SIGPROF timer per thread listed in /proc/self/task
+    static std::vector<timer_t> startTimers(int hz) {
+        std::vector<timer_t> timers;
+        DIR* dir = opendir("/proc/self/task");
+        if (dir == nullptr) return timers;
+        long interval_ns = 1000000000L / hz;
+        while (dirent* entry = readdir(dir)) {
+            pid_t tid = (pid_t)atoi(entry->d_name);
+            if (tid <= 0) continue;
+            sigevent sev;
+            memset(&sev, 0, sizeof(sev));
+            sev.sigev_notify = SIGEV_THREAD_ID;
+            sev.sigev_signo = SIGPROF;
+            sev.sigev_notify_thread_id = tid;
+            timer_t timer;
+            if (timer_create(threadCpuClock(tid), &sev, &timer) != 0) continue;  // Thread already exited
+            itimerspec spec;
+            spec.it_interval.tv_sec = interval_ns / 1000000000L;
+            spec.it_interval.tv_nsec = interval_ns % 1000000000L;
+            spec.it_value = spec.it_interval;
+            timer_settime(timer, 0, &spec, nullptr);
+            timers.push_back(timer);
+        }
+        closedir(dir);
+        return timers;
+    }
+
+public:
+    struct Profile {
+        std::string collapsed;    // "root;...;leaf count" lines (flamegraph.pl / speedscope input)
+        size_t samples = 0;
+        size_t dropped = 0;
+    };
+
+    // Sample for `seconds` at `hz` and return collapsed stacks. Returns false if a
+    // profile is already running.
+    bool run(int seconds, int hz, Profile& out) {
+        bool expected = false;
+        if (!running.compare_exchange_strong(expected, true)) return false;
+
+        // backtrace() loads libgcc on first use, which is not signal-safe: do it here
+        void* warm[1];
+        backtrace(warm, 1);
+        samples();
+        next() = 0;
+        dropped() = 0;
+
+        struct sigaction sa, old_sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = &SamplingProfiler::onSignal;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGPROF, &sa, &old_sa);
+
+        std::vector<timer_t> timers = startTimers(hz);
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        for (timer_t t : timers) timer_delete(t);
+        // A signal may still be in flight on another thread
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        sigaction(SIGPROF, &old_sa, nullptr);
+
+        size_t n = std::min(next().load(), (size_t)Config::PROFILE_MAX_SAMPLES);
+        std::map<void*, std::string> names;
+        std::map<std::string, size_t> stacks;
+        for (size_t i = 0; i < n; ++i) {
+            const Sample& s = samples()[i];
+            // Frames 0-1 are the handler and the signal trampoline; print root first
+            std::string stack;
+            for (int f = s.depth - 1; f >= 2; --f) {
+                auto it = names.find(s.pcs[f]);
+                if (it == names.end()) {
+                    std::string name = symbolize(s.pcs[f]);
+                    sanitize(name);
+                    it = names.emplace(s.pcs[f], name).first;
+                }
+                if (!stack.empty()) stack += ';';
+                stack += it->second;
+            }
+            if (!stack.empty()) stacks[stack]++;
+        }
+        // A slot claimed but never filled must read as empty in the next run
+        for (size_t i = 0; i < n; ++i) samples()[i].depth = 0;
+
+        out.samples = n;
+        out.dropped = dropped();
+        out.collapsed.clear();
+        for (const auto& st : stacks) {
+            out.collapsed += st.first + " " + std::to_string(st.second) + "\n";
+        }
+        running = false;
+        return true;
+    }
+
+    bool isRunning() const { return running; }
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,323 @@
+#ifndef REBALANCE_H
+#define REBALANCE_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <unordered_set>
+#include <iostream>
+#include "constants.h"
+#include "cache.h"
+#include "cluster.h"
+
+// Snapshot of one outgoing handoff (see /cluster/status)
+struct HandoffStats {
+    std::string target;
+    bool done = false;
+    bool given_up = false;
+    uint64_t planned = 0;
+    uint64_t shipped = 0;
+    uint64_t invalidated = 0;
+    uint64_t failed_batches = 0;
+};
+
+// Streams hot cache entries to their new owners after a membership change.
+// One background worker per target ships the matching entries in MRU order,
+// in batches of CLUSTER_MIGRATION_BATCH and at most CLUSTER_MIGRATION_KEYS_PER_SEC.
+// Writes to moved keys that happen here during the handoff are recorded and
+// shipped as drop records before the handoff is reported complete, so the new
+// owner never keeps a stale value. Drops and the completion report are retried
+// until the target acknowledges them, and this node keeps serving the keys
+// until it does. Writes that race with completion are dropped on the new owner
+// directly.
+// A handoff still unacknowledged after CLUSTER_HANDOFF_TIMEOUT_SEC is given up:
+// the target owns the keys and this node drops its copies. A new owner likewise
+// stops waiting for previous owners, drops what they shipped and reads the keys
+// from the database. abandon() does both at once.
+class Rebalancer {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Migration {
+        std::string target;
+        Clock::time_point deadline;
+        std::atomic<bool> abandoned{false};
+        std::mutex mtx;
+        bool done = false;                           // Protected by mtx
+        bool given_up = false;                       // Protected by mtx
+        std::unordered_set<std::string> dirty;       // Keys written during the handoff, protected by mtx
+        std::atomic<uint64_t> planned{0};
+        std::atomic<uint64_t> shipped{0};
+        std::atomic<uint64_t> invalidated{0};
+        std::atomic<uint64_t> failed_batches{0};
+        std::thread worker;
+    };
+
+    Cluster* cluster;
+    ShardedLRUCache* cache;
+    std::mutex change_mtx;                           // Serializes membership changes
+    std::mutex mtx;
+    std::vector<std::shared_ptr<Migration>> migrations;
+    std::atomic<bool> stopping{false};
+    std::atomic<Clock::rep> receive_deadline{0};     // When this node stops waiting for previous owners
+    std::mutex watch_mtx;
+    std::condition_variable watch_cv;
+    std::thread watchdog;
+    std::atomic<uint64_t> imported{0};
+    std::atomic<uint64_t> dropped{0};
+
+    static bool expired(const Migration* m) {
+        return m->abandoned || Clock::now() >= m->deadline;
+    }
+
+    // Send one batch, retrying with back-off while the target is unreachable
+    bool send(Migration* m, const std::string& path, const std::string& body) {
+        for (int attempt = 0; attempt < Config::CLUSTER_MIGRATION_RETRIES && !stopping && !expired(m); ++attempt) {
+            if (cluster->post(m->target, path, body)) return true;
+            m->failed_batches++;
+            std::this_thread::sleep_until(std::min(Clock::now() + std::chrono::milliseconds(100 << attempt), m->deadline));
+        }
+        return false;
+    }
+
+    // Send a record the target must apply, retrying until it acknowledges.
+    // Fails when stopping or once the handoff deadline has passed.
+    bool deliver(Migration* m, const std::string& path, const std::string& body) {
+        while (!stopping && !expired(m)) {
+            if (send(m, path, body)) return true;
+        }
+        return false;
+    }
+
+    // Ship drops for the keys written here since the last call
+    bool dropDirty(Migration* m) {
+        std::vector<HandoffRecord> drops;
+        {
+            std::lock_guard<std::mutex> lock(m->mtx);
+            for (const auto& k : m->dirty) drops.push_back({'D', k, ""});
+            m->dirty.clear();
+        }
+        if (drops.empty()) return true;
+        if (!deliver(m, "/cluster/import", encodeRecords(drops))) return false;
+        m->invalidated += drops.size();
+        return true;
+    }
+
+    void run(Migration* m) {
+        const std::string& target = m->target;
+        auto moved = [this, &target](const std::string& key) { return cluster->owner(key) == target; };
+
+        std::vector<CollectedEntry> entries = cache->collect(moved, Config::CLUSTER_MIGRATION_MAX_KEYS);
+        m->planned = entries.size();
+
+        // Rate limit: each batch takes at least batch / rate seconds
+        auto batch_interval = std::chrono::microseconds((long long)Config::CLUSTER_MIGRATION_BATCH * 1000000 / Config::CLUSTER_MIGRATION_KEYS_PER_SEC);
+        for (size_t i = 0; i < entries.size() && !stopping && !expired(m); i += Config::CLUSTER_MIGRATION_BATCH) {
+            auto start = std::chrono::steady_clock::now();
+            std::vector<HandoffRecord> batch;
+            for (size_t j = i; j < entries.size() && j < i + Config::CLUSTER_MIGRATION_BATCH; ++j) {
+                batch.push_back({'P', entries[j].key, entries[j].value, entries[j].version});
+            }
+            if (send(m, "/cluster/import", encodeRecords(batch))) m->shipped += batch.size();
+            std::this_thread::sleep_until(start + batch_interval);
+        }
+
+        // Drop keys written here during the handoff, until a pass finds none
+        bool acked = true;
+        while (acked && !stopping) {
+            {
+                std::lock_guard<std::mutex> lock(m->mtx);
+                if (m->dirty.empty()) break;
+            }
+            acked = dropDirty(m);
+        }
+
+        // The target serves the keys once it acknowledges; until then they are still served
+        // (and their writes recorded) here. Then flip ownership atomically w.r.t. noteWrite()
+        // and drop what was written in between. Past the deadline ownership flips anyway.
+        acked = acked && deliver(m, "/cluster/handoff_done", cluster->membership());
+        if (stopping) return;
+        {
+            std::lock_guard<std::mutex> lock(m->mtx);
+            m->done = true;
+            m->given_up = !acked;
+            cluster->handoffSent(target);
+        }
+        // noteWrite() drops later writes directly
+        if (acked) acked = dropDirty(m);
+        size_t removed = cache->removeIf(moved);
+        if (acked) {
+            std::cout << "[Rebalance] Handoff to " << target << " complete: shipped " << m->shipped
+                      << " of " << m->planned << " entries, dropped " << removed << " local copies" << std::endl;
+        } else {
+            std::cerr << "[Rebalance] Handoff to " << target << " given up: shipped " << m->shipped
+                      << " of " << m->planned << " entries, dropped " << removed << " local copies" << std::endl;
+        }
+    }
+
+    // Stop waiting for previous owners that have not finished. What they shipped may
+    // miss later drops, so it is discarded and the keys are read from the database.
+    void expireIncoming() {
+        std::set<std::string> stale = cluster->pendingFrom();
+        if (stale.empty()) return;
+        const std::string& self = cluster->self();
+        size_t removed = cache->removeIf([this, &stale, &self](const std::string& key) {
+            return cluster->owner(key) == self && stale.count(cluster->previousOwner(key)) > 0;
+        });
+        cluster->abandonPending(stale);
+        std::string from;
+        for (const auto& n : stale) from += (from.empty() ? "" : ",") + n;
+        std::cerr << "[Rebalance] Stopped waiting for handoffs from " << from << ": dropped " << removed
+                  << " entries they shipped" << std::endl;
+    }
+
+    void watch() {
+        std::unique_lock<std::mutex> lock(watch_mtx);
+        while (!stopping) {
+            watch_cv.wait_for(lock, std::chrono::seconds(1));
+            if (stopping) break;
+            if (Clock::now().time_since_epoch().count() < receive_deadline || !cluster->inTransition()) continue;
+            lock.unlock();
+            expireIncoming();
+            lock.lock();
+        }
+    }
+
+public:
+    Rebalancer(Cluster* cluster_in, ShardedLRUCache* cache_in) : cluster(cluster_in), cache(cache_in) {}
+
+    ~Rebalancer() {
+        stopping = true;
+        {
+            std::lock_guard<std::mutex> lock(watch_mtx);
+            watch_cv.notify_all();
+        }
+        if (watchdog.joinable()) watchdog.join();
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto& m : migrations) {
+            if (m->worker.joinable()) m->worker.join();
+        }
+    }
+
+    // Apply a new membership and start handing moved entries to their new owners.
+    // Returns false if the previous transition has not finished yet.
+    bool changeMembership(const std::vector<std::string>& nodes) {
+        std::lock_guard<std::mutex> change(change_mtx);
+        if (cluster->inTransition()) return false;
+
+        // Finished handoffs may still be dropping late writes; noteWrite() keeps using them meanwhile
+        std::vector<std::shared_ptr<Migration>> previous;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            previous = migrations;
+        }
+        for (auto& m : previous) {
+            if (m->worker.joinable()) m->worker.join();
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        std::vector<std::string> targets;
+        if (!cluster->setMembers(nodes, targets)) return false;
+
+        Clock::time_point deadline = Clock::now() + std::chrono::seconds(Config::CLUSTER_HANDOFF_TIMEOUT_SEC);
+        receive_deadline = deadline.time_since_epoch().count();
+        migrations.clear();
+        for (const auto& t : targets) {
+            std::shared_ptr<Migration> m(new Migration());
+            m->target = t;
+            m->deadline = deadline;
+            migrations.push_back(m);
+        }
+        for (auto& m : migrations) {
+            m->worker = std::thread(&Rebalancer::run, this, m.get());
+        }
+        if (!watchdog.joinable()) watchdog = std::thread(&Rebalancer::watch, this);
+        return true;
+    }
+
+    // Give up every handoff of the transition in progress, in both directions.
+    // Returns false if there is none.
+    bool abandon() {
+        if (!cluster->inTransition()) return false;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (auto& m : migrations) m->abandoned = true;
+        }
+        expireIncoming();
+        cluster->abandonTransition();
+        return true;
+    }
+
+    // Called after a local write or delete of `key`
+    void noteWrite(const std::string& key) {
+        std::string target = cluster->owner(key);
+        if (target == cluster->self()) return;
+
+        std::shared_ptr<Migration> m;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (auto& candidate : migrations) {
+                if (candidate->target == target) m = candidate;
+            }
+        }
+        if (m == nullptr) return;
+        {
+            std::lock_guard<std::mutex> lock(m->mtx);
+            if (!m->done) {
+                m->dirty.insert(key);
+                return;
+            }
+        }
+        // The handoff finished while this write was in flight
+        cluster->post(target, "/cluster/import", encodeRecords({{'D', key, ""}}));
+        m->invalidated++;
+    }
+
+    // Apply a handoff stream received from a previous owner
+    bool importRecords(const std::string& body) {
+        std::vector<HandoffRecord> records;
+        if (!decodeRecords(body, records)) return false;
+        for (const auto& r : records) {
+            if (r.op == 'P') {
+                // A value written here since the handoff started is newer. The row
+                // version keeps the entry a hit.
+                if (cache->putIfAbsent(r.key, r.value, r.version)) imported++;
+            } else if (r.op == 'D') {
+                cache->remove(r.key);
+                dropped++;
+            }
+        }
+        return true;
+    }
+
+    uint64_t importedCount() const { return imported; }
+    uint64_t droppedCount() const { return dropped; }
+
+    std::vector<HandoffStats> stats() {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::vector<HandoffStats> out;
+        for (auto& m : migrations) {
+            HandoffStats s;
+            s.target = m->target;
+            {
+                std::lock_guard<std::mutex> mlock(m->mtx);
+                s.done = m->done;
+                s.given_up = m->given_up;
+            }
+            s.planned = m->planned;
+            s.shipped = m->shipped;
+            s.invalidated = m->invalidated;
+            s.failed_batches = m->failed_batches;
+            out.push_back(s);
+        }
+        return out;
+    }
+};
+
+#endif // REBALANCE_H
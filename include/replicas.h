@@ -0,0 +1,158 @@
+#ifndef REPLICAS_H
+#define REPLICAS_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include "constants.h"
+#include "database.h"
+
+// Snapshot of one read replica (see /stats)
+struct ReplicaStats {
+    std::string host;
+    bool healthy = false;
+    long long lag_sec = -1;        // -1 if unknown or replication is stopped
+    int outstanding = 0;
+    uint64_t reads = 0;
+    PoolStats pool;
+};
+
+// Routes cache-miss reads across read replicas by least outstanding requests.
+// Each replica has its own DBPool. A background thread polls replication lag
+// and excludes replicas that are more than REPLICA_MAX_LAG_SEC behind (or not
+// replicating at all). Without healthy replicas reads go to the primary.
+class ReplicaRouter {
+public:
+    static const int PRIMARY = -1;
+
+private:
+    struct Replica {
+        std::unique_ptr<DBPool> pool;
+        std::atomic<bool> healthy{false};
+        std::atomic<long long> lag_sec{-1};
+        std::atomic<int> outstanding{0};
+        std::atomic<uint64_t> reads{0};
+    };
+
+    DBPool* primary;
+    std::vector<std::unique_ptr<Replica>> replicas;
+    std::atomic<uint64_t> primary_reads{0};
+
+    std::atomic<bool> stopping{false};
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread lag_checker;
+
+    // Seconds behind the source, or -1 if replication is not running
+    static long long queryLag(DBPool* pool) {
+        sql::Connection* con = pool->getConnection();
+        if (con == nullptr) return -1;
+        long long lag = -1;
+        bool failed = false;
+        try {
+            std::unique_ptr<sql::Statement> stmt(con->createStatement());
+            std::unique_ptr<sql::ResultSet> rs;
+            std::string column = "Seconds_Behind_Source";
+            try {
+                rs.reset(stmt->executeQuery("SHOW REPLICA STATUS"));
+            } catch (sql::SQLException &e) {
+                // Servers older than 8.0.22
+                rs.reset(stmt->executeQuery("SHOW SLAVE STATUS"));
+                column = "Seconds_Behind_Master";
+            }
+            if (rs && rs->next() && !rs->isNull(column)) {
+                lag = rs->getInt64(column);
+            }
+        } catch (sql::SQLException &e) {
+            std::cerr << "Replica lag check failed on " << pool->endpoint() << ": " << e.what() << std::endl;
+            failed = true;
+        }
+        pool->releaseConnection(con, failed);
+        return lag;
+    }
+
+    void lagLoop() {
+        while (!stopping) {
+            for (auto& r : replicas) {
+                long long lag = queryLag(r->pool.get());
+                r->lag_sec = lag;
+                r->healthy = lag >= 0 && lag <= Config::REPLICA_MAX_LAG_SEC;
+            }
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait_for(lock, std::chrono::milliseconds(Config::REPLICA_LAG_CHECK_INTERVAL_MS), [this] { return stopping.load(); });
+        }
+    }
+
+public:
+    ReplicaRouter(DBPool* primary_in, const std::vector<std::string>& hosts) : primary(primary_in) {
+        for (const auto& h : hosts) {
+            std::unique_ptr<Replica> r(new Replica());
+            r->pool.reset(new DBPool(h));
+            replicas.push_back(std::move(r));
+        }
+        if (!replicas.empty()) {
+            lag_checker = std::thread(&ReplicaRouter::lagLoop, this);
+        }
+    }
+
+    ~ReplicaRouter() {
+        stopping = true;
+        cv.notify_all();
+        if (lag_checker.joinable()) lag_checker.join();
+    }
+
+    // Pick the healthy replica with the fewest outstanding reads and count the read
+    // as outstanding. Must be paired with done().
+    int pick() {
+        int best = PRIMARY;
+        int best_outstanding = 0;
+        for (size_t i = 0; i < replicas.size(); ++i) {
+            Replica& r = *replicas[i];
+            if (!r.healthy.load(std::memory_order_relaxed)) continue;
+            int o = r.outstanding.load(std::memory_order_relaxed);
+            if (best == PRIMARY || o < best_outstanding) {
+                best = (int)i;
+                best_outstanding = o;
+            }
+        }
+        if (best == PRIMARY) {
+            primary_reads.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            replicas[best]->outstanding.fetch_add(1, std::memory_order_relaxed);
+            replicas[best]->reads.fetch_add(1, std::memory_order_relaxed);
+        }
+        return best;
+    }
+
+    DBPool* pool(int target) {
+        return target == PRIMARY ? primary : replicas[target]->pool.get();
+    }
+
+    void done(int target) {
+        if (target != PRIMARY) replicas[target]->outstanding.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    uint64_t primaryReads() const { return primary_reads.load(std::memory_order_relaxed); }
+
+    std::vector<ReplicaStats> stats() {
+        std::vector<ReplicaStats> out;
+        for (auto& r : replicas) {
+            ReplicaStats s;
+            s.host = r->pool->endpoint();
+            s.healthy = r->healthy;
+            s.lag_sec = r->lag_sec;
+            s.outstanding = r->outstanding;
+            s.reads = r->reads;
+            s.pool = r->pool->stats();
+            out.push_back(s);
+        }
+        return out;
+    }
+};
+
+#endif // REPLICAS_H
@@ -0,0 +1,305 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include "httplib.h"
+#include "constants.h"
+#include "cache.h"
+
+// One write shipped from the leader. op is 'P' (put), 'D' (delete) or 'H' (heartbeat).
+struct LogEntry {
+    uint64_t seq;
+    char op;
+    std::string key;
+    std::string value;
+    uint64_t version = 0;         // Row version of a put
+};
+
+// Stream encoding: "<seq> <op> <klen> <vlen> <version>\n<key><value>"
+inline void encodeLogEntry(const LogEntry& e, std::string& out) {
+    out += std::to_string(e.seq) + " " + e.op + " " + std::to_string(e.key.size()) + " " + std::to_string(e.value.size()) +
+           " " + std::to_string(e.version) + "\n";
+    out += e.key;
+    out += e.value;
+}
+
+// Parse complete entries from the front of `buf`, leaving any partial entry in place.
+// Returns false on malformed input.
+inline bool decodeLogEntries(std::string& buf, std::vector<LogEntry>& out) {
+    size_t pos = 0;
+    while (pos < buf.size()) {
+        size_t nl = buf.find('\n', pos);
+        if (nl == std::string::npos) break;
+        unsigned long long seq = 0, version = 0;
+        size_t klen = 0, vlen = 0;
+        char op = 0;
+        std::string header = buf.substr(pos, nl - pos);
+        if (sscanf(header.c_str(), "%llu %c %zu %zu %llu", &seq, &op, &klen, &vlen, &version) != 5) return false;
+        if (buf.size() - (nl + 1) < klen + vlen) break;
+        LogEntry e;
+        e.seq = seq;
+        e.op = op;
+        e.key = buf.substr(nl + 1, klen);
+        e.value = buf.substr(nl + 1 + klen, vlen);
+        e.version = version;
+        out.push_back(std::move(e));
+        pos = nl + 1 + klen + vlen;
+    }
+    buf.erase(0, pos);
+    return true;
+}
+
+// Bounded, sequenced in-memory log of cache writes on the leader
+class ReplicationLog {
+private:
+    std::deque<LogEntry> entries;
+    uint64_t head = 0;            // Sequence number of the last appended entry
+    std::mutex mtx;
+    std::condition_variable cv;
+
+public:
+    void append(char op, const std::string& key, const std::string& value, uint64_t version) {
+        std::lock_guard<std::mutex> lock(mtx);
+        entries.push_back({++head, op, key, value, version});
+        if (entries.size() > (size_t)Config::REPL_LOG_CAPACITY) entries.pop_front();
+        cv.notify_all();
+    }
+
+    // Restart numbering after a promotion so followers of the old leader can continue
+    void resetHead(uint64_t seq) {
+        std::lock_guard<std::mutex> lock(mtx);
+        entries.clear();
+        head = seq;
+    }
+
+    uint64_t headSeq() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return head;
+    }
+
+    // Whether entries after `from` are still retained
+    bool covers(uint64_t from) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (from > head) return false;
+        uint64_t oldest = entries.empty() ? head + 1 : entries.front().seq;
+        return from + 1 >= oldest;
+    }
+
+    // Wait up to `timeout` for entries after `from` and copy up to `max` of them.
+    // Returns false if `from` has fallen out of the log.
+    bool readAfter(uint64_t from, size_t max, std::chrono::milliseconds timeout, std::vector<LogEntry>& out) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait_for(lock, timeout, [&] { return head > from; });
+        uint64_t oldest = entries.empty() ? head + 1 : entries.front().seq;
+        if (from + 1 < oldest && from < head) return false;
+        for (const auto& e : entries) {
+            if (e.seq <= from) continue;
+            if (out.size() >= max) break;
+            out.push_back(e);
+        }
+        return true;
+    }
+};
+
+// Leader/follower replication of cache writes between kv_server processes.
+// The leader appends every successful create/update/delete to a ReplicationLog
+// and streams it to each follower over one long-lived chunked response
+// (GET /repl/stream?from=N). Followers apply the stream to their own cache, so
+// they serve warm reads and can be promoted without a cold start. MySQL stays
+// the source of truth; followers forward writes to the leader.
+class Replicator {
+public:
+    enum Role { STANDALONE, LEADER, FOLLOWER };
+
+private:
+    ShardedLRUCache* cache;
+    ReplicationLog log;
+    std::atomic<int> role;
+    std::string leader_id;                 // Protected by mtx
+    std::mutex mtx;
+    std::atomic<uint64_t> applied{0};      // Last sequence applied (follower)
+    std::atomic<uint64_t> leader_head{0};  // Leader head seen in the last heartbeat (follower)
+    std::atomic<uint64_t> resyncs{0};
+    std::atomic<int> followers{0};         // Connected followers (leader)
+    std::atomic<uint64_t> refused{0};      // Streams refused at the follower limit (leader)
+
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> generation{0};   // Bumped on every role change to stop the old follower loop
+    std::thread follower;
+
+    void apply(const LogEntry& e) {
+        if (e.op == 'P') cache->put(e.key, e.value, e.version);
+        else if (e.op == 'D') cache->remove(e.key);
+        if (e.op == 'H') {
+            leader_head = e.seq;
+            return;
+        }
+        applied = e.seq;
+        if (e.seq > leader_head) leader_head = e.seq;
+    }
+
+    void followLoop(uint64_t gen, std::string leader) {
+        std::string host;
+        int port = Config::SERVER_PORT;
+        size_t colon = leader.rfind(':');
+        host = leader.substr(0, colon);
+        if (colon != std::string::npos) port = std::stoi(leader.substr(colon + 1));
+
+        while (!stopping && generation == gen) {
+            httplib::Client cli(host, port);
+            cli.set_connection_timeout(0, Config::CLUSTER_CONNECT_TIMEOUT_MS * 1000);
+            cli.set_read_timeout(std::chrono::milliseconds((long long)Config::REPL_HEARTBEAT_MS * 3));
+
+            std::string buf;
+            bool gap = false;
+            std::string path = "/repl/stream?from=" + std::to_string(applied.load());
+            cli.Get(path, httplib::Headers(),
+                [&](const httplib::Response& r) {
+                    if (r.status == 410) {
+                        gap = true;
+                        leader_head = std::stoull(r.get_header_value("X-Repl-Head", "0"));
+                    }
+                    return r.status == 200;
+                },
+                [&](const char* data, size_t len) {
+                    if (stopping || generation != gen) return false;
+                    buf.append(data, len);
+                    std::vector<LogEntry> batch;
+                    if (!decodeLogEntries(buf, batch)) return false;
+                    for (const auto& e : batch) apply(e);
+                    return true;
+                });
+
+            if (gap) {
+                // Fell behind the leader's log: the cache may have missed writes
+                std::cerr << "[Replication] Log gap, clearing cache and resyncing from " << leader_head << std::endl;
+                cache->removeIf([](const std::string&) { return true; });
+                applied = leader_head.load();
+                resyncs++;
+                continue;
+            }
+            // Stream ended (leader restarted, not a leader yet, or network error): back off and reconnect
+            if (!stopping && generation == gen) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(Config::REPL_RECONNECT_MS));
+            }
+        }
+    }
+
+    void startFollowing(const std::string& leader) {
+        uint64_t gen = ++generation;
+        if (follower.joinable()) follower.join();
+        follower = std::thread(&Replicator::followLoop, this, gen, leader);
+    }
+
+public:
+    Replicator(ShardedLRUCache* cache_in, const std::string& role_in, const std::string& leader_in) : cache(cache_in), role(STANDALONE), leader_id(leader_in) {
+        if (role_in == "leader") {
+            role = LEADER;
+        } else if (role_in == "follower" && !leader_in.empty()) {
+            role = FOLLOWER;
+            startFollowing(leader_in);
+        }
+    }
+
+    ~Replicator() {
+        stopping = true;
+        generation++;
+        if (follower.joinable()) follower.join();
+    }
+
+    Role currentRole() const { return (Role)role.load(); }
+    bool isFollower() const { return role == FOLLOWER; }
+
+    std::string leader() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return leader_id;
+    }
+
+    // Leader: record a write that was committed to MySQL and the local cache
+    void append(char op, const std::string& key, const std::string& value = "", uint64_t version = 0) {
+        if (role == LEADER) log.append(op, key, value, version);
+    }
+
+    // Follower -> leader. The log continues from the last applied sequence.
+    void promote() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (role == LEADER) return;
+        generation++;
+        if (follower.joinable()) follower.join();
+        log.resetHead(applied);
+        leader_id.clear();
+        role = LEADER;
+    }
+
+    // Start (or switch) following `leader`
+    void follow(const std::string& leader) {
+        std::lock_guard<std::mutex> lock(mtx);
+        leader_id = leader;
+        role = FOLLOWER;
+        startFollowing(leader);
+    }
+
+    // Serve GET /repl/stream?from=N on the leader
+    void serveStream(const httplib::Request& req, httplib::Response& res) {
+        if (role != LEADER) {
+            res.status = 409;
+            res.set_content("Not the leader", "text/plain");
+            return;
+        }
+        uint64_t from = req.has_param("from") ? std::stoull(req.get_param_value("from")) : 0;
+        if (!log.covers(from)) {
+            res.status = 410;
+            res.set_header("X-Repl-Head", std::to_string(log.headSeq()));
+            return;
+        }
+
+        // A stream holds its worker for as long as the follower stays connected.
+        // At least one worker is always left for requests; extra followers retry later.
+        int limit = std::min(Config::REPL_MAX_FOLLOWERS, Config::SERVER_THREAD_POOL_SIZE - 1);
+        if (followers.fetch_add(1) >= limit) {
+            followers--;
+            refused++;
+            res.status = 503;
+            res.set_header("Retry-After", std::to_string(Config::RETRY_AFTER_SEC.load()));
+            res.set_content("Too many followers", "text/plain");
+            return;
+        }
+        std::shared_ptr<uint64_t> cursor = std::make_shared<uint64_t>(from);
+        res.set_chunked_content_provider("application/octet-stream",
+            [this, cursor](size_t offset, httplib::DataSink& sink) {
+                std::vector<LogEntry> batch;
+                if (stopping || role != LEADER || !log.readAfter(*cursor, Config::REPL_STREAM_BATCH, std::chrono::milliseconds(Config::REPL_HEARTBEAT_MS), batch)) {
+                    return false;  // Follower reconnects and gets 410 if it fell behind
+                }
+                std::string out;
+                if (batch.empty()) {
+                    encodeLogEntry({log.headSeq(), 'H', "", ""}, out);
+                } else {
+                    for (const auto& e : batch) encodeLogEntry(e, out);
+                    *cursor = batch.back().seq;
+                }
+                return sink.write(out.data(), out.size());
+            },
+            [this](bool success) { followers--; });
+    }
+
+    uint64_t headSeq() { return role == LEADER ? log.headSeq() : leader_head.load(); }
+    uint64_t appliedSeq() const { return applied; }
+    uint64_t resyncCount() const { return resyncs; }
+    int followerCount() const { return followers; }
+    uint64_t refusedCount() const { return refused; }
+};
+
+#endif // REPLICATION_H
@@ -0,0 +1,68 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+#include "httplib.h"
+#include "constants.h"
+#include "database.h"
+#include "replicas.h"
+#include "cache.h"
+#include "cluster.h"
+#include "rebalance.h"
+#include "replication.h"
+#include "invalidation.h"
+#include "profiler.h"
+#include "tracing.h"
+#include "admission.h"
+#include "worker_pool.h"
+#include "config.h"
+#include "counters.h"
+#include "bloom.h"
+
+// Global singletons, created by init_services()
+extern DBPool* dbPool;
+extern ReplicaRouter* readRouter;
+extern ShardedLRUCache* cache;
+extern Cluster* cluster;
+extern Rebalancer* rebalancer;
+extern Replicator* replicator;
+extern VersionClock* versionClock;
+extern InvalidationBus* invalidationBus;
+extern SamplingProfiler* profiler;
+extern tracing::Tracer* tracer;
+extern AdmissionController* admission;
+extern CounterFlusher* counters;
+extern KeyFilter* keyFilter;
+extern WorkStealingPool* workerPool;
+extern ConfigLoader config;            // Config file and command-line settings, loaded by main()
+
+struct ServerOptions {
+    std::string self_id = Config::SERVER_ADDRESS + ":" + std::to_string(Config::SERVER_PORT);  // "host:port" in the cluster
+    std::string repl_role = Config::REPL_ROLE;
+    std::string repl_leader = Config::REPL_LEADER;
+    std::string db_host = Config::DB_HOST;
+};
+
+// Create the DB pools, cache and cluster/replication services
+void init_services(const ServerOptions& opts);
+
+// CPU/NUMA topology and where workers, service threads and cache shards were placed
+std::string placement_report();
+
+// Re-read the config file and apply the hot settings; `report` says what changed
+bool reload_config(std::string& report);
+
+// Reload the config on SIGHUP. SIGHUP must be blocked in every thread, i.e.
+// before init_services() starts any, for the watcher thread to receive it.
+void start_reload_watcher();
+
+// Register every HTTP endpoint on `svr`. Shared by kv_server and server_bench.
+void register_routes(httplib::Server& svr);
+
+// Work-stealing worker pool for svr.new_task_queue
+httplib::TaskQueue* new_task_queue();
+
+// Stop background threads and free the services (reverse order of creation)
+void shutdown_services();
+
+#endif // SERVER_H
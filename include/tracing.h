@@ -0,0 +1,219 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <time.h>
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include "constants.h"
+
+// Per-request stage tracing. Each worker thread accumulates the time a request
+// spends in each stage into a thread-local trace. When the response is written,
+// the trace is appended to that thread's ring buffer and summarized in a
+// Server-Timing header. /debug/traces reads the rings without blocking writers.
+namespace tracing {
+
+enum Stage {
+    QUEUE,        // Connection waiting in the server's task queue (first request on a connection)
+    CACHE,        // Cache lookups and updates, including lock waits
+    CACHE_LOCK,   // Part of CACHE spent blocked on a shard mutex
+    DB_WAIT,      // Borrowing a DB connection
+    SQL,          // Executing statements
+    FORWARD,      // Relaying to another cluster node or the replication leader
+    NUM_STAGES
+};
+
+inline const char* stageName(int s) {
+    static const char* names[NUM_STAGES] = {"queue", "cache", "cache_lock", "db_wait", "sql", "forward"};
+    return names[s];
+}
+
+// CLOCK_MONOTONIC_RAW is not slewed by NTP and is read through the vDSO
+inline uint64_t nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// One finished request
+struct Record {
+    uint64_t end_ns = 0;
+    uint64_t total_ns = 0;     // Queueing + handling
+    uint64_t stage_ns[NUM_STAGES] = {};
+    int status = 0;
+    char method[8] = {};
+    char target[64] = {};      // Truncated request target
+};
+
+// Request being handled on this thread
+struct ActiveTrace {
+    bool active = false;
+    uint64_t start_ns = 0;
+    uint64_t stage_ns[NUM_STAGES] = {};
+};
+
+inline ActiveTrace& current() {
+    thread_local ActiveTrace t;
+    return t;
+}
+
+// Queueing delay of the connection this thread just picked up, consumed by its first
+// request. Set by the server's task queue wrapper.
+inline uint64_t& pendingQueueNs() {
+    thread_local uint64_t ns = 0;
+    return ns;
+}
+
+inline void add(Stage s, uint64_t ns) {
+    ActiveTrace& t = current();
+    if (t.active) t.stage_ns[s] += ns;
+}
+
+// Adds the lifetime of the scope to a stage
+class Span {
+private:
+    Stage stage;
+    uint64_t start;
+
+public:
+    explicit Span(Stage s) : stage(s), start(Config::TRACE_ENABLED ? nowNs() : 0) {}
+    ~Span() {
+        if (Config::TRACE_ENABLED) add(stage, nowNs() - start);
+    }
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+};
+
+// Single-writer ring of records. Each slot carries a sequence number (odd while
+// being written) so readers on other threads can detect torn or overwritten
+// slots without taking a lock.
+class TraceRing {
+private:
+    struct Slot {
+        std::atomic<uint64_t> seq{0};
+        Record rec;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t capacity;
+    std::atomic<uint64_t> head{0};     // Records written so far
+
+public:
+    explicit TraceRing(size_t cap) : slots(new Slot[cap]), capacity(cap) {}
+
+    void push(const Record& r) {
+        uint64_t i = head.load(std::memory_order_relaxed);
+        Slot& s = slots[i % capacity];
+        s.seq.store(2 * i + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.rec = r;
+        s.seq.store(2 * i + 2, std::memory_order_release);
+        head.store(i + 1, std::memory_order_release);
+    }
+
+    // Copy records written after `cursor` and advance it. Records the writer has
+    // already overwritten are counted in `lost`.
+    void readSince(uint64_t& cursor, std::vector<Record>& out, uint64_t& lost) {
+        uint64_t h = head.load(std::memory_order_acquire);
+        if (h > capacity && cursor < h - capacity) {
+            lost += (h - capacity) - cursor;
+            cursor = h - capacity;
+        }
+        for (uint64_t i = cursor; i < h; ++i) {
+            Slot& s = slots[i % capacity];
+            uint64_t before = s.seq.load(std::memory_order_acquire);
+            Record r = s.rec;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t after = s.seq.load(std::memory_order_relaxed);
+            if (before != 2 * i + 2 || after != before) {
+                lost++;
+                continue;
+            }
+            out.push_back(r);
+        }
+        cursor = h;
+    }
+};
+
+class Tracer {
+private:
+    struct ThreadRing {
+        TraceRing ring;
+        uint64_t cursor = 0;       // Read position of /debug/traces, protected by mtx
+        ThreadRing() : ring(Config::TRACE_RING_CAPACITY) {}
+    };
+
+    std::vector<std::unique_ptr<ThreadRing>> rings;   // Never shrinks; worker threads are long-lived
+    std::mutex mtx;
+
+    TraceRing& localRing() {
+        thread_local TraceRing* ring = nullptr;
+        if (ring == nullptr) {
+            std::lock_guard<std::mutex> lock(mtx);
+            rings.emplace_back(new ThreadRing());
+            ring = &rings.back()->ring;
+        }
+        return *ring;
+    }
+
+public:
+    // Start tracing the request about to be routed on this thread
+    void begin() {
+        if (!Config::TRACE_ENABLED) return;
+        ActiveTrace& t = current();
+        t.active = true;
+        t.start_ns = nowNs();
+        std::fill(t.stage_ns, t.stage_ns + NUM_STAGES, 0);
+        t.stage_ns[QUEUE] = pendingQueueNs();
+        pendingQueueNs() = 0;
+    }
+
+    // Finish the request, store its record and return the Server-Timing header value
+    std::string finish(const std::string& method, const std::string& target, int status) {
+        ActiveTrace& t = current();
+        if (!t.active) return "";
+        t.active = false;
+
+        Record r;
+        r.end_ns = nowNs();
+        r.total_ns = r.end_ns - t.start_ns + t.stage_ns[QUEUE];
+        std::copy(t.stage_ns, t.stage_ns + NUM_STAGES, r.stage_ns);
+        r.status = status;
+        strncpy(r.method, method.c_str(), sizeof(r.method) - 1);
+        strncpy(r.target, target.c_str(), sizeof(r.target) - 1);
+        localRing().push(r);
+
+        // Durations in milliseconds, as the Server-Timing spec expects
+        std::string header;
+        char buf[64];
+        for (int s = 0; s < NUM_STAGES; ++s) {
+            if (r.stage_ns[s] == 0) continue;
+            snprintf(buf, sizeof(buf), "%s;dur=%.3f, ", stageName(s), r.stage_ns[s] / 1e6);
+            header += buf;
+        }
+        snprintf(buf, sizeof(buf), "total;dur=%.3f", r.total_ns / 1e6);
+        header += buf;
+        return header;
+    }
+
+    // Records finished since the previous call, across all threads
+    std::vector<Record> collect(uint64_t& lost, size_t& threads) {
+        std::vector<Record> out;
+        std::lock_guard<std::mutex> lock(mtx);
+        lost = 0;
+        threads = rings.size();
+        for (auto& r : rings) r->ring.readSince(r->cursor, out, lost);
+        return out;
+    }
+};
+
+} // namespace tracing
+
+#endif // TRACING_H
@@ -0,0 +1,207 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <sched.h>
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include "httplib.h"
+#include "mpmc_queue.h"
+#include "constants.h"
+#include "placement.h"
+
+struct WorkerPoolStats {
+    int threads = 0;
+    int parked = 0;
+    size_t queued = 0;
+    uint64_t executed = 0;
+    uint64_t stolen = 0;       // Tasks run by a worker other than the one they were queued on
+    uint64_t parks = 0;        // Times a worker went to sleep after spinning
+    uint64_t rejected = 0;     // Enqueues refused because every queue was full
+};
+
+// Replacement for httplib::ThreadPool. Each worker has its own bounded lock-free
+// queue (MPMCQueue); enqueue() spreads tasks over them round-robin, and a worker
+// whose queue is empty steals from the others. An idle worker spins for
+// SERVER_WORKER_SPIN_US before parking on a condition variable, and enqueue()
+// only touches the mutex when some worker is parked.
+//
+// Given a CPU list, worker i is pinned to cpus[i % cpus.size()].
+//
+// Tasks are moved into preallocated queue slots. httplib's per-connection
+// closure fits in std::function's inline storage, so queueing does not allocate.
+class WorkStealingPool : public httplib::TaskQueue {
+public:
+    // Called on the enqueuing thread once a task is queued (possibly after a worker
+    // already started it), and on the worker with the time the task waited
+    typedef void (*EnqueueHook)();
+    typedef void (*StartHook)(uint64_t waited_ns);
+
+private:
+    struct Task {
+        std::function<void()> fn;
+        uint64_t enqueued_ns = 0;
+    };
+
+    struct alignas(64) Worker {
+        MPMCQueue<Task> queue;
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> stolen{0};
+        explicit Worker(size_t capacity) : queue(capacity) {}
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::vector<int> cpus;
+    EnqueueHook on_enqueue;
+    StartHook on_start;
+
+    std::atomic<size_t> next{0};                // Round-robin enqueue position
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> rejected{0};
+    std::atomic<uint64_t> parks{0};
+
+    // Parking: enqueue() checks `sleepers` after publishing a task, a worker
+    // re-checks the queues after announcing itself, so no wake-up is lost
+    std::mutex park_mtx;
+    std::condition_variable park_cv;
+    std::atomic<int> sleepers{0};
+    int wakeups = 0;                            // Pending notifications, protected by park_mtx
+
+    static uint64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Own queue first, then the others starting with the neighbour
+    bool take(size_t self, Task& task) {
+        if (workers[self]->queue.pop(task)) return true;
+        size_t n = workers.size();
+        for (size_t i = 1; i < n; ++i) {
+            if (workers[(self + i) % n]->queue.pop(task)) {
+                workers[self]->stolen.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool anyQueued() const {
+        for (const auto& w : workers) {
+            if (w->queue.size() > 0) return true;
+        }
+        return false;
+    }
+
+    void wakeOne() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_relaxed) == 0) return;
+        {
+            std::lock_guard<std::mutex> lock(park_mtx);
+            wakeups++;
+        }
+        park_cv.notify_one();
+    }
+
+    void park() {
+        std::unique_lock<std::mutex> lock(park_mtx);
+        sleepers.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!anyQueued() && !stopping) {
+            parks.fetch_add(1, std::memory_order_relaxed);
+            park_cv.wait(lock, [this] { return wakeups > 0 || stopping; });
+            if (wakeups > 0) wakeups--;
+        }
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void run(size_t self) {
+        if (!cpus.empty()) placement::pinThread({cpus[self % cpus.size()]});
+        Task task;
+        for (;;) {
+            bool found = take(self, task);
+            if (!found) {
+                // Spin briefly: under load the next connection usually arrives within microseconds
+                uint64_t spin_until = nowNs() + (uint64_t)Config::SERVER_WORKER_SPIN_US * 1000;
+                while (!(found = take(self, task)) && !stopping && nowNs() < spin_until) sched_yield();
+            }
+            if (!found) {
+                if (stopping) break;   // Queues are drained before exiting
+                park();
+                continue;
+            }
+            if (on_start) on_start(nowNs() - task.enqueued_ns);
+            task.fn();
+            task.fn = nullptr;         // Release the connection's state now, not at the next task
+            workers[self]->executed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+public:
+    WorkStealingPool(size_t n, size_t queue_capacity, EnqueueHook enqueue_hook = nullptr, StartHook start_hook = nullptr,
+                     const std::vector<int>& cpus_in = {})
+        : cpus(cpus_in), on_enqueue(enqueue_hook), on_start(start_hook) {
+        if (n == 0) n = 1;
+        for (size_t i = 0; i < n; ++i) workers.emplace_back(new Worker(queue_capacity));
+        for (size_t i = 0; i < n; ++i) threads.emplace_back(&WorkStealingPool::run, this, i);
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    ~WorkStealingPool() override {
+        if (!stopping) shutdown();
+    }
+
+    bool enqueue(std::function<void()> fn) override {
+        Task task;
+        task.fn = std::move(fn);
+        task.enqueued_ns = nowNs();
+
+        size_t n = workers.size();
+        size_t start = next.fetch_add(1, std::memory_order_relaxed);
+        for (size_t i = 0; i < n; ++i) {
+            if (workers[(start + i) % n]->queue.push(std::move(task))) {
+                if (on_enqueue) on_enqueue();
+                wakeOne();
+                return true;
+            }
+        }
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void shutdown() override {
+        {
+            std::lock_guard<std::mutex> lock(park_mtx);
+            stopping = true;
+        }
+        park_cv.notify_all();
+        for (auto& t : threads) {
+            if (t.joinable()) t.join();
+        }
+    }
+
+    WorkerPoolStats stats() const {
+        WorkerPoolStats s;
+        s.threads = (int)workers.size();
+        s.parked = sleepers.load(std::memory_order_relaxed);
+        for (const auto& w : workers) {
+            s.queued += w->queue.size();
+            s.executed += w->executed.load(std::memory_order_relaxed);
+            s.stolen += w->stolen.load(std::memory_order_relaxed);
+        }
+        s.parks = parks.load();
+        s.rejected = rejected.load();
+        return s;
+    }
+};
+
+#endif // WORKER_POOL_H
@@ -8,4 +8,9 @@ FLUSH PRIVILEGES;
 
 USE kv_store_db;
 
-CREATE TABLE key_value (key_name VARCHAR(255) PRIMARY KEY, value TEXT);
\ No newline at end of file
+-- LONGBLOB: values may be larger than TEXT's 64 KB and are measured and sliced in bytes.
+-- version: set on every write (conditional PUTs compare it); rows keep the highest one.
+-- key_name compares byte for byte, like the cache and the key filter; a case-insensitive collation would find rows they miss.
+-- Existing tables: ALTER TABLE key_value MODIFY value LONGBLOB, ADD COLUMN version BIGINT UNSIGNED NOT NULL DEFAULT 1,
+--                  MODIFY key_name VARCHAR(255) CHARACTER SET utf8mb4 COLLATE utf8mb4_bin;
+CREATE TABLE key_value (key_name VARCHAR(255) CHARACTER SET utf8mb4 COLLATE utf8mb4_bin PRIMARY KEY, value LONGBLOB, version BIGINT UNSIGNED NOT NULL DEFAULT 1);
\ No newline at end of file
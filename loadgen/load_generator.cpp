@@ -7,7 +7,9 @@
 #include <random>
 #include <iomanip>
 #include <algorithm>
-#include "httplib.h"
+#include <fstream>
+#include <numeric>
+#include "kv_client.h"
 #include "constants.h"
 
 // --- CONFIGURATION ---
@@ -20,6 +22,7 @@ const int MIXED_PREFILL = 2000;         // Keys per thread for Mixed History
 std::atomic<long> total_requests(0);
 std::atomic<long> successful_requests(0);
 std::atomic<long> failed_requests(0);
+std::atomic<long> shed_requests(0);         // 503 from admission control or an exhausted DB pool
 std::atomic<long long> total_latency_ms(0);
 
 // DETAILED METRICS
@@ -28,21 +31,47 @@ std::atomic<long> cache_misses(0);
 std::atomic<long> disk_writes(0);
 std::atomic<long> disk_misses(0);
 
+// SERVER-TIMING BREAKDOWN (microseconds summed over requests that reported it)
+const char* STAGES[] = {"queue", "cache", "cache_lock", "db_wait", "sql", "forward", "total"};
+const int NUM_STAGES = sizeof(STAGES) / sizeof(STAGES[0]);
+std::atomic<long long> stage_us[NUM_STAGES];
+std::atomic<long long> timed_latency_us(0);   // Client-side latency of the same requests
+std::atomic<long> timed_requests(0);
+
+// Latency of every successful request per thread (microseconds), for percentiles
+std::vector<std::vector<uint32_t>> latencies_us;
+
 bool running = true;
 
 enum WorkloadType { PUT_ALL, GET_ALL_UNIQUE, GET_POPULAR, MIXED };
 
 // --- WARMUP PHASE ---
-void perform_warmup(int id, int total_threads, WorkloadType type, std::string host, int port) {
-    httplib::Client cli(host, port);
-    cli.set_connection_timeout(30);
-    cli.set_read_timeout(30);
-    
+// Keys are loaded in batches through POST /api/bulk, which writes them in large
+// transactions and caches them like individual creates would
+const size_t WARMUP_BATCH = 20000;
+
+void load_batch(kv::Client& cli, const std::vector<std::pair<std::string, std::string>>& items) {
+    kv::Result r = cli.bulkLoad(items, true);
+    // Servers without the bulk endpoint (or a failed load) get the keys one request at a time
+    if (!r.ok()) cli.multiPut(items);
+}
+
+void put_batched(kv::Client& cli, std::vector<std::pair<std::string, std::string>>& items) {
+    if (items.size() >= WARMUP_BATCH) {
+        load_batch(cli, items);
+        items.clear();
+    }
+}
+
+void perform_warmup(int id, int total_threads, WorkloadType type, kv::Client& cli) {
+    std::vector<std::pair<std::string, std::string>> items;
+
     // 1. GET_POPULAR: Keys 1-100
     if (type == GET_POPULAR && id == 0) {
         std::cout << "[Warmup] Inserting " << POPULAR_RANGE << " popular keys...\n";
         for(int i=1; i<=POPULAR_RANGE; ++i) {
-            cli.Post("/api/data", httplib::Params{{"key", std::to_string(i)}, {"val", "x"}});
+            items.push_back({std::to_string(i), "x"});
+            put_batched(cli, items);
         }
     }
     // 2. GET_ALL: Keys 1-100,000
@@ -54,7 +83,8 @@ void perform_warmup(int id, int total_threads, WorkloadType type, std::string ho
         if (id == total_threads - 1) end = LARGE_RANGE + 1;
 
         for(int i=start; i<end; ++i) {
-            cli.Post("/api/data", httplib::Params{{"key", std::to_string(i)}, {"val", "x"}});
+            items.push_back({std::to_string(i), "x"});
+            put_batched(cli, items);
         }
     }
     // 3. MIXED: Thread History
@@ -62,18 +92,16 @@ void perform_warmup(int id, int total_threads, WorkloadType type, std::string ho
         if (id == 0) std::cout << "[Warmup] Pre-filling " << MIXED_PREFILL << " keys per thread...\n";
         for(int i=1; i<=MIXED_PREFILL; ++i) {
             std::string k = std::to_string(id) + "_" + std::to_string(i);
-            cli.Post("/api/data", httplib::Params{{"key", k}, {"val", "x"}});
+            items.push_back({k, "x"});
+            put_batched(cli, items);
         }
     }
+    if (!items.empty()) load_batch(cli, items);
     // PUT_ALL does not need Data Warmup (it writes new data), but the shell script runs it to warm up the connections.
 }
 
 // --- WORKER THREAD ---
-void worker(int id, WorkloadType type, std::string host, int port, int p_get, int p_put) {
-    httplib::Client cli(host, port);
-    cli.set_connection_timeout(5);
-    cli.set_read_timeout(5);
-
+void worker(int id, WorkloadType type, kv::Client& cli, int p_get, int p_put) {
     std::mt19937 rng(id + std::time(nullptr));
     std::uniform_int_distribution<int> dist_percent(0, 99);
     
@@ -86,9 +114,9 @@ void worker(int id, WorkloadType type, std::string host, int port, int p_get, in
     long long local_max = MIXED_PREFILL; 
 
     while (running) {
-        std::string key, val, path;
+        std::string key, val;
         auto start = std::chrono::high_resolution_clock::now();
-        httplib::Result res;
+        kv::Result res;
         bool is_read = false, is_write = false;
         int p = dist_percent(rng);
 
@@ -100,12 +128,11 @@ void worker(int id, WorkloadType type, std::string host, int port, int p_get, in
             val = "val_" + key; // Payload
             
             if (p < p_get) { // Reusing param as Put%
-                res = cli.Post("/api/data", httplib::Params{{"key", key}, {"val", val}});
+                res = cli.put(key, val);
                 is_write = true;
             } else {
                 // Delete random key (Disk intensive)
-                path = "/api/data?key=" + key;
-                res = cli.Delete(path.c_str());
+                res = cli.del(key);
                 is_write = true;
             }
         }
@@ -113,16 +140,14 @@ void worker(int id, WorkloadType type, std::string host, int port, int p_get, in
         // 2. GET POPULAR (Cache Hits)
         else if (type == GET_POPULAR) {
             key = std::to_string(dist_popular(rng));
-            path = "/api/data?key=" + key;
-            res = cli.Get(path.c_str());
+            res = cli.get(key);
             is_read = true;
         }
 
         // 3. GET ALL UNIQUE (Cache Misses / Disk Reads)
         else if (type == GET_ALL_UNIQUE) {
             key = std::to_string(dist_large(rng));
-            path = "/api/data?key=" + key;
-            res = cli.Get(path.c_str());
+            res = cli.get(key);
             is_read = true;
         }
 
@@ -131,22 +156,20 @@ void worker(int id, WorkloadType type, std::string host, int port, int p_get, in
             if (p < p_get) { // GET
                 std::uniform_int_distribution<long long> dist_hist(1, local_max);
                 key = std::to_string(id) + "_" + std::to_string(dist_hist(rng));
-                path = "/api/data?key=" + key;
-                res = cli.Get(path.c_str());
+                res = cli.get(key);
                 is_read = true;
             }
             else if (p < (p_get + p_put)) { // PUT
                 local_max++;
                 key = std::to_string(id) + "_" + std::to_string(local_max);
                 val = "v_" + key;
-                res = cli.Post("/api/data", httplib::Params{{"key", key}, {"val", val}});
+                res = cli.put(key, val);
                 is_write = true;
             }
             else { // DELETE
                 std::uniform_int_distribution<long long> dist_hist(1, local_max);
                 key = std::to_string(id) + "_" + std::to_string(dist_hist(rng));
-                path = "/api/data?key=" + key;
-                res = cli.Delete(path.c_str());
+                res = cli.del(key);
                 is_write = true;
             }
         }
@@ -154,60 +177,97 @@ void worker(int id, WorkloadType type, std::string host, int port, int p_get, in
         auto end = std::chrono::high_resolution_clock::now();
         total_requests++;
 
-        if (res) {
-            if (res->status != 500) {
+        if (res.status == 503) {
+            shed_requests++;
+        } else if (res.status != 0) {
+            if (res.status != 500) {
                 successful_requests++;
                 long long lat = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
                 total_latency_ms += lat;
+                long long lat_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+                latencies_us[id].push_back((uint32_t)std::min<long long>(lat_us, UINT32_MAX));
+
+                std::vector<std::pair<std::string, double>> stages = res.stages();
+                if (!stages.empty()) {
+                    for (const auto& st : stages) {
+                        for (int s = 0; s < NUM_STAGES; ++s) {
+                            if (st.first == STAGES[s]) stage_us[s] += (long long)(st.second * 1000);
+                        }
+                    }
+                    timed_latency_us += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+                    timed_requests++;
+                }
 
                 if (is_write) disk_writes++;
                 if (is_read) {
-                    if (res->has_header("X-Cache-Status")) {
-                        if (res->get_header_value("X-Cache-Status") == "HIT") cache_hits++;
+                    if (!res.cache_status.empty()) {
+                        if (res.hit()) cache_hits++;
                         else cache_misses++;
                     } else {
-                        if (res->status == 200) {
+                        if (res.status == 200) {
                             if (type == GET_POPULAR) cache_hits++; else cache_misses++;
                         }
                     }
-                    if (res->status == 404) disk_misses++;
+                    if (res.status == 404) disk_misses++;
                 }
             } else failed_requests++;
         } else failed_requests++;
     }
 }
 
+double percentile_ms(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    return sorted[(size_t)(p / 100.0 * (sorted.size() - 1))] / 1000.0;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc < 4) {
-        std::cout << "Usage: ./loadgen <threads> <duration> <type> [p1] [p2] [--no-warmup]\n";
+    // Options may appear anywhere; the rest are positional
+    std::vector<std::string> args;
+    bool skip_warmup = false;
+    int port = Config::SERVER_PORT;
+    std::string summary_path;   // Machine-readable results ("name=value" lines) for scripts and autotune
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--no-warmup") skip_warmup = true;
+        else if (arg == "--port" && i + 1 < argc) port = std::stoi(argv[++i]);
+        else if (arg == "--summary" && i + 1 < argc) summary_path = argv[++i];
+        else args.push_back(arg);
+    }
+
+    if (args.size() < 3) {
+        std::cout << "Usage: ./loadgen <threads> <duration> <type> [p1] [p2] [--no-warmup] [--port N] [--summary file]\n";
         return 1;
     }
 
-    int threads = std::stoi(argv[1]);
-    int seconds = std::stoi(argv[2]);
-    std::string type_s = argv[3];
+    int threads = std::stoi(args[0]);
+    int seconds = std::stoi(args[1]);
+    std::string type_s = args[2];
     WorkloadType type;
     int p_get = 0, p_put = 0;
-    
-    bool skip_warmup = false;
-    for(int i=0; i<argc; ++i) {
-        if(std::string(argv[i]) == "--no-warmup") skip_warmup = true;
-    }
 
     if (type_s == "put_all") {
         type = PUT_ALL;
-        if (argc > 4 && std::string(argv[4]) != "--no-warmup") p_get = std::stoi(argv[4]);
-        else p_get = 100;
+        p_get = args.size() > 3 ? std::stoi(args[3]) : 100;
     }
     else if (type_s == "get_all") type = GET_ALL_UNIQUE;
     else if (type_s == "get_popular") type = GET_POPULAR;
     else if (type_s == "mix") {
         type = MIXED;
-        if (argc > 4 && std::string(argv[4]) != "--no-warmup") p_get = std::stoi(argv[4]); else p_get = 80;
-        if (argc > 5 && std::string(argv[5]) != "--no-warmup") p_put = std::stoi(argv[5]); else p_put = 10;
+        p_get = args.size() > 3 ? std::stoi(args[3]) : 80;
+        p_put = args.size() > 4 ? std::stoi(args[4]) : 10;
     } else {
         std::cerr << "Invalid type.\n"; return 1;
     }
+    latencies_us.resize(threads);
+
+    // One pooled, cluster-aware client shared by all threads (one keep-alive connection per thread)
+    kv::ClientOptions opts;
+    opts.nodes = Config::CLUSTER_NODES;
+    opts.port = port;
+    opts.connections_per_node = std::max(threads, 8);
+    opts.connect_timeout_ms = 5000;
+    opts.read_timeout_ms = 30000;
+    kv::Client cli(opts);
 
     // AUTOMATIC WARMUP
     if (!skip_warmup && (type != PUT_ALL)) {
@@ -215,7 +275,7 @@ int main(int argc, char* argv[]) {
         std::vector<std::thread> w_threads;
         int w_count = (threads > 8) ? 8 : threads;
         for(int i=0; i<w_count; ++i) 
-            w_threads.push_back(std::thread(perform_warmup, i, w_count, type, Config::SERVER_ADDRESS, Config::SERVER_PORT));
+            w_threads.push_back(std::thread(perform_warmup, i, w_count, type, std::ref(cli)));
         for(auto& t : w_threads) t.join();
         std::cout << ">>> Warmup Complete.\n";
     }
@@ -224,7 +284,7 @@ int main(int argc, char* argv[]) {
     std::cout << ">>> Starting Benchmark (" << type_s << ") with " << threads << " threads for " << seconds << "s...\n";
     std::vector<std::thread> b_threads;
     for(int i=0; i<threads; ++i) 
-        b_threads.push_back(std::thread(worker, i, type, Config::SERVER_ADDRESS, Config::SERVER_PORT, p_get, p_put));
+        b_threads.push_back(std::thread(worker, i, type, std::ref(cli), p_get, p_put));
 
     std::this_thread::sleep_for(std::chrono::seconds(seconds));
     running = false;
@@ -240,6 +300,42 @@ int main(int argc, char* argv[]) {
     std::cout << "Latency: " << lat << " ms\n";
     std::cout << "Cache: Hits=" << cache_hits << " Misses=" << cache_misses << " HitRate=" << hit_rate << "%\n";
     std::cout << "Disk: Writes=" << disk_writes << " 404s=" << disk_misses << "\n";
+    std::cout << "Errors: Failed=" << failed_requests << " Shed(503)=" << shed_requests << "\n";
+    if (timed_requests > 0) {
+        // Average per request; cache_lock is part of cache, and network is what the server did not account for
+        std::cout << "Stages (avg ms):";
+        for (int s = 0; s < NUM_STAGES; ++s) {
+            std::cout << " " << STAGES[s] << "=" << std::setprecision(3) << stage_us[s] / 1000.0 / timed_requests;
+        }
+        double network_ms = (timed_latency_us - stage_us[NUM_STAGES - 1]) / 1000.0 / timed_requests;
+        std::cout << " network=" << network_ms << "\n";
+    }
+
+    std::vector<uint32_t> all;
+    for (const auto& l : latencies_us) all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+    std::cout << "Percentiles (ms): p50=" << std::setprecision(3) << percentile_ms(all, 50)
+              << " p90=" << percentile_ms(all, 90) << " p99=" << percentile_ms(all, 99)
+              << " p99.9=" << percentile_ms(all, 99.9) << "\n";
+
+    if (!summary_path.empty()) {
+        std::ofstream out(summary_path);
+        out << std::fixed << std::setprecision(3)
+            << "workload=" << type_s << "\n"
+            << "threads=" << threads << "\n"
+            << "seconds=" << seconds << "\n"
+            << "throughput=" << tput << "\n"
+            << "mean_ms=" << (all.empty() ? 0.0 : std::accumulate(all.begin(), all.end(), 0.0) / all.size() / 1000.0) << "\n"
+            << "p50_ms=" << percentile_ms(all, 50) << "\n"
+            << "p90_ms=" << percentile_ms(all, 90) << "\n"
+            << "p99_ms=" << percentile_ms(all, 99) << "\n"
+            << "p999_ms=" << percentile_ms(all, 99.9) << "\n"
+            << "requests=" << total_requests << "\n"
+            << "successful=" << successful_requests << "\n"
+            << "failed=" << failed_requests << "\n"
+            << "shed=" << shed_requests << "\n"
+            << "hit_rate=" << hit_rate << "\n";
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -1,184 +1,81 @@
 #include <iostream>
-#include "httplib.h"
-#include "constants.h"
-#include "database.h"    
-#include "cache.h"  
-
-// Global singletons
-DBPool* dbPool;
-ShardedLRUCache* cache;
-
-// Helper to execute SQL (Generic wrapper for simple inserts)
-void exec_sql(const std::string& query, const std::string& k, const std::string& v = "") {
-    sql::Connection* con = dbPool->getConnection();
-    try {
-        std::unique_ptr<sql::PreparedStatement> pstmt(con->prepareStatement(query));
-        pstmt->setString(1, k);
-        if (!v.empty()) {
-            pstmt->setString(2, v);
-        }
-        pstmt->executeUpdate();
-    } catch (sql::SQLException &e) {
-        std::cerr << "SQL Error: " << e.what() << std::endl;
+#include <csignal>
+#include <pthread.h>
+#include "server.h"
+
+int main(int argc, char* argv[]) {
+    // Usage: ./kv_server [port] [--leader | --follow host:port] [--config file] [--<setting> value ...]
+    // The port argument lets several cluster nodes or replicas run on one host.
+    // Settings are the Config names, e.g. --cache-shards 8 or --DB_POOL_MAX_SIZE=32.
+
+    // Block SIGHUP before any thread starts so only the reload watcher receives it
+    sigset_t hup;
+    sigemptyset(&hup);
+    sigaddset(&hup, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &hup, nullptr);
+
+    std::vector<std::string> args;
+    std::string error;
+    if (!config.parseArgs(argc, argv, args, error) || !config.load(error)) {
+        std::cerr << "Config error: " << error << std::endl;
+        return 1;
     }
-    dbPool->releaseConnection(con);
-}
-
 
-
-// 1. Create (POST /api/data?key=x&val=y)
-void handle_create(const httplib::Request& req, httplib::Response& res) {
-    if (req.has_param("key") && req.has_param("val")) {
-        std::string k = req.get_param_value("key");
-        std::string v = req.get_param_value("val");
-
-        // DB Write (Insert or Update if exists)
-        exec_sql("INSERT INTO key_value (key_name, value) VALUES (?, ?) ON DUPLICATE KEY UPDATE value = VALUES(value)", k, v);
-        
-        // Cache Write
-        cache->put(k, v);
-
-        res.set_content("Created", "text/plain");
-    } else {
-        res.status = 400;
-    }
-}
-
-// 2. Read (GET /api/data?key=x)
-void handle_read(const httplib::Request& req, httplib::Response& res) {
-    if (req.has_param("key")) {
-        std::string k = req.get_param_value("key");
-        std::string v;
-
-        // 1. Check Cache
-        if (cache->get(k, v)) {
-            // HIT: Set header for Load Generator to track
-            res.set_header("X-Cache-Status", "HIT");
-            res.set_content(v, "text/plain");
-            return; 
-        }
-
-        // 2. Cache Miss - Fetch from DB
-        sql::Connection* con = dbPool->getConnection();
-        try {
-            std::unique_ptr<sql::PreparedStatement> pstmt(con->prepareStatement("SELECT value FROM key_value WHERE key_name = ?"));
-            pstmt->setString(1, k);
-            std::unique_ptr<sql::ResultSet> res_set(pstmt->executeQuery());
-
-            if (res_set->next()) {
-                v = res_set->getString("value");
-                
-                // Update Cache
-                cache->put(k, v); 
-                
-                // MISS: Set header
-                res.set_header("X-Cache-Status", "MISS");
-                res.set_content(v, "text/plain");
-            } else {
-                res.status = 404;
-                res.set_content("Not Found", "text/plain");
-            }
-        } catch (sql::SQLException &e) {
-            std::cerr << "SQL Error in Read: " << e.what() << std::endl;
-            res.status = 500;
-        }
-        dbPool->releaseConnection(con);
-    } else {
-        res.status = 400;
-    }
-}
-
-// 3. Update (PUT /api/data?key=x&val=y)
-void handle_update(const httplib::Request& req, httplib::Response& res) {
-    if (req.has_param("key") && req.has_param("val")) {
-        std::string k = req.get_param_value("key");
-        std::string v = req.get_param_value("val");
-
-        sql::Connection* con = dbPool->getConnection();
-        int rows_affected = 0;
-
-        try {
-
-            // executeUpdate() returns the number of rows matched/changed.
-            std::unique_ptr<sql::PreparedStatement> pstmt(con->prepareStatement("UPDATE key_value SET value = ? WHERE key_name = ?"));
-            pstmt->setString(1, v);
-            pstmt->setString(2, k);
-            rows_affected = pstmt->executeUpdate();
-        } catch (sql::SQLException &e) {
-            std::cerr << "SQL Error in Update: " << e.what() << std::endl;
-        }
-        
-        dbPool->releaseConnection(con);
-
-        if (rows_affected > 0) {
-            // If DB updated successfully, update cache
-            cache->put(k, v);
-            res.set_content("Updated", "text/plain");
+    int port = Config::SERVER_PORT;
+    std::string repl_role = Config::REPL_ROLE;
+    std::string repl_leader = Config::REPL_LEADER;
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        if (arg == "--leader") {
+            repl_role = "leader";
+        } else if (arg == "--follow" && i + 1 < args.size()) {
+            repl_role = "follower";
+            repl_leader = args[++i];
+        } else if (!arg.empty() && arg.find_first_not_of("0123456789") == std::string::npos) {
+            port = std::stoi(arg);
         } else {
-            // If 0 rows affected, key didn't exist
-            res.status = 404;
-            res.set_content("Key not found", "text/plain");
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
         }
-
-    } else {
-        res.status = 400;
     }
-}
-
-// 4. Delete (DELETE /api/data?key=x)
-void handle_delete(const httplib::Request& req, httplib::Response& res) {
-    if (req.has_param("key")) {
-        std::string k = req.get_param_value("key");
-
-        // DB Delete
-        sql::Connection* con = dbPool->getConnection();
-        try {
-            std::unique_ptr<sql::PreparedStatement> pstmt(con->prepareStatement("DELETE FROM key_value WHERE key_name = ?"));
-            pstmt->setString(1, k);
-            pstmt->executeUpdate();
-        } catch (...) {}
-        dbPool->releaseConnection(con);
-
-        // Cache Delete
-        cache->remove(k);
-
-        res.set_content("Deleted", "text/plain");
-    } else {
-        res.status = 400;
-    }
-}
-
-int main() {
-
-    dbPool = new DBPool();
-    cache = new ShardedLRUCache(Config::CACHE_CAPACITY_TOTAL, Config::CACHE_SHARDS);
+    ServerOptions opts;
+    opts.self_id = Config::SERVER_ADDRESS + ":" + std::to_string(port);
+    opts.repl_role = repl_role;
+    opts.repl_leader = repl_leader;
+    init_services(opts);
+    start_reload_watcher();
 
     httplib::Server svr;
     
     // Configure thread pool
-    svr.new_task_queue = [] { return new httplib::ThreadPool(Config::SERVER_THREAD_POOL_SIZE); };
+    svr.new_task_queue = new_task_queue;
 
     // Register Routes
-    svr.Post("/api/data", handle_create);
-    svr.Get("/api/data", handle_read);
-    svr.Put("/api/data", handle_update);
-    svr.Delete("/api/data", handle_delete);
+    register_routes(svr);
 
 
     std::cout << "\n=== SERVER CONFIG DIAGNOSTICS ===" << std::endl;
+    std::cout << "Config File:      " << (config.file().empty() ? "none (defaults and flags)" : config.file() + " (SIGHUP reloads)") << std::endl;
     std::cout << "Server IP:        " << Config::SERVER_ADDRESS << std::endl;
-    std::cout << "Server Port:      " << Config::SERVER_PORT << std::endl;
-    std::cout << "Thread Pool Size: " << Config::SERVER_THREAD_POOL_SIZE << std::endl;
+    std::cout << "Server Port:      " << port << std::endl;
+    std::cout << "Replication:      " << repl_role << (repl_leader.empty() ? "" : " of " + repl_leader) << std::endl;
+    std::cout << "Invalidation Bus: " << (invalidationBus->enabled() ? Config::INVALIDATION_GROUP + ":" + std::to_string(Config::INVALIDATION_PORT) : "off") << std::endl;
+    std::cout << "Cluster Nodes:    " << (cluster->enabled() ? std::to_string(cluster->nodes().size()) : "standalone") << std::endl;
+    std::cout << "Thread Pool Size: " << Config::SERVER_THREAD_POOL_SIZE << " (work-stealing)" << std::endl;
+    std::cout << placement_report() << std::endl;
+    std::cout << "Admission:        " << (Config::ADMISSION_ENABLED ? "target " + std::to_string(Config::ADMISSION_TARGET_MS) + " ms / " + std::to_string(Config::ADMISSION_INTERVAL_MS) + " ms" : "off") << std::endl;
+    std::cout << "Stage Tracing:    " << (Config::TRACE_ENABLED ? "on (" + std::to_string(Config::TRACE_RING_CAPACITY) + " per thread)" : "off") << std::endl;
     std::cout << "Cache Capacity:   " << Config::CACHE_CAPACITY_TOTAL << std::endl;
-    std::cout << "DB Pool Size:     " << Config::DB_POOL_SIZE << std::endl;
+    std::cout << "Cache Compress:   " << (Config::CACHE_COMPRESSION_ENABLED ? ">= " + std::to_string(Config::CACHE_COMPRESS_THRESHOLD) + " bytes" : "off") << std::endl;
+    std::cout << "Read Replicas:    " << Config::DB_READ_REPLICAS.size() << std::endl;
+    std::cout << "DB Pool Size:     " << Config::DB_POOL_MIN_SIZE << "-" << Config::DB_POOL_MAX_SIZE << std::endl;
     std::cout << "=================================\n" << std::endl;
 
 
-    std::cout << "Server started on port " << Config::SERVER_PORT << "..." << std::endl;
-    svr.listen(Config::SERVER_ADDRESS.c_str(), Config::SERVER_PORT);
+    std::cout << "Server started on port " << port << "..." << std::endl;
+    svr.listen(Config::SERVER_ADDRESS.c_str(), port);
 
     // Cleanup (Only reached if server stops)
-    delete cache;
-    delete dbPool;
+    shutdown_services();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,1710 @@
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <csignal>
+#include <charconv>
+#include <unordered_set>
+#include "server.h"
+
+// Global singletons
+DBPool* dbPool;
+ReplicaRouter* readRouter;
+ShardedLRUCache* cache;
+Cluster* cluster;
+Rebalancer* rebalancer;
+Replicator* replicator;
+VersionClock* versionClock;
+InvalidationBus* invalidationBus;
+SamplingProfiler* profiler;
+tracing::Tracer* tracer;
+AdmissionController* admission;
+CounterFlusher* counters;
+KeyFilter* keyFilter;
+WorkStealingPool* workerPool;      // Owned by the httplib::Server; null until it listens
+ConfigLoader config;
+
+// Placement decided by init_services()
+static placement::Topology topology;
+static std::vector<int> workerCpus;
+static std::vector<int> dbThreadCpus;
+static int backgroundPinned = 0;
+
+// Answer 503 when no DB connection could be borrowed in time
+void set_unavailable(httplib::Response& res) {
+    res.status = 503;
+    res.set_header("Retry-After", std::to_string(Config::RETRY_AFTER_SEC));
+    res.set_content("Database unavailable", "text/plain");
+}
+
+// Answer 503 for work shed by admission control
+void set_overloaded(httplib::Response& res) {
+    res.status = 503;
+    res.set_header("Retry-After", std::to_string(Config::RETRY_AFTER_SEC));
+    res.set_content("Server overloaded", "text/plain");
+}
+
+// Borrow a DB connection, counting the wait as the db_wait stage
+sql::Connection* borrow(DBPool* pool) {
+    tracing::Span span(tracing::DB_WAIT);
+    return pool->getConnection();
+}
+
+// Node a request for `key` must be forwarded to, or "" to serve it here.
+// Followers send writes to the replication leader; in a cluster, keys owned by
+// another node go to their owner.
+std::string forward_target(const httplib::Request& req, const std::string& key, bool has_key) {
+    bool forwarded = req.has_header(Config::CLUSTER_FORWARD_HEADER);
+    if (req.method != "GET" && replicator->isFollower() && !forwarded) return replicator->leader();
+    std::string target;
+    if (!cluster->enabled() || !has_key || forwarded || cluster->route(key, target)) return "";
+    return target;
+}
+
+// Wrap a key-based handler: requests for keys owned by another cluster node are forwarded there
+httplib::Server::Handler owned(httplib::Server::Handler handler) {
+    return [handler](const httplib::Request& req, httplib::Response& res) {
+        // Writes are the first work shed under overload
+        if (req.method != "GET" && !admission->admitWrite()) {
+            set_overloaded(res);
+            return;
+        }
+        std::string key = req.get_param_value("key");
+        std::string target = forward_target(req, key, req.has_param("key"));
+        if (!target.empty()) {
+            tracing::Span span(tracing::FORWARD);
+            cluster->forward(target, req, res);
+            return;
+        }
+        handler(req, res);
+        // Writes to keys being handed off must not leave a stale copy on the new owner
+        if (cluster->enabled() && req.method != "GET" && req.has_param("key")) rebalancer->noteWrite(key);
+    };
+}
+
+// After a committed write of `version`: cache the value (or drop the cached copy
+// of a value too large to cache), and tell other instances and followers about it
+void publish_write(const std::string& k, const std::string* v, uint64_t version) {
+    {
+        tracing::Span span(tracing::CACHE);
+        if (v != nullptr) cache->put(k, *v, version);
+        else cache->remove(k);
+    }
+    invalidationBus->publish(k, version);
+    // Large values stay out of the in-memory replication log; followers drop their copy
+    if (v != nullptr) replicator->append('P', k, *v, version);
+    else replicator->append('D', k);
+}
+
+bool is_large(size_t size) {
+    return size > Config::LARGE_VALUE_THRESHOLD;
+}
+
+// False if the key filter proves `k` is not in MySQL
+bool key_may_exist(const std::string& k) {
+    if (!keyFilter->isReady() || keyFilter->mayContain(k)) return true;
+    keyFilter->countDefiniteMiss();
+    return false;
+}
+
+// Write `v` as the value of `k` on `con` under a new version, and return the HTTP
+// status: 200, 404 (update of a missing key) or 409 (the row is not at
+// `*if_version`). `version` returns the version written, the row's version on
+// 409, or 0 if a write with a newer version replaced the row first. Racing writes
+// keep the highest version, so the row and every cache agree on the winner; a
+// write that loses only because this clock is behind the row's is retried once.
+int write_row(sql::Connection* con, const std::string& k, const std::string& v, bool create,
+              const uint64_t* if_version, uint64_t& version) {
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        version = versionClock->now();
+        std::unique_ptr<sql::PreparedStatement> pstmt;
+        if (if_version != nullptr) {
+            version = std::max(version, *if_version + 1);
+            pstmt.reset(con->prepareStatement("UPDATE key_value SET value = ?, version = ? WHERE key_name = ? AND version = ?"));
+            pstmt->setUInt64(4, *if_version);
+        } else if (create) {
+            // Assignments run left to right: `value` still sees the old version
+            pstmt.reset(con->prepareStatement(
+                "INSERT INTO key_value (key_name, value, version) VALUES (?, ?, ?) ON DUPLICATE KEY UPDATE "
+                "value = IF(version < VALUES(version), VALUES(value), value), version = GREATEST(version, VALUES(version))"));
+        } else {
+            pstmt.reset(con->prepareStatement("UPDATE key_value SET value = ?, version = ? WHERE key_name = ? AND version < ?"));
+            pstmt->setUInt64(4, version);
+        }
+        if (create && if_version == nullptr) {
+            pstmt->setString(1, k);
+            pstmt->setString(2, v);
+            pstmt->setUInt64(3, version);
+        } else {
+            pstmt->setString(1, v);
+            pstmt->setUInt64(2, version);
+            pstmt->setString(3, k);
+        }
+        // A new row must be in the key filter before other requests can see it;
+        // the extra count is taken back if the row already existed
+        bool insert = create && if_version == nullptr;
+        if (insert) keyFilter->add(k);
+        int affected;
+        try {
+            affected = pstmt->executeUpdate();
+        } catch (sql::SQLException&) {
+            if (insert) keyFilter->remove(k);
+            throw;
+        }
+        if (insert && affected != 1) keyFilter->remove(k);
+        if (affected > 0) return 200;
+
+        std::unique_ptr<sql::PreparedStatement> check(con->prepareStatement("SELECT version FROM key_value WHERE key_name = ?"));
+        check->setString(1, k);
+        std::unique_ptr<sql::ResultSet> res_set(check->executeQuery());
+        if (!res_set->next()) return 404;
+        uint64_t current = res_set->getUInt64("version");
+        if (if_version != nullptr) {
+            version = current;
+            return 409;
+        }
+        versionClock->observe(current);
+    }
+    version = 0;
+    return 200;
+}
+
+// Parse the if_version parameter of a conditional write. False if it is malformed.
+bool parse_if_version(const httplib::Request& req, bool& conditional, uint64_t& if_version) {
+    conditional = req.has_param("if_version");
+    if (!conditional) return true;
+    std::string in = req.get_param_value("if_version");
+    auto r = std::from_chars(in.data(), in.data() + in.size(), if_version);
+    return !in.empty() && r.ec == std::errc() && r.ptr == in.data() + in.size();
+}
+
+// Answer a conditional write from the cache when it cannot succeed: row versions
+// only grow, so a cached version newer than `if_version` is a definite conflict.
+// Otherwise make sure the row holds every increment the cached version includes.
+bool reject_stale_version(const std::string& k, uint64_t if_version, httplib::Response& res) {
+    uint64_t cached;
+    if (cache->versionOf(k, cached) && cached > if_version) {
+        res.status = 409;
+        res.set_header("X-KV-Version", std::to_string(cached));
+        res.set_content("Version mismatch", "text/plain");
+        return true;
+    }
+    if (cache->hasPending(k)) counters->flush();
+    return false;
+}
+
+// Create or update `k` from a request whose value fits in memory
+void write_value(const std::string& k, const std::string& v, bool create, const uint64_t* if_version,
+                 httplib::Response& res) {
+    sql::Connection* con = borrow(dbPool);
+    if (con == nullptr) {
+        set_unavailable(res);
+        return;
+    }
+    uint64_t version = 0;
+    int status;
+    try {
+        tracing::Span span(tracing::SQL);
+        status = write_row(con, k, v, create, if_version, version);
+    } catch (sql::SQLException &e) {
+        std::cerr << "SQL Error in " << (create ? "Create" : "Update") << ": " << e.what() << std::endl;
+        status = 500;
+    }
+    dbPool->releaseConnection(con, status == 500);
+
+    if (status == 200) {
+        // Cache Write, and tell the other instances their copy is stale
+        if (version != 0) {
+            publish_write(k, is_large(v.size()) ? nullptr : &v, version);
+            res.set_header("X-KV-Version", std::to_string(version));
+        }
+        res.set_content(create ? "Created" : "Updated", "text/plain");
+    } else if (status == 409) {
+        res.status = 409;
+        res.set_header("X-KV-Version", std::to_string(version));
+        res.set_content("Version mismatch", "text/plain");
+    } else if (status == 404) {
+        res.status = 404;
+        res.set_content("Key not found", "text/plain");
+    } else {
+        res.status = status;
+    }
+}
+
+// 1. Create (POST /api/data?key=x&val=y)
+void handle_create(const httplib::Request& req, httplib::Response& res) {
+    if (req.has_param("key") && req.has_param("val")) {
+        // DB Write (Insert or Update if exists)
+        write_value(req.get_param_value("key"), req.get_param_value("val"), true, nullptr, res);
+    } else {
+        res.status = 400;
+    }
+}
+
+// Send a large value as the response body, read from MySQL one piece at a time.
+// The pieces come from one consistent snapshot, so a concurrent write cannot
+// mix two versions; the connection is held until the body is sent.
+void stream_value(const std::string& k, sql::Connection* con, DBPool* pool, int target, httplib::Response& res) {
+    uint64_t length = 0;
+    uint64_t version = 0;
+    bool found = false;
+    bool failed = false;
+    try {
+        tracing::Span span(tracing::SQL);
+        std::unique_ptr<sql::Statement> stmt(con->createStatement());
+        stmt->execute("START TRANSACTION WITH CONSISTENT SNAPSHOT, READ ONLY");
+        std::unique_ptr<sql::PreparedStatement> pstmt(con->prepareStatement("SELECT LENGTH(value) AS length, version FROM key_value WHERE key_name = ?"));
+        pstmt->setString(1, k);
+        std::unique_ptr<sql::ResultSet> res_set(pstmt->executeQuery());
+        if (res_set->next()) {
+            length = res_set->getUInt64("length");
+            version = res_set->getUInt64("version");
+            found = true;
+        }
+    } catch (sql::SQLException &e) {
+        std::cerr << "SQL Error in Read: " << e.what() << std::endl;
+        failed = true;
+    }
+
+    // Ends the snapshot and gives the connection back
+    auto release = [con, pool, target](bool ok) {
+        try {
+            con->commit();
+        } catch (sql::SQLException &e) {
+            ok = false;
+        }
+        pool->releaseConnection(con, !ok);
+        readRouter->done(target);
+    };
+    if (!found) {
+        release(!failed);
+        res.status = failed ? 500 : 404;
+        if (!failed) res.set_content("Not Found", "text/plain");
+        return;
+    }
+
+    res.set_header("X-Cache-Status", "MISS");
+    res.set_header("X-KV-Version", std::to_string(version));
+    res.set_content_provider(length, "text/plain",
+        [k, con](size_t offset, size_t len, httplib::DataSink& sink) {
+            std::string piece;
+            try {
+                tracing::Span span(tracing::SQL);
+                std::unique_ptr<sql::PreparedStatement> pstmt(con->prepareStatement("SELECT SUBSTRING(value, ?, ?) AS piece FROM key_value WHERE key_name = ?"));
+                pstmt->setUInt64(1, offset + 1);
+                pstmt->setUInt64(2, std::min(len, Config::LARGE_VALUE_CHUNK_BYTES));
+                pstmt->setString(3, k);
+                std::unique_ptr<sql::ResultSet> res_set(pstmt->executeQuery());
+                if (res_set->next()) piece = res_set->getString("piece");
+            } catch (sql::SQLException &e) {
+                std::cerr << "SQL Error in Read: " << e.what() << std::endl;
+                return false;
+            }
+            // An empty piece means the row is gone or shorter than announced
+            return !piece.empty() && sink.write(piece.data(), piece.size());
+        },
+        release);
+}
+
+// 2. Read (GET /api/data?key=x)
+void handle_read(const httplib::Request& req, httplib::Response& res) {
+    if (req.has_param("key")) {
+        std::string k = req.get_param_value("key");
+        std::string v;
+
+        // 1. Check Cache
+        // Clients that accept the lz encoding get compressed entries as stored
+        bool accepts_lz = req.get_header_value("Accept-Encoding").find(Config::CACHE_COMPRESS_ENCODING) != std::string::npos;
+        bool compressed = false;
+        uint64_t version = 0;
+        bool hit;
+        {
+            tracing::Span span(tracing::CACHE);
+            hit = accepts_lz ? cache->getRaw(k, v, compressed, version) : cache->get(k, v, version);
+        }
+        if (hit) {
+            // HIT: Set header for Load Generator to track
+            res.set_header("X-Cache-Status", "HIT");
+            res.set_header("X-KV-Version", std::to_string(version));
+            if (compressed) res.set_header("Content-Encoding", Config::CACHE_COMPRESS_ENCODING);
+            res.set_content(v, "text/plain");
+            return; 
+        }
+
+        // Keys the filter has never seen are not in MySQL either
+        if (!key_may_exist(k)) {
+            res.status = 404;
+            res.set_content("Not Found", "text/plain");
+            return;
+        }
+
+        // Under overload only hits are served; a miss would hold a worker for a DB round trip
+        if (!admission->admitMiss()) {
+            set_overloaded(res);
+            return;
+        }
+
+        // 2. Cache Miss - Fetch from DB (least loaded healthy replica, or the primary)
+        // The fill is versioned with the time the read started, so it cannot replace a newer write.
+        uint64_t read_version = versionClock->now();
+        int target = readRouter->pick();
+        DBPool* pool = readRouter->pool(target);
+        sql::Connection* con = borrow(pool);
+        if (con == nullptr) {
+            readRouter->done(target);
+            set_unavailable(res);
+            return;
+        }
+        bool failed = false;
+        bool found = false;
+        uint64_t length = 0;
+        try {
+            tracing::Span span(tracing::SQL);
+            // Large values are not fetched here; they are streamed below
+            std::unique_ptr<sql::PreparedStatement> pstmt(con->prepareStatement(
+                "SELECT IF(LENGTH(value) > ?, NULL, value) AS value, LENGTH(value) AS length, version FROM key_value WHERE key_name = ?"));
+            pstmt->setUInt64(1, Config::LARGE_VALUE_THRESHOLD);
+            pstmt->setString(2, k);
+            std::unique_ptr<sql::ResultSet> res_set(pstmt->executeQuery());
+
+            if (res_set->next()) {
+                length = res_set->getUInt64("length");
+                if (!is_large(length)) v = res_set->getString("value");
+                version = res_set->getUInt64("version");
+                found = true;
+            }
+        } catch (sql::SQLException &e) {
+            std::cerr << "SQL Error in Read: " << e.what() << std::endl;
+            res.status = 500;
+            failed = true;
+        }
+        if (found && is_large(length)) {
+            // The connection stays with the response until the body is sent
+            stream_value(k, con, pool, target, res);
+            return;
+        }
+        pool->releaseConnection(con, failed);
+        readRouter->done(target);
+
+        if (found) {
+            // Update Cache, unless another instance wrote the key while we were reading.
+            // The entry keeps the row's version, so it never replaces a newer write.
+            // A replica may be missing a recent write: its value is only kept briefly.
+            int ttl_ms = target == ReplicaRouter::PRIMARY ? 0 : Config::REPLICA_FILL_TTL_MS.load();
+            if ((target == ReplicaRouter::PRIMARY || ttl_ms > 0) && invalidationBus->shouldCacheFill(k, read_version)) {
+                tracing::Span span(tracing::CACHE);
+                cache->put(k, v, version, ttl_ms);
+            }
+
+            // MISS: Set header
+            res.set_header("X-Cache-Status", "MISS");
+            res.set_header("X-KV-Version", std::to_string(version));
+            res.set_content(v, "text/plain");
+        } else if (!failed) {
+            if (keyFilter->isReady()) keyFilter->countFalsePositive();
+            res.status = 404;
+            res.set_content("Not Found", "text/plain");
+        }
+    } else {
+        res.status = 400;
+    }
+}
+
+// 3. Update (PUT /api/data?key=x&val=y[&if_version=v])
+// With if_version the update only succeeds if the key is still at that version
+// (as returned in X-KV-Version); otherwise it answers 409 with the current one.
+void handle_update(const httplib::Request& req, httplib::Response& res) {
+    bool conditional;
+    uint64_t if_version = 0;
+    if (req.has_param("key") && req.has_param("val") && parse_if_version(req, conditional, if_version)) {
+        std::string k = req.get_param_value("key");
+        if (conditional && reject_stale_version(k, if_version, res)) return;
+        write_value(k, req.get_param_value("val"), false, conditional ? &if_version : nullptr, res);
+    } else {
+        res.status = 400;
+    }
+}
+
+// Raw value body being written to MySQL. The first LARGE_VALUE_THRESHOLD bytes
+// are buffered; a longer value is written inside one transaction, with the
+// buffer flushed every LARGE_VALUE_CHUNK_BYTES by appending to the row.
+struct ValueUpload {
+    std::string key;
+    bool create;
+    bool conditional = false;
+    uint64_t if_version = 0;
+    std::string piece;          // Bytes not yet sent to MySQL
+    size_t written = 0;         // Bytes already sent
+    uint64_t version = 0;       // Written by the first piece; 0 if a newer write won
+    sql::Connection* con = nullptr;
+    int status = 200;           // 404 if an update found no row, 409 on a version mismatch, 500/503 on failure
+
+    // Send `piece` to MySQL: the first piece writes the row, later ones append
+    void flush() {
+        if (status != 200 || (written > 0 && version == 0)) {
+            piece.clear();
+            return;
+        }
+        try {
+            tracing::Span span(tracing::SQL);
+            if (written == 0) {
+                con->setAutoCommit(false);
+                status = write_row(con, key, piece, create, conditional ? &if_version : nullptr, version);
+            } else {
+                std::unique_ptr<sql::PreparedStatement> pstmt(con->prepareStatement("UPDATE key_value SET value = CONCAT(value, ?) WHERE key_name = ?"));
+                pstmt->setString(1, piece);
+                pstmt->setString(2, key);
+                pstmt->executeUpdate();
+            }
+        } catch (sql::SQLException &e) {
+            std::cerr << "SQL Error in Upload: " << e.what() << std::endl;
+            status = 500;
+        }
+        written += piece.size();
+        piece.clear();
+    }
+
+    // Commit or roll back, and return the connection
+    void finish() {
+        if (con == nullptr) return;
+        bool failed = status == 500;
+        try {
+            if (status == 200) con->commit();
+            else con->rollback();
+            con->setAutoCommit(true);
+        } catch (sql::SQLException &e) {
+            std::cerr << "SQL Error in Upload: " << e.what() << std::endl;
+            status = 500;
+            failed = true;
+        }
+        dbPool->releaseConnection(con, failed);
+        con = nullptr;
+    }
+};
+
+// Read and discard the body of a request answered without it, so the next
+// request on the keep-alive connection starts at the right byte
+void drain(const httplib::ContentReader& reader) {
+    reader([](const char*, size_t) { return true; });
+}
+
+// 1/3. Create or update (POST/PUT /api/data)
+// httplib hands every POST and PUT to a content-reader handler, so this is the
+// entry point for all three forms: the query string (?key=x&val=y), a form body
+// (key=x&val=y), or the value itself as the body (?key=x, any other Content-Type,
+// with Content-Length or chunked), where large values never sit in memory whole.
+void handle_data_body(const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader) {
+    if (req.has_param("val")) {
+        static const httplib::Server::Handler create = owned(handle_create);
+        static const httplib::Server::Handler update = owned(handle_update);
+        drain(reader);
+        if (req.method == "POST") create(req, res);
+        else update(req, res);
+        return;
+    }
+    bool form = req.get_header_value("Content-Type").find("application/x-www-form-urlencoded") == 0;
+    if (req.is_multipart_form_data() || (!form && !req.has_param("key"))) {
+        drain(reader);
+        res.status = 400;
+        return;
+    }
+    if (!admission->admitWrite()) {
+        drain(reader);
+        set_overloaded(res);
+        return;
+    }
+
+    if (form) {
+        // Same as the query-string form, with the fields read from the body
+        std::string body;
+        reader([&](const char* data, size_t len) {
+            body.append(data, len);
+            return true;
+        });
+        httplib::Request fields;
+        fields.method = req.method;
+        fields.params = req.params;
+        httplib::detail::parse_query_text(body, fields.params);
+        std::string key = fields.get_param_value("key");
+        std::string target = forward_target(req, key, fields.has_param("key"));
+        if (!target.empty()) {
+            httplib::Request fwd = req;
+            fwd.body = std::move(body);
+            tracing::Span span(tracing::FORWARD);
+            cluster->forward(target, fwd, res);
+            return;
+        }
+        if (req.method == "POST") handle_create(fields, res);
+        else handle_update(fields, res);
+        if (cluster->enabled() && fields.has_param("key")) rebalancer->noteWrite(key);
+        return;
+    }
+
+    ValueUpload up;
+    up.key = req.get_param_value("key");
+    up.create = req.method == "POST";
+    if (!parse_if_version(req, up.conditional, up.if_version) || (up.conditional && up.create)) {
+        drain(reader);
+        res.status = 400;
+        return;
+    }
+    std::string target = forward_target(req, up.key, true);
+    if (!target.empty()) {
+        // Peers take the whole body in one request
+        httplib::Request fwd = req;
+        reader([&](const char* data, size_t len) {
+            fwd.body.append(data, len);
+            return true;
+        });
+        tracing::Span span(tracing::FORWARD);
+        cluster->forward(target, fwd, res);
+        return;
+    }
+    if (up.conditional && reject_stale_version(up.key, up.if_version, res)) {
+        drain(reader);
+        return;
+    }
+
+    reader([&](const char* data, size_t len) {
+        up.piece.append(data, len);
+        if (up.con == nullptr && up.status == 200 && is_large(up.written + up.piece.size())) {
+            up.con = borrow(dbPool);
+            if (up.con == nullptr) up.status = 503;
+        }
+        if (up.piece.size() >= Config::LARGE_VALUE_CHUNK_BYTES && (up.con != nullptr || up.status != 200)) up.flush();
+        return true;   // Keep reading after a failure so the connection stays usable
+    });
+
+    if (up.con == nullptr && up.status == 200) {
+        // Small enough to cache: the regular path
+        httplib::Request fields;
+        fields.method = req.method;
+        fields.params = req.params;
+        fields.params.emplace("val", std::move(up.piece));
+        if (up.create) handle_create(fields, res);
+        else handle_update(fields, res);
+    } else {
+        if (!up.piece.empty()) up.flush();
+        up.finish();
+        if (up.status == 200) {
+            if (up.version != 0) {
+                publish_write(up.key, nullptr, up.version);
+                res.set_header("X-KV-Version", std::to_string(up.version));
+            }
+            res.set_content(up.create ? "Created" : "Updated", "text/plain");
+        } else if (up.status == 409) {
+            res.status = 409;
+            res.set_header("X-KV-Version", std::to_string(up.version));
+            res.set_content("Version mismatch", "text/plain");
+        } else if (up.status == 503) {
+            set_unavailable(res);
+        } else if (up.status == 404) {
+            res.status = 404;
+            res.set_content("Key not found", "text/plain");
+        } else {
+            res.status = up.status;
+        }
+    }
+    if (cluster->enabled()) rebalancer->noteWrite(up.key);
+}
+
+// 4. Delete (DELETE /api/data?key=x)
+void handle_delete(const httplib::Request& req, httplib::Response& res) {
+    if (req.has_param("key")) {
+        std::string k = req.get_param_value("key");
+
+        // Nothing to delete in MySQL; a cached copy can only be stale
+        if (!key_may_exist(k)) {
+            tracing::Span span(tracing::CACHE);
+            cache->remove(k);
+            res.set_content("Deleted", "text/plain");
+            return;
+        }
+
+        // DB Delete
+        sql::Connection* con = borrow(dbPool);
+        if (con == nullptr) {
+            set_unavailable(res);
+            return;
+        }
+        bool failed = false;
+        try {
+            tracing::Span span(tracing::SQL);
+            std::unique_ptr<sql::PreparedStatement> pstmt(con->prepareStatement("DELETE FROM key_value WHERE key_name = ?"));
+            pstmt->setString(1, k);
+            if (pstmt->executeUpdate() > 0) keyFilter->remove(k);
+        } catch (...) {
+            failed = true;
+        }
+        dbPool->releaseConnection(con, failed);
+
+        // Cache Delete
+        {
+            tracing::Span span(tracing::CACHE);
+            cache->remove(k);
+        }
+        invalidationBus->publish(k, versionClock->now());
+        replicator->append('D', k);
+
+        res.set_content("Deleted", "text/plain");
+    } else {
+        res.status = 400;
+    }
+}
+
+// JSON object for one DB pool (used for the primary and each replica)
+std::string pool_stats_json(const PoolStats& p) {
+    std::ostringstream pool_json;
+    pool_json << "{\"size\":" << p.size
+              << ",\"idle\":" << p.idle
+              << ",\"in_use\":" << p.in_use
+              << ",\"min_size\":" << p.min_size
+              << ",\"max_size\":" << p.max_size
+              << ",\"borrows\":" << p.borrows
+              << ",\"affinity_hits\":" << p.affinity_hits
+              << ",\"steals\":" << p.steals
+              << ",\"sleeps\":" << p.sleeps
+              << ",\"grown\":" << p.grown
+              << ",\"shrunk\":" << p.shrunk
+              << ",\"timeouts\":" << p.timeouts
+              << ",\"invalidated\":" << p.invalidated
+              << ",\"reconnects\":" << p.reconnects
+              << ",\"reconnecting\":" << p.reconnecting
+              << ",\"wait_avg_ms\":" << p.wait_avg_ms
+              << ",\"wait_p50_ms\":" << p.wait_p50_ms
+              << ",\"wait_p99_ms\":" << p.wait_p99_ms
+              << ",\"window_wait_p99_ms\":" << p.window_wait_p99_ms
+              << ",\"hold_avg_ms\":" << p.hold_avg_ms
+              << ",\"hold_p99_ms\":" << p.hold_p99_ms
+              << ",\"utilization\":" << p.utilization << "}";
+    return pool_json.str();
+}
+
+const char* repl_role_name(Replicator::Role role) {
+    switch (role) {
+        case Replicator::LEADER: return "leader";
+        case Replicator::FOLLOWER: return "follower";
+        default: return "standalone";
+    }
+}
+
+// 5. Stats (GET /stats)
+void handle_stats(const httplib::Request& req, httplib::Response& res) {
+    std::vector<ShardStats> shard_stats = cache->stats();
+    uint64_t hits = 0, misses = 0;
+    std::ostringstream shards_json;
+    for (size_t i = 0; i < shard_stats.size(); ++i) {
+        const ShardStats& s = shard_stats[i];
+        hits += s.hits;
+        misses += s.misses;
+        double ratio = s.stored_bytes > 0 ? (double)s.raw_bytes / s.stored_bytes : 1.0;
+        double compress_us = s.compress_ops > 0 ? s.compress_ns / 1000.0 / s.compress_ops : 0.0;
+        double decompress_us = s.decompress_ops > 0 ? s.decompress_ns / 1000.0 / s.decompress_ops : 0.0;
+        if (i > 0) shards_json << ",";
+        shards_json << "{\"shard\":" << i
+                    << ",\"items\":" << s.items
+                    << ",\"hits\":" << s.hits
+                    << ",\"misses\":" << s.misses
+                    << ",\"compressed_items\":" << s.compressed_items
+                    << ",\"compressed_raw_bytes\":" << s.raw_bytes
+                    << ",\"compressed_stored_bytes\":" << s.stored_bytes
+                    << ",\"compression_ratio\":" << ratio
+                    << ",\"compress_ops\":" << s.compress_ops
+                    << ",\"compress_cpu_ms\":" << s.compress_ns / 1e6
+                    << ",\"avg_compress_us\":" << compress_us
+                    << ",\"decompress_ops\":" << s.decompress_ops
+                    << ",\"decompress_cpu_ms\":" << s.decompress_ns / 1e6
+                    << ",\"avg_decompress_us\":" << decompress_us
+                    << ",\"lock_waits\":" << s.lock_waits
+                    << ",\"lock_wait_ms\":" << s.lock_wait_ns / 1e6
+                    << ",\"node\":" << s.node << "}";
+    }
+    double hit_rate = (hits + misses) > 0 ? (double)hits / (hits + misses) * 100.0 : 0.0;
+
+    std::ostringstream replicas_json;
+    std::vector<ReplicaStats> replica_stats = readRouter->stats();
+    for (size_t i = 0; i < replica_stats.size(); ++i) {
+        const ReplicaStats& r = replica_stats[i];
+        if (i > 0) replicas_json << ",";
+        replicas_json << "{\"host\":\"" << r.host << "\""
+                      << ",\"healthy\":" << (r.healthy ? "true" : "false")
+                      << ",\"lag_sec\":" << r.lag_sec
+                      << ",\"outstanding\":" << r.outstanding
+                      << ",\"reads\":" << r.reads
+                      << ",\"pool\":" << pool_stats_json(r.pool) << "}";
+    }
+
+    BusStats bus = invalidationBus->stats();
+    AdmissionStats adm = admission->stats();
+    WorkerPoolStats wp = workerPool ? workerPool->stats() : WorkerPoolStats();
+    CounterStats cs = counters->stats();
+    KeyFilterStats kf = keyFilter->stats();
+    uint64_t filtered = kf.definite_misses + kf.false_positives;
+
+    std::ostringstream out;
+    out << "{\"cache_hits\":" << hits
+        << ",\"cache_misses\":" << misses
+        << ",\"hit_rate\":" << hit_rate
+        << ",\"shards\":[" << shards_json.str() << "]"
+        << ",\"db_pool\":" << pool_stats_json(dbPool->stats())
+        << ",\"primary_reads\":" << readRouter->primaryReads()
+        << ",\"replicas\":[" << replicas_json.str() << "]"
+        << ",\"cluster\":{\"self\":\"" << cluster->self() << "\""
+        << ",\"nodes\":" << cluster->nodes().size()
+        << ",\"forwarded\":" << cluster->forwardedCount()
+        << ",\"forward_errors\":" << cluster->forwardErrors() << "}"
+        << ",\"replication\":{\"role\":\"" << repl_role_name(replicator->currentRole()) << "\""
+        << ",\"leader\":\"" << replicator->leader() << "\""
+        << ",\"head_seq\":" << replicator->headSeq()
+        << ",\"applied_seq\":" << replicator->appliedSeq()
+        << ",\"resyncs\":" << replicator->resyncCount()
+        << ",\"followers\":" << replicator->followerCount()
+        << ",\"followers_refused\":" << replicator->refusedCount() << "}"
+        << ",\"invalidation\":{\"enabled\":" << (bus.enabled ? "true" : "false")
+        << ",\"packets_sent\":" << bus.packets_sent
+        << ",\"keys_sent\":" << bus.keys_sent
+        << ",\"packets_received\":" << bus.packets_received
+        << ",\"keys_received\":" << bus.keys_received
+        << ",\"invalidated\":" << bus.invalidated
+        << ",\"stale_fills\":" << bus.stale_fills << "}"
+        << ",\"admission\":{\"enabled\":" << (adm.enabled ? "true" : "false")
+        << ",\"overloaded\":" << (adm.overloaded ? "true" : "false")
+        << ",\"shedding_writes\":" << (adm.shedding_writes ? "true" : "false")
+        << ",\"queued\":" << adm.queued
+        << ",\"overload_episodes\":" << adm.overload_episodes
+        << ",\"shed_writes\":" << adm.shed_writes
+        << ",\"shed_misses\":" << adm.shed_misses
+        << ",\"queue_delay_avg_ms\":" << adm.queue_delay_avg_ms
+        << ",\"queue_delay_p99_ms\":" << adm.queue_delay_p99_ms << "}"
+        << ",\"counters\":{\"sync\":" << (Config::COUNTER_SYNC ? "true" : "false")
+        << ",\"increments\":" << cs.increments
+        << ",\"pending_keys\":" << cs.pending_keys
+        << ",\"pending_delta\":" << cs.pending_delta
+        << ",\"flushes\":" << cs.flushes
+        << ",\"statements\":" << cs.statements
+        << ",\"superseded\":" << cs.superseded
+        << ",\"flush_errors\":" << cs.flush_errors << "}"
+        << ",\"key_filter\":{\"ready\":" << (kf.ready ? "true" : "false")
+        << ",\"disabled\":" << (kf.disabled ? "true" : "false")
+        << ",\"keys\":" << kf.keys
+        << ",\"counters\":" << kf.counters
+        << ",\"hashes\":" << kf.hashes
+        << ",\"memory_bytes\":" << kf.memory_bytes
+        << ",\"fill_ratio\":" << kf.fill_ratio
+        << ",\"saturated_counters\":" << kf.saturated
+        << ",\"estimated_fp_rate\":" << kf.estimated_fp_rate
+        << ",\"observed_fp_rate\":" << (filtered > 0 ? (double)kf.false_positives / filtered : 0.0)
+        << ",\"definite_misses\":" << kf.definite_misses
+        << ",\"false_positives\":" << kf.false_positives
+        << ",\"build_keys\":" << kf.build_keys
+        << ",\"build_ms\":" << kf.build_ms << "}"
+        << ",\"workers\":{\"threads\":" << wp.threads
+        << ",\"parked\":" << wp.parked
+        << ",\"queued\":" << wp.queued
+        << ",\"executed\":" << wp.executed
+        << ",\"stolen\":" << wp.stolen
+        << ",\"parks\":" << wp.parks
+        << ",\"rejected\":" << wp.rejected << "}}";
+    res.set_content(out.str(), "application/json");
+}
+
+// 6. Cluster membership (POST /cluster/members?nodes=host:port,host:port,...)
+// Send the same list to every node, old and new. New nodes are started with the old membership.
+void handle_cluster_members(const httplib::Request& req, httplib::Response& res) {
+    if (!req.has_param("nodes")) {
+        res.status = 400;
+        return;
+    }
+    std::vector<std::string> nodes;
+    std::stringstream ss(req.get_param_value("nodes"));
+    std::string node;
+    while (std::getline(ss, node, ',')) {
+        if (!node.empty()) nodes.push_back(node);
+    }
+    if (!rebalancer->changeMembership(nodes)) {
+        res.status = 409;
+        res.set_content("Previous rebalance still in progress", "text/plain");
+        return;
+    }
+    // Peers now share the table and insert keys this node never sees
+    if (nodes.size() > 1) keyFilter->disable();
+    res.set_content("Membership updated", "text/plain");
+}
+
+// 7. Handoff stream from a previous owner (POST /cluster/import)
+void handle_cluster_import(const httplib::Request& req, httplib::Response& res) {
+    if (!rebalancer->importRecords(req.body)) {
+        res.status = 400;
+        return;
+    }
+    res.set_content("Imported", "text/plain");
+}
+
+// 8. Previous owner finished its handoff (POST /cluster/handoff_done)
+void handle_cluster_handoff_done(const httplib::Request& req, httplib::Response& res) {
+    cluster->handoffReceived(req.get_header_value(Config::CLUSTER_FORWARD_HEADER), req.body);
+    res.set_content("OK", "text/plain");
+}
+
+// 9. Cluster status (GET /cluster/status)
+void handle_cluster_status(const httplib::Request& req, httplib::Response& res) {
+    std::ostringstream out;
+    out << "{\"self\":\"" << cluster->self() << "\",\"nodes\":[";
+    std::vector<std::string> nodes = cluster->nodes();
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        out << (i > 0 ? "," : "") << "\"" << nodes[i] << "\"";
+    }
+    out << "],\"in_transition\":" << (cluster->inTransition() ? "true" : "false")
+        << ",\"imported\":" << rebalancer->importedCount()
+        << ",\"dropped\":" << rebalancer->droppedCount()
+        << ",\"handoffs\":[";
+    std::vector<HandoffStats> handoffs = rebalancer->stats();
+    for (size_t i = 0; i < handoffs.size(); ++i) {
+        const HandoffStats& h = handoffs[i];
+        out << (i > 0 ? "," : "") << "{\"target\":\"" << h.target << "\""
+            << ",\"done\":" << (h.done ? "true" : "false")
+            << ",\"given_up\":" << (h.given_up ? "true" : "false")
+            << ",\"planned\":" << h.planned
+            << ",\"shipped\":" << h.shipped
+            << ",\"invalidated\":" << h.invalidated
+            << ",\"failed_batches\":" << h.failed_batches << "}";
+    }
+    out << "]}";
+    res.set_content(out.str(), "application/json");
+}
+
+// 10. Replication stream to a follower (GET /repl/stream?from=seq)
+void handle_repl_stream(const httplib::Request& req, httplib::Response& res) {
+    replicator->serveStream(req, res);
+}
+
+// 11. Promote this follower to leader (POST /repl/promote)
+void handle_repl_promote(const httplib::Request& req, httplib::Response& res) {
+    replicator->promote();
+    res.set_content("Promoted", "text/plain");
+}
+
+// 12. Follow another leader (POST /repl/follow?leader=host:port)
+void handle_repl_follow(const httplib::Request& req, httplib::Response& res) {
+    if (!req.has_param("leader")) {
+        res.status = 400;
+        return;
+    }
+    // The leader writes the table from now on; this node's key filter stops tracking it
+    keyFilter->disable();
+    replicator->follow(req.get_param_value("leader"));
+    res.set_content("Following", "text/plain");
+}
+
+// 13. CPU profile (GET /debug/profile?seconds=N[&hz=H])
+// Blocks for N seconds, then returns collapsed stacks for flamegraph.pl or speedscope.
+void handle_debug_profile(const httplib::Request& req, httplib::Response& res) {
+    int seconds = req.has_param("seconds") ? std::atoi(req.get_param_value("seconds").c_str()) : 10;
+    int hz = req.has_param("hz") ? std::atoi(req.get_param_value("hz").c_str()) : Config::PROFILE_DEFAULT_HZ;
+    if (seconds < 1 || seconds > Config::PROFILE_MAX_SECONDS || hz < 1 || hz > Config::PROFILE_MAX_HZ) {
+        res.status = 400;
+        res.set_content("seconds must be 1-" + std::to_string(Config::PROFILE_MAX_SECONDS) +
+                        ", hz 1-" + std::to_string(Config::PROFILE_MAX_HZ), "text/plain");
+        return;
+    }
+    SamplingProfiler::Profile profile;
+    if (!profiler->run(seconds, hz, profile)) {
+        res.status = 409;
+        res.set_content("A profile is already running", "text/plain");
+        return;
+    }
+    res.set_header("X-Profile-Samples", std::to_string(profile.samples));
+    res.set_header("X-Profile-Dropped", std::to_string(profile.dropped));
+    res.set_content(profile.collapsed, "text/plain");
+}
+
+// Quote a request target for JSON output
+std::string json_string(const std::string& in) {
+    std::string out = "\"";
+    for (char c : in) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+// 14. Stage traces (GET /debug/traces[?limit=N&min_us=M])
+// Returns the requests finished since the previous call, slowest first.
+void handle_debug_traces(const httplib::Request& req, httplib::Response& res) {
+    size_t limit = req.has_param("limit") ? std::strtoul(req.get_param_value("limit").c_str(), nullptr, 10) : 100;
+    uint64_t min_ns = req.has_param("min_us") ? std::strtoull(req.get_param_value("min_us").c_str(), nullptr, 10) * 1000 : 0;
+
+    uint64_t lost = 0;
+    size_t threads = 0;
+    std::vector<tracing::Record> records = tracer->collect(lost, threads);
+    size_t collected = records.size();
+    records.erase(std::remove_if(records.begin(), records.end(),
+                                 [min_ns](const tracing::Record& r) { return r.total_ns < min_ns; }),
+                  records.end());
+    std::sort(records.begin(), records.end(),
+              [](const tracing::Record& a, const tracing::Record& b) { return a.total_ns > b.total_ns; });
+    if (records.size() > limit) records.resize(limit);
+
+    std::ostringstream out;
+    out << "{\"enabled\":" << (Config::TRACE_ENABLED ? "true" : "false")
+        << ",\"threads\":" << threads
+        << ",\"collected\":" << collected
+        << ",\"lost\":" << lost
+        << ",\"traces\":[";
+    for (size_t i = 0; i < records.size(); ++i) {
+        const tracing::Record& r = records[i];
+        out << (i > 0 ? "," : "") << "{\"method\":" << json_string(r.method)
+            << ",\"target\":" << json_string(r.target)
+            << ",\"status\":" << r.status
+            << ",\"total_us\":" << r.total_ns / 1000.0;
+        for (int st = 0; st < tracing::NUM_STAGES; ++st) {
+            out << ",\"" << tracing::stageName(st) << "_us\":" << r.stage_ns[st] / 1000.0;
+        }
+        out << "}";
+    }
+    out << "]}";
+    res.set_content(out.str(), "application/json");
+}
+
+// Push hot settings into the objects that cache them. The DB pool, admission
+// control and replica router read Config on every use and need nothing here.
+void apply_tunables() {
+    cache->setCapacity(Config::CACHE_CAPACITY_TOTAL);
+}
+
+bool reload_config(std::string& report) {
+    std::vector<std::string> changed, restart;
+    std::string error;
+    if (!config.reload(changed, restart, error)) {
+        report = "Config reload failed: " + error;
+        return false;
+    }
+    apply_tunables();
+    std::ostringstream out;
+    out << "Config reloaded from " << (config.file().empty() ? "command line" : config.file()) << ":";
+    if (changed.empty()) out << " no changes";
+    for (const auto& c : changed) out << " " << c;
+    if (!restart.empty()) {
+        out << "; restart needed for";
+        for (const auto& r : restart) out << " " << r;
+    }
+    report = out.str();
+    return true;
+}
+
+// 15. Settings (GET /admin/config)
+void handle_admin_config_get(const httplib::Request& req, httplib::Response& res) {
+    std::ostringstream out;
+    out << "{\"file\":" << json_string(config.file()) << ",\"settings\":[";
+    const auto& settings = config.all();
+    for (size_t i = 0; i < settings.size(); ++i) {
+        out << (i > 0 ? "," : "") << "{\"name\":\"" << settings[i].name << "\""
+            << ",\"value\":" << (settings[i].name == "DB_PASS" ? "\"***\"" : json_string(settings[i].get()))
+            << ",\"hot\":" << (settings[i].hot ? "true" : "false") << "}";
+    }
+    out << "]}";
+    res.set_content(out.str(), "application/json");
+}
+
+// 16. Change hot settings (POST /admin/config?NAME=value[&NAME=value...])
+// A later reload resets settings that the config file or command line name.
+void handle_admin_config_set(const httplib::Request& req, httplib::Response& res) {
+    if (req.params.empty()) {
+        res.status = 400;
+        res.set_content("Expected NAME=value parameters", "text/plain");
+        return;
+    }
+    std::string error;
+    for (const auto& p : req.params) {
+        const ConfigLoader::Setting* s = config.find(p.first);
+        if (s == nullptr || !s->hot) {
+            res.status = 400;
+            res.set_content(s == nullptr ? "Unknown setting " + p.first : s->name + " needs a restart", "text/plain");
+            return;
+        }
+    }
+    for (const auto& p : req.params) {
+        if (!config.setHot(p.first, p.second, error)) {
+            res.status = 400;
+            res.set_content(error, "text/plain");
+            apply_tunables();   // Keep the settings applied before the bad one consistent
+            return;
+        }
+    }
+    apply_tunables();
+    handle_admin_config_get(req, res);
+}
+
+// 17. Re-read the config file (POST /admin/reload, or SIGHUP)
+void handle_admin_reload(const httplib::Request& req, httplib::Response& res) {
+    std::string report;
+    if (!reload_config(report)) res.status = 400;
+    std::cout << report << std::endl;
+    res.set_content(report, "text/plain");
+}
+
+// Position of a range scan between batches
+struct ScanCursor {
+    std::string from;          // Next batch starts at this key (inclusive until the first row is read)
+    bool after = false;        // Start strictly after `from`
+    std::string end;           // Exclusive upper bound, empty = none
+    std::string like;          // LIKE pattern for the prefix, empty = none
+    size_t remaining = 0;      // Rows still to return
+    bool done = false;
+};
+
+// Read the next batch of a scan as NDJSON lines into `out`. Returns the HTTP
+// status: 200, 500 on SQL error, 503 if no connection was available.
+// Each batch is one index-range query on the primary key, restarted after the
+// last key returned, so no connection is held while the client reads.
+int scan_batch(ScanCursor& c, std::string& out) {
+    size_t batch = std::min<size_t>(c.remaining, Config::SCAN_BATCH_SIZE);
+    // Cached entries written after this point may be newer than the rows read.
+    // A replica can additionally be up to REPLICA_MAX_LAG_SEC behind.
+    uint64_t read_version = versionClock->now();
+    int target = readRouter->pick();
+    uint64_t overlay_from = read_version;
+    if (target != ReplicaRouter::PRIMARY) overlay_from -= std::min<uint64_t>(overlay_from, (uint64_t)Config::REPLICA_MAX_LAG_SEC * 1000000);
+    DBPool* pool = readRouter->pool(target);
+    sql::Connection* con = borrow(pool);
+    if (con == nullptr) {
+        readRouter->done(target);
+        return 503;
+    }
+
+    std::string query = std::string("SELECT key_name, value FROM key_value WHERE key_name ") + (c.after ? ">" : ">=") + " ?";
+    if (!c.end.empty()) query += " AND key_name < ?";
+    if (!c.like.empty()) query += " AND key_name LIKE ?";
+    query += " ORDER BY key_name LIMIT ?";
+
+    size_t rows = 0;
+    bool failed = false;
+    std::vector<std::pair<std::string, std::string>> found;
+    try {
+        tracing::Span span(tracing::SQL);
+        std::unique_ptr<sql::PreparedStatement> pstmt(con->prepareStatement(query));
+        int param = 1;
+        pstmt->setString(param++, c.from);
+        if (!c.end.empty()) pstmt->setString(param++, c.end);
+        if (!c.like.empty()) pstmt->setString(param++, c.like);
+        pstmt->setInt(param, (int)batch);
+        std::unique_ptr<sql::ResultSet> res_set(pstmt->executeQuery());
+        while (res_set->next()) found.emplace_back(res_set->getString("key_name"), res_set->getString("value"));
+    } catch (sql::SQLException &e) {
+        std::cerr << "SQL Error in Scan: " << e.what() << std::endl;
+        failed = true;
+    }
+    pool->releaseConnection(con, failed);
+    readRouter->done(target);
+    if (failed) return 500;
+
+    tracing::Span span(tracing::CACHE);
+    for (auto& row : found) {
+        std::string cached;
+        uint64_t version = 0;
+        if (cache->peek(row.first, cached, version) && version >= overlay_from) row.second = std::move(cached);
+        out += "{\"key\":" + json_string(row.first) + ",\"value\":" + json_string(row.second) + "}\n";
+        rows++;
+    }
+    if (rows > 0) {
+        c.from = found.back().first;
+        c.after = true;
+    }
+    c.remaining -= rows;
+    c.done = rows < batch || c.remaining == 0;
+    return 200;
+}
+
+// 18. Range scan (GET /api/scan[?start=a&end=b&prefix=p&limit=N])
+// Keys in [start, end) starting with `prefix`, in key order, streamed as one
+// JSON object per line. `after=k` starts strictly after k, for paging.
+void handle_scan(const httplib::Request& req, httplib::Response& res) {
+    std::shared_ptr<ScanCursor> c = std::make_shared<ScanCursor>();
+    c->from = req.get_param_value("start");
+    if (req.has_param("after")) {
+        c->from = req.get_param_value("after");
+        c->after = true;
+    }
+    c->end = req.get_param_value("end");
+    std::string prefix = req.get_param_value("prefix");
+    if (!prefix.empty()) {
+        // The prefix is also a lower bound, so the range starts in the right place
+        if (c->from < prefix) {
+            c->from = prefix;
+            c->after = false;
+        }
+        for (char ch : prefix) {
+            if (ch == '%' || ch == '_' || ch == '\\') c->like += '\\';
+            c->like += ch;
+        }
+        c->like += '%';
+    }
+    long long limit = req.has_param("limit") ? std::atoll(req.get_param_value("limit").c_str()) : Config::SCAN_DEFAULT_LIMIT;
+    if (limit < 1) {
+        res.status = 400;
+        res.set_content("limit must be at least 1", "text/plain");
+        return;
+    }
+    c->remaining = (size_t)limit;
+
+    // A scan costs DB round trips like a cache miss
+    if (!admission->admitMiss()) {
+        set_overloaded(res);
+        return;
+    }
+
+    // The first batch is read before answering, so errors still get a status code
+    std::string first;
+    int status = scan_batch(*c, first);
+    if (status == 503) {
+        set_unavailable(res);
+        return;
+    } else if (status != 200) {
+        res.status = status;
+        return;
+    }
+    if (c->done) {
+        res.set_content(first, "application/x-ndjson");
+        return;
+    }
+    std::shared_ptr<std::string> pending = std::make_shared<std::string>(std::move(first));
+    res.set_chunked_content_provider("application/x-ndjson",
+        [c, pending](size_t offset, httplib::DataSink& sink) {
+            if (!pending->empty()) {
+                bool ok = sink.write(pending->data(), pending->size());
+                pending->clear();
+                return ok;
+            }
+            if (c->done) {
+                sink.done();
+                return true;
+            }
+            std::string out;
+            if (scan_batch(*c, out) != 200) {
+                // Headers are gone; end the stream with an error line the client can detect
+                out = "{\"error\":\"scan interrupted\"}\n";
+                c->done = true;
+            }
+            return out.empty() || sink.write(out.data(), out.size());
+        });
+}
+
+// Current value and version of a counter from the primary, creating the row at 0
+// if absent. Returns the HTTP status: 200, 500 on SQL error, 503 if no connection was available.
+int load_counter(const std::string& k, std::string& base, uint64_t& version) {
+    sql::Connection* con = borrow(dbPool);
+    if (con == nullptr) return 503;
+    int status = 500;
+    try {
+        tracing::Span span(tracing::SQL);
+        // Anything longer than an int64 is not a counter; do not fetch it
+        std::unique_ptr<sql::PreparedStatement> select(con->prepareStatement("SELECT IF(LENGTH(value) > 20, '', value) AS value, version FROM key_value WHERE key_name = ?"));
+        select->setString(1, k);
+        for (int attempt = 0; attempt < 2 && status != 200; ++attempt) {
+            std::unique_ptr<sql::ResultSet> res_set(select->executeQuery());
+            if (res_set->next()) {
+                base = res_set->getString("value");
+                version = res_set->getUInt64("version");
+                status = 200;
+                break;
+            }
+            version = versionClock->now();
+            std::unique_ptr<sql::PreparedStatement> create(con->prepareStatement("INSERT IGNORE INTO key_value (key_name, value, version) VALUES (?, '0', ?)"));
+            create->setString(1, k);
+            create->setUInt64(2, version);
+            keyFilter->add(k);
+            int inserted;
+            try {
+                inserted = create->executeUpdate();
+            } catch (sql::SQLException&) {
+                keyFilter->remove(k);
+                throw;
+            }
+            if (inserted > 0) {
+                base = "0";
+                status = 200;
+            } else {
+                keyFilter->remove(k);
+            }
+            // Otherwise another request created it first: read that row
+        }
+    } catch (sql::SQLException &e) {
+        std::cerr << "SQL Error in Incr: " << e.what() << std::endl;
+    }
+    dbPool->releaseConnection(con, status != 200);
+    return status;
+}
+
+// 19. Counter increment (POST /api/incr?key=x[&delta=N])
+// Adds `delta` (default 1, may be negative) to an integer value and returns the
+// result. A missing key starts at 0. The increment is applied in the counter's
+// cache entry and reaches MySQL with the next flush, or before the answer with COUNTER_SYNC.
+void handle_incr(const httplib::Request& req, httplib::Response& res) {
+    long long delta = 1;
+    if (!req.has_param("key") || (req.has_param("delta") && !parseCounter(req.get_param_value("delta"), delta))) {
+        res.status = 400;
+        return;
+    }
+    std::string k = req.get_param_value("key");
+    bool deferred = !Config::COUNTER_SYNC;
+
+    long long value = 0;
+    uint64_t version = 0;
+    IncrResult result;
+    PendingWrite sync;
+    {
+        tracing::Span span(tracing::CACHE);
+        result = cache->incr(k, delta, nullptr, deferred, value, version, &sync);
+    }
+    // Not cached: start from the DB value, unless another instance wrote the key meanwhile
+    for (int attempt = 0; result == IncrResult::MISSING && attempt < 3; ++attempt) {
+        uint64_t read_version = versionClock->now();
+        std::string base;
+        int status = load_counter(k, base, version);
+        if (status == 503) {
+            set_unavailable(res);
+            return;
+        } else if (status != 200) {
+            res.status = status;
+            return;
+        }
+        if (!invalidationBus->shouldCacheFill(k, read_version)) continue;
+        tracing::Span span(tracing::CACHE);
+        result = cache->incr(k, delta, &base, deferred, value, version, &sync);
+    }
+
+    if (result == IncrResult::NOT_INTEGER) {
+        res.status = 409;
+        res.set_content("Value is not an integer", "text/plain");
+        return;
+    } else if (result == IncrResult::OVERFLOW) {
+        res.status = 409;
+        res.set_content("Increment would overflow", "text/plain");
+        return;
+    } else if (result == IncrResult::MISSING) {
+        res.status = 503;
+        res.set_header("Retry-After", std::to_string(Config::RETRY_AFTER_SEC));
+        res.set_content("Counter is being rewritten", "text/plain");
+        return;
+    }
+    counters->counted();
+    if (!deferred) {
+        std::vector<PendingWrite> writes = {sync};
+        bool ok;
+        {
+            tracing::Span span(tracing::SQL);
+            ok = counters->write(writes);
+        }
+        cache->settle(writes[0], ok, true);
+        if (!ok) {
+            res.status = 500;
+            return;
+        }
+        // A write to the key landed first; the counter was dropped and is read again next time
+        if (!writes[0].applied) {
+            res.status = 503;
+            res.set_header("Retry-After", std::to_string(Config::RETRY_AFTER_SEC));
+            res.set_content("Counter is being rewritten", "text/plain");
+            return;
+        }
+    }
+    res.set_header("X-KV-Version", std::to_string(version));
+    res.set_content(std::to_string(value), "text/plain");
+}
+
+// Records of a bulk load on their way to MySQL. Parsed records are inserted
+// with multi-row statements of up to BULK_STATEMENT_ROWS rows (or
+// BULK_STATEMENT_BYTES), and the transaction is committed every
+// BULK_TRANSACTION_ROWS rows. Caches, followers and the key filter learn of the
+// rows the same way as for single writes, once they are committed.
+struct BulkLoad {
+    // A row inserted but not yet committed
+    struct Row {
+        std::string key;
+        std::string value;      // Kept only when the cache is being filled
+        bool cache;
+        uint64_t version;
+    };
+
+    bool populate = false;      // Cache the values, not just drop stale copies
+    std::string buf;            // Body bytes not yet parsed
+    std::vector<std::pair<std::string, std::string>> batch;   // Parsed, not yet inserted
+    size_t batch_bytes = 0;
+    std::vector<Row> uncommitted;
+    sql::Connection* con = nullptr;
+    std::unique_ptr<sql::PreparedStatement> full;   // INSERT for a full batch, prepared once
+    uint64_t loaded = 0;        // Rows committed
+    uint64_t statements = 0;
+    uint64_t transactions = 0;
+    uint64_t parsed_bytes = 0;
+    int status = 200;           // 400 on a malformed record, 500 on SQL error, 503 without a connection
+    bool too_large = false;     // The 400 is for a key or value over its limit
+
+    static size_t maxRows() {
+        return (size_t)std::max(1, std::min(Config::BULK_STATEMENT_ROWS, 21845));
+    }
+
+    // Racing writes keep the highest version, as in write_row()
+    static sql::PreparedStatement* prepare(sql::Connection* c, size_t rows) {
+        std::string q = "INSERT INTO key_value (key_name, value, version) VALUES (?, ?, ?)";
+        q.reserve(q.size() + rows * 11 + 128);
+        for (size_t i = 1; i < rows; ++i) q += ",(?, ?, ?)";
+        q += " ON DUPLICATE KEY UPDATE value = IF(version < VALUES(version), VALUES(value), value), "
+             "version = GREATEST(version, VALUES(version))";
+        return c->prepareStatement(q);
+    }
+
+    // Keys of `batch` that are already in key_value, among those the key filter may hold.
+    // FOR UPDATE keeps them from being deleted (dropping their count) before the upsert
+    // re-creates them. Before the filter is ready every key is added instead.
+    std::unordered_set<std::string> existingKeys() {
+        std::unordered_set<std::string> found;
+        if (!keyFilter->isReady()) return found;
+        std::vector<const std::string*> maybe;
+        for (const auto& r : batch) {
+            if (keyFilter->mayContain(r.first)) maybe.push_back(&r.first);
+        }
+        if (maybe.empty()) return found;
+        std::string q = "SELECT key_name FROM key_value WHERE key_name IN (?";
+        for (size_t i = 1; i < maybe.size(); ++i) q += ", ?";
+        q += ") FOR UPDATE";
+        std::unique_ptr<sql::PreparedStatement> pstmt(con->prepareStatement(q));
+        for (size_t i = 0; i < maybe.size(); ++i) pstmt->setString(i + 1, *maybe[i]);
+        std::unique_ptr<sql::ResultSet> rs(pstmt->executeQuery());
+        while (rs->next()) found.insert(rs->getString(1));
+        return found;
+    }
+
+    // Parse the complete records at the front of `buf`: "<klen> <vlen>\n<key><value>"
+    void parse() {
+        size_t pos = 0;
+        while (status == 200) {
+            size_t nl = buf.find('\n', pos);
+            if (nl == std::string::npos) {
+                if (buf.size() - pos > 42) status = 400;   // Longer than any two lengths
+                break;
+            }
+            size_t klen = 0, vlen = 0;
+            const char* p = buf.data() + pos;
+            const char* end = buf.data() + nl;
+            auto k = std::from_chars(p, end, klen);
+            bool ok = k.ec == std::errc() && k.ptr < end && *k.ptr == ' ';
+            if (ok) {
+                auto v = std::from_chars(k.ptr + 1, end, vlen);
+                ok = v.ec == std::errc() && v.ptr == end;
+            }
+            if (!ok) {
+                status = 400;
+                break;
+            }
+            // Checked before buffering: lengths a row cannot hold would otherwise be waited for in memory
+            if (klen > Config::BULK_MAX_KEY_BYTES || vlen > Config::BULK_MAX_VALUE_BYTES) {
+                too_large = true;
+                status = 400;
+                break;
+            }
+            if (buf.size() - (nl + 1) < klen + vlen) break;
+            batch.emplace_back(buf.substr(nl + 1, klen), buf.substr(nl + 1 + klen, vlen));
+            batch_bytes += klen + vlen;
+            pos = nl + 1 + klen + vlen;
+            if (batch.size() >= maxRows() || batch_bytes >= Config::BULK_STATEMENT_BYTES) insert();
+        }
+        parsed_bytes += pos;
+        buf.erase(0, pos);
+    }
+
+    // Send `batch` to MySQL as one statement
+    void insert() {
+        if (status == 200 && !batch.empty()) {
+            try {
+                tracing::Span span(tracing::SQL);
+                if (con == nullptr) {
+                    con = borrow(dbPool);
+                    if (con == nullptr) {
+                        status = 503;
+                        batch.clear();
+                        return;
+                    }
+                    con->setAutoCommit(false);
+                }
+                std::unique_ptr<sql::PreparedStatement> partial;
+                sql::PreparedStatement* pstmt;
+                if (batch.size() == maxRows()) {
+                    if (!full) full.reset(prepare(con, batch.size()));
+                    pstmt = full.get();
+                } else {
+                    partial.reset(prepare(con, batch.size()));
+                    pstmt = partial.get();
+                }
+                std::unordered_set<std::string> existing = existingKeys();
+                for (size_t i = 0; i < batch.size(); ++i) {
+                    const std::string& k = batch[i].first;
+                    const std::string& v = batch[i].second;
+                    uint64_t version = versionClock->now();
+                    if (!existing.count(k)) keyFilter->add(k);
+                    pstmt->setString(3 * i + 1, k);
+                    pstmt->setString(3 * i + 2, v);
+                    pstmt->setUInt64(3 * i + 3, version);
+                    bool cache = populate && !is_large(v.size());
+                    uncommitted.push_back({k, cache ? v : std::string(), cache, version});
+                }
+                pstmt->executeUpdate();
+                statements++;
+                if (uncommitted.size() >= (size_t)Config::BULK_TRANSACTION_ROWS) commit();
+            } catch (sql::SQLException &e) {
+                std::cerr << "SQL Error in Bulk Load: " << e.what() << std::endl;
+                status = 500;
+            }
+        }
+        batch.clear();
+        batch_bytes = 0;
+    }
+
+    // Commit, then publish the rows: cache or drop them here, drop them on the
+    // cluster node that owns them, and tell other instances and followers
+    void commit() {
+        con->commit();
+        transactions++;
+        loaded += uncommitted.size();
+        std::map<std::string, std::vector<HandoffRecord>> drops;
+        for (const Row& r : uncommitted) {
+            std::string owner;
+            bool local = !cluster->enabled() || cluster->route(r.key, owner);
+            publish_write(r.key, r.cache && local ? &r.value : nullptr, r.version);
+            if (!local) drops[owner].push_back({'D', r.key, ""});
+            else if (cluster->enabled()) rebalancer->noteWrite(r.key);
+        }
+        for (const auto& d : drops) cluster->post(d.first, "/cluster/import", encodeRecords(d.second));
+        uncommitted.clear();
+    }
+
+    // Insert and commit what is left, or roll back the open transaction
+    void finish() {
+        if (status == 200 && !buf.empty()) status = 400;   // Truncated record
+        insert();
+        if (con == nullptr) return;
+        try {
+            if (status == 200) {
+                if (!uncommitted.empty()) commit();
+            } else {
+                con->rollback();
+            }
+            con->setAutoCommit(true);
+        } catch (sql::SQLException &e) {
+            std::cerr << "SQL Error in Bulk Load: " << e.what() << std::endl;
+            status = 500;
+        }
+        dbPool->releaseConnection(con, status == 500);
+        con = nullptr;
+    }
+};
+
+// 20. Bulk load (POST /api/bulk[?cache=1])
+// The body is a stream of "<klen> <vlen>\n<key><value>" records, each inserted
+// or overwritten. With cache=1 the values are also cached. Transactions already
+// committed stay when a later one fails; the answer reports the rows loaded.
+void handle_bulk(const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader) {
+    if (!admission->admitWrite()) {
+        drain(reader);
+        set_overloaded(res);
+        return;
+    }
+    std::string target = forward_target(req, "", false);
+    if (!target.empty()) {
+        // The leader takes the whole body in one request, streamed through as it arrives
+        tracing::Span span(tracing::FORWARD);
+        cluster->forward(target, req, res, &reader);
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    BulkLoad load;
+    load.populate = req.get_param_value("cache") == "1" || req.get_param_value("cache") == "true";
+    reader([&](const char* data, size_t len) {
+        if (load.status != 200) return true;   // Keep reading after a failure so the connection stays usable
+        load.buf.append(data, len);
+        load.parse();
+        return true;
+    });
+    load.finish();
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (load.status == 503) {
+        set_unavailable(res);
+        return;
+    }
+    res.status = load.status;
+    std::ostringstream out;
+    out << "{\"loaded\":" << load.loaded
+        << ",\"statements\":" << load.statements
+        << ",\"transactions\":" << load.transactions
+        << ",\"ms\":" << ms;
+    if (load.status == 400 && load.too_large) {
+        out << ",\"error\":\"Record too large at byte " << load.parsed_bytes << " (keys up to " << Config::BULK_MAX_KEY_BYTES
+            << " bytes, values up to " << Config::BULK_MAX_VALUE_BYTES << ")\"";
+    } else if (load.status == 400) {
+        out << ",\"error\":\"Malformed record at byte " << load.parsed_bytes << "\"";
+    } else if (load.status == 500) {
+        out << ",\"error\":\"Database error\"";
+    }
+    out << "}";
+    res.set_content(out.str(), "application/json");
+}
+
+// 21. Give up a stuck rebalance (POST /cluster/abandon)
+// Send to every node. Moved keys switch to their new owners at once and are read from the database.
+void handle_cluster_abandon(const httplib::Request& req, httplib::Response& res) {
+    if (!rebalancer->abandon()) {
+        res.status = 409;
+        res.set_content("No rebalance in progress", "text/plain");
+        return;
+    }
+    res.set_content("Rebalance abandoned", "text/plain");
+}
+
+void start_reload_watcher() {
+    std::thread([] {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGHUP);
+        for (;;) {
+            int sig = 0;
+            if (sigwait(&set, &sig) != 0) continue;
+            std::string report;
+            reload_config(report);
+            std::cout << report << std::endl;
+        }
+    }).detach();
+}
+
+httplib::TaskQueue* new_task_queue() {
+    // Connection queueing time feeds admission control and the connection's first trace
+    workerPool = new WorkStealingPool(
+        Config::SERVER_THREAD_POOL_SIZE, Config::SERVER_WORKER_QUEUE_CAPACITY,
+        [] { admission->onEnqueue(); },
+        [](uint64_t waited_ns) {
+            admission->onDequeue(waited_ns);
+            tracing::pendingQueueNs() = waited_ns;
+        },
+        workerCpus);
+    return workerPool;
+}
+
+void init_services(const ServerOptions& opts) {
+    cluster = new Cluster(opts.self_id, Config::CLUSTER_NODES);
+    if (cluster->enabled()) {
+        bool member = false;
+        for (const auto& n : cluster->nodes()) member = member || n == opts.self_id;
+        if (!member) std::cerr << "Warning: " << opts.self_id << " is not in CLUSTER_NODES, all requests will be forwarded" << std::endl;
+    }
+
+    topology = placement::Topology::detect();
+    workerCpus = placement::parseCpuList(Config::SERVER_WORKER_CPUS);
+    dbThreadCpus = placement::parseCpuList(Config::DB_THREAD_CPUS);
+
+    dbPool = new DBPool(opts.db_host);
+    readRouter = new ReplicaRouter(dbPool, Config::DB_READ_REPLICAS);
+    if (Config::CACHE_NUMA_PLACEMENT) {
+        std::vector<int> nodes = placement::shardNodes(topology, workerCpus, Config::CACHE_SHARDS);
+        cache = new ShardedLRUCache(Config::CACHE_CAPACITY_TOTAL, Config::CACHE_SHARDS, &topology, nodes);
+    } else {
+        cache = new ShardedLRUCache(Config::CACHE_CAPACITY_TOTAL, Config::CACHE_SHARDS);
+    }
+    rebalancer = new Rebalancer(cluster, cache);
+    replicator = new Replicator(cache, opts.repl_role, opts.repl_leader);
+    versionClock = new VersionClock();
+    invalidationBus = new InvalidationBus(cache, versionClock);
+    profiler = new SamplingProfiler();
+    tracer = new tracing::Tracer();
+    admission = new AdmissionController();
+    // Flushed counters: other instances and followers drop their copy and re-read MySQL
+    counters = new CounterFlusher(cache, dbPool, [](const std::string& k, uint64_t version) {
+        invalidationBus->publish(k, version);
+        replicator->append('D', k);
+    });
+    // Other writers (cluster peers, a replication leader, instances on the
+    // invalidation bus) insert keys the filter never sees: standalone nodes only
+    bool filter_keys = Config::KEY_FILTER_ENABLED && !cluster->enabled() && !replicator->isFollower() && !invalidationBus->enabled();
+    keyFilter = new KeyFilter(filter_keys ? Config::KEY_FILTER_EXPECTED_KEYS : 0, Config::KEY_FILTER_COUNTERS_PER_KEY);
+    if (filter_keys) keyFilter->build(dbPool);
+    else keyFilter->disable();
+
+    // Every thread started so far besides this one is a service thread (DB pool
+    // maintenance and reconnects, replica lag checks, replication, invalidation bus)
+    backgroundPinned = placement::pinOtherThreads(dbThreadCpus);
+}
+
+std::string placement_report() {
+    std::ostringstream out;
+    for (int n = 0; n < topology.numNodes(); ++n) {
+        if (topology.node_cpus[n].empty()) continue;
+        out << "NUMA Node " << n << ":      CPUs " << placement::formatCpuList(topology.node_cpus[n]) << "\n";
+    }
+    out << "Worker CPUs:      " << (workerCpus.empty() ? "any" : placement::formatCpuList(workerCpus)) << "\n";
+    out << "DB Thread CPUs:   " << (dbThreadCpus.empty() ? "any" : placement::formatCpuList(dbThreadCpus) + " (" + std::to_string(backgroundPinned) + " threads)") << "\n";
+    out << "Cache Shards:     ";
+    std::vector<ShardStats> shards = cache->stats();
+    for (size_t i = 0; i < shards.size(); ++i) {
+        out << (i > 0 ? " " : "") << i << "@" << (shards[i].node < 0 ? std::string("any") : "node" + std::to_string(shards[i].node));
+    }
+    return out.str();
+}
+
+void register_routes(httplib::Server& svr) {
+    svr.Post("/api/data", handle_data_body);
+    svr.Get("/api/data", owned(handle_read));
+    svr.Put("/api/data", handle_data_body);
+    svr.Delete("/api/data", owned(handle_delete));
+    svr.Get("/api/scan", handle_scan);
+    svr.Post("/api/incr", owned(handle_incr));
+    svr.Post("/api/bulk", handle_bulk);
+    svr.Get("/stats", handle_stats);
+    svr.Post("/cluster/members", handle_cluster_members);
+    svr.Post("/cluster/import", handle_cluster_import);
+    svr.Post("/cluster/handoff_done", handle_cluster_handoff_done);
+    svr.Get("/cluster/status", handle_cluster_status);
+    svr.Post("/cluster/abandon", handle_cluster_abandon);
+    svr.Get("/repl/stream", handle_repl_stream);
+    svr.Post("/repl/promote", handle_repl_promote);
+    svr.Post("/repl/follow", handle_repl_follow);
+    svr.Get("/debug/profile", handle_debug_profile);
+    svr.Get("/debug/traces", handle_debug_traces);
+    svr.Get("/admin/config", handle_admin_config_get);
+    svr.Post("/admin/config", handle_admin_config_set);
+    svr.Post("/admin/reload", handle_admin_reload);
+
+    // Every routed request is traced from routing until its response is written
+    svr.set_pre_routing_handler([](const httplib::Request&, httplib::Response&) {
+        tracer->begin();
+        return httplib::Server::HandlerResponse::Unhandled;
+    });
+    svr.set_post_routing_handler([](const httplib::Request& req, httplib::Response& res) {
+        std::string timing = tracer->finish(req.method, req.target, res.status);
+        if (!timing.empty()) res.set_header("Server-Timing", timing);
+    });
+}
+
+void shutdown_services() {
+    delete keyFilter;
+    delete counters;
+    delete admission;
+    delete tracer;
+    delete profiler;
+    delete invalidationBus;
+    delete versionClock;
+    delete replicator;
+    delete rebalancer;
+    delete cache;
+    delete readRouter;
+    delete dbPool;
+    delete cluster;
+}
@@ -5,83 +5,55 @@
 #include <chrono>
 #include <limits> // For std::numeric_limits
 
-#include "httplib.h" // Assuming httplib.h is in your include path
+#include "kv_client.h"
 
 #include "constants.h"
 
-// Helper function to send HTTP requests and print results
-std::string send_kv_request(const std::string& method, const std::string& key, const std::string& value = "") {
-    httplib::Client cli(Config::SERVER_ADDRESS, Config::SERVER_PORT);
-    cli.set_connection_timeout(0, 300000); // 300ms
-    cli.set_read_timeout(5, 0);            // 5 seconds
-    cli.set_write_timeout(5, 0);           // 5 seconds
-
-    std::string path;
-    httplib::Result res;
-    httplib::Params params; // For POST requests with form parameters
-
-    auto start_time = std::chrono::high_resolution_clock::now();
-
-    if (method == "GET") {
-        path = "/kv/" + key;
-        res = cli.Get(path.c_str());
-    } else if (method == "POST") { // Used for 'add' and 'update' in this client, as per server API
-        path = "/kv"; // POST /kv expects form parameters
-        params.emplace("key", key);
-        params.emplace("value", value);
-        res = cli.Post(path.c_str(), params);
-    } else if (method == "PUT") {
-        path = "/kv/" + key; 
-        // httplib can send params in body for PUT similarly to POST
-        params.emplace("value", value); 
-        res = cli.Put(path.c_str(), params);
-    }else if (method == "DELETE") {
-        path = "/kv/" + key;
-        res = cli.Delete(path.c_str());
-    } else {
-        std::cerr << "Error: Invalid internal HTTP method specified." << std::endl;
-        return "Error: Invalid internal HTTP method specified.";
-    }
+// One client for the whole session: connections stay open between commands
+kv::Client client(Config::SERVER_ADDRESS, Config::SERVER_PORT);
 
+// Print latency and status of a completed request and return its body
+std::string report(const kv::Result& res, std::chrono::high_resolution_clock::time_point start_time) {
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
     double latency_ms = static_cast<double>(duration.count()) / 1000.0;
 
     std::cout << "Request Latency: " << std::fixed << std::setprecision(3) << latency_ms << " ms" << std::endl;
 
-    if (res) {
-        std::cout << "HTTP Status: " << res->status << std::endl;
-        return res->body;
+    if (res.status != 0) {
+        std::cout << "HTTP Status: " << res.status << std::endl;
+        if (!res.cache_status.empty()) std::cout << "Cache: " << res.cache_status << std::endl;
+        return res.value;
     } else {
-        auto err = res.error();
-        std::cerr << "Network/Client Error: " << httplib::to_string(err) << std::endl;
-        return "Error: " + httplib::to_string(err);
+        std::cerr << "Network/Client Error: " << res.error << std::endl;
+        return "Error: " + res.error;
     }
 }
 
-// Function to send a request for server statistics
-std::string send_stats_request() {
-    httplib::Client cli(Config::SERVER_ADDRESS, Config::SERVER_PORT);
-    cli.set_connection_timeout(0, 300000); // 300ms
-    cli.set_read_timeout(5, 0);            // 5 seconds
-    cli.set_write_timeout(5, 0);           // 5 seconds
-
+// Helper function to send KV requests and print results
+std::string send_kv_request(const std::string& method, const std::string& key, const std::string& value = "") {
     auto start_time = std::chrono::high_resolution_clock::now();
-    httplib::Result res = cli.Get("/stats");
-    auto end_time = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
-    double latency_ms = static_cast<double>(duration.count()) / 1000.0;
+    kv::Result res;
 
-    std::cout << "Request Latency: " << std::fixed << std::setprecision(3) << latency_ms << " ms" << std::endl;
-
-    if (res) {
-        std::cout << "HTTP Status: " << res->status << std::endl;
-        return res->body;
+    if (method == "GET") {
+        res = client.get(key);
+    } else if (method == "POST") { // 'add': insert or overwrite
+        res = client.put(key, value);
+    } else if (method == "PUT") {  // 'update': existing keys only
+        res = client.update(key, value);
+    } else if (method == "DELETE") {
+        res = client.del(key);
     } else {
-        auto err = res.error();
-        std::cerr << "Network/Client Error: " << httplib::to_string(err) << std::endl;
-        return "Error: " + httplib::to_string(err);
+        std::cerr << "Error: Invalid internal HTTP method specified." << std::endl;
+        return "Error: Invalid internal HTTP method specified.";
     }
+    return report(res, start_time);
+}
+
+// Function to send a request for server statistics
+std::string send_stats_request() {
+    auto start_time = std::chrono::high_resolution_clock::now();
+    return report(client.stats(), start_time);
 }
 
 
@@ -119,14 +91,13 @@ int main() {
             std::string response_body = send_kv_request("GET", key);
             std::cout << "Server Response Body:\n" << response_body << std::endl;
 
-        } if (command == "add") {
+        } else if (command == "add") {
             std::cout << "Enter key to add: ";
             std::getline(std::cin, key);
             std::cout << "Enter value: ";
             std::getline(std::cin, value);
 
             // "add" uses POST (Insert)
-            // send_kv_request handles POST by sending to /kv with params
             std::string response = send_kv_request("POST", key, value);
             std::cout << "Response:\n" << response << std::endl;
 
@@ -137,7 +108,6 @@ int main() {
             std::getline(std::cin, value);
 
             // "update" uses PUT
-            // We need to ensure send_kv_request handles PUT correctly
             std::string response = send_kv_request("PUT", key, value);
             std::cout << "Response:\n" << response << std::endl;
 